@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_ADMISSION_CONTROL_HPP_INCLUDED_
+#define _COCAINE_DEALER_ADMISSION_CONTROL_HPP_INCLUDED_
+
+#include <string>
+#include <map>
+
+#include <boost/utility.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+// watermarks of messages queued and awaiting response, 0 - no limit
+struct queue_limits_t {
+	queue_limits_t() :
+		high_messages(0),
+		low_messages(0),
+		high_bytes(0),
+		low_bytes(0) {}
+
+	bool operator == (const queue_limits_t& rhs) const {
+		return (high_messages == rhs.high_messages &&
+				low_messages == rhs.low_messages &&
+				high_bytes == rhs.high_bytes &&
+				low_bytes == rhs.low_bytes);
+	}
+
+	size_t high_messages;
+	size_t low_messages;
+	size_t high_bytes;
+	size_t low_bytes;
+};
+
+// counts messages of a service and each of its handles, once a high
+// watermark is reached admission stays closed until usage falls to low one
+class admission_control_t : private boost::noncopyable {
+public:
+	struct usage_t {
+		usage_t() : messages(0), bytes(0), closed(false) {}
+
+		size_t messages;
+		size_t bytes;
+		bool closed;
+	};
+
+public:
+	admission_control_t(const queue_limits_t& service_limits,
+						const queue_limits_t& handle_limits);
+
+	bool is_enabled() const;
+
+	bool try_acquire(const std::string& handle_name, size_t bytes);
+
+	// waits up to timeout seconds for admission to open
+	bool acquire(const std::string& handle_name, size_t bytes, double timeout);
+
+	// ignores closed admission, message still must fit under high watermarks,
+	// used once older message was dropped to make room for this one
+	bool try_acquire_dropped(const std::string& handle_name, size_t bytes);
+
+	// whether message fits under handle high watermarks
+	bool handle_fits(const std::string& handle_name, size_t bytes);
+
+	void release(const std::string& handle_name, size_t bytes);
+
+	usage_t service_usage();
+	usage_t handle_usage(const std::string& handle_name);
+
+private:
+	// call under m_mutex
+	bool try_acquire_locked(usage_t& handle, size_t bytes, bool respect_closed);
+
+	static bool fits(const usage_t& usage, const queue_limits_t& limits, size_t bytes);
+	static bool drained(const usage_t& usage, const queue_limits_t& limits);
+
+private:
+	queue_limits_t m_service_limits;
+	queue_limits_t m_handle_limits;
+
+	usage_t m_service_usage;
+
+	// <handle name, usage>, kept while service lives as handles come and go
+	std::map<std::string, usage_t> m_handles_usage;
+
+	boost::mutex m_mutex;
+	boost::condition_variable m_opened;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_ADMISSION_CONTROL_HPP_INCLUDED_
@@ -0,0 +1,58 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_ASYNC_RESPONSE_HPP_INCLUDED_
+#define _COCAINE_DEALER_ASYNC_RESPONSE_HPP_INCLUDED_
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include "cocaine/dealer/response.hpp"
+#include "cocaine/dealer/response_chunk.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// response delivered through callbacks instead of blocking get(),
+// has no lock of its own, chunks are accepted under service responses
+// lock and delivered in order by a single completion thread
+class async_response_t : private boost::noncopyable {
+public:
+	async_response_t(const chunk_callback_t& on_chunk,
+					 const done_callback_t& on_done);
+
+	// false if chunk must be dropped, marks response finished by choke or error
+	bool accept(const response_chunk_t& chunk);
+	bool is_finished() const;
+
+	void deliver(const boost::shared_ptr<response_chunk_t>& chunk);
+
+private:
+	chunk_callback_t m_on_chunk;
+	done_callback_t m_on_done;
+
+	bool m_is_finished;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_ASYNC_RESPONSE_HPP_INCLUDED_
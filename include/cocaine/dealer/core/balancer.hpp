@@ -23,25 +23,39 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <map>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
 #include <zmq.hpp>
+#include <msgpack.hpp>
 
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/response_chunk.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/core/balancing_strategy.hpp"
+#include "cocaine/dealer/core/latency_tracker.hpp"
+#include "cocaine/dealer/utils/time_value.hpp"
 
 namespace cocaine {
 namespace dealer {
 
+// keeps a socket per endpoint address, so endpoints come and go
+// without touching connections to the rest of them
 class balancer_t : private boost::noncopyable, public dealer_object_t {
 public:
+	typedef boost::shared_ptr<zmq::socket_t> socket_ptr_t;
+
+	// <endpoint address, socket connected to it>
+	typedef std::map<std::string, socket_ptr_t> sockets_map_t;
+
 	balancer_t(const std::string& identity,
 			   const std::vector<cocaine_endpoint_t>& endpoints,
 			   const boost::shared_ptr<context_t>& ctx,
+			   enum e_balancing_type balancing_type = defaults_t::balancing_type,
 			   bool logging_enabled = true);
 
 	virtual ~balancer_t();
@@ -50,14 +64,40 @@ public:
 	void disconnect();
 
 	bool send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t& endpoint);
+
+	// sends messages in order until socket refuses one, returns number of
+	// messages sent and route each of them was sent to
+	size_t send_batch(const std::vector<boost::shared_ptr<message_iface> >& messages,
+					  std::vector<std::string>& routes);
+
+	// sends duplicate of message to any endpoint but the one with given route,
+	// false if there's no other endpoint available
+	bool send_hedge(const boost::shared_ptr<message_iface>& message,
+					const std::string& excluded_route,
+					cocaine_endpoint_t& endpoint);
+
 	bool receive(boost::shared_ptr<response_chunk_t>& response);
 
 	void update_endpoints(const std::vector<cocaine_endpoint_t>& endpoints,
 						  std::vector<cocaine_endpoint_t>& missing_endpoints);
 
-	bool check_for_responses(int poll_timeout) const;
+	// sorted endpoints, in-flight counts are expected in the same order
+	const std::vector<cocaine_endpoint_t>& endpoints() const;
+	bool uses_in_flight() const;
+	void set_in_flight(const std::vector<size_t>& in_flight);
+
+	// latency of messages sent to route, feeds endpoint scoring and ejection
+	void ack_received(const std::string& route, const time_value& sent_timestamp);
+	void response_received(const std::string& route, const time_value& sent_timestamp);
+
+	bool check_for_responses(int poll_timeout);
+
+	// appends poll item of every socket, returns number of items added
+	size_t poll_items(std::vector<zmq_pollitem_t>& items) const;
 
 	static const int socket_timeout = 0;
+	// unlimited, zmq 2.x router silently drops messages over hwm while
+	// they're counted as sent, admission control bounds queues instead
 	static const int64_t socket_hwm = 0;
 	static bool is_valid_rpc_code(int rpc_code);
 
@@ -66,15 +106,46 @@ private:
 							std::vector<cocaine_endpoint_t>& new_endpoints,
 							std::vector<cocaine_endpoint_t>& missing_endpoints);
 
-	void recreate_socket();
+	socket_ptr_t create_socket(const std::string& endpoint);
+
+	// connects sockets to new endpoint addresses, closes sockets
+	// of addresses no longer in use
+	void sync_sockets();
 
-	cocaine_endpoint_t& get_next_endpoint();
+	// refreshes latencies and ejections before sending
+	void update_loads();
+
+	// index of endpoint to send next message to
+	size_t get_next_endpoint();
+
+	bool send_frames(const boost::shared_ptr<message_iface>& message, size_t endpoint_index);
+	bool receive_frames(zmq::socket_t& socket, boost::shared_ptr<response_chunk_t>& response);
 
 private:
-	boost::shared_ptr<zmq::socket_t>	m_socket;
+	sockets_map_t						m_sockets;
+	bool								m_connected;
+
+	// socket of each endpoint, NULL until connected
+	std::vector<zmq::socket_t*>			m_endpoint_sockets;
+
+	// sockets are read in turns, poll items reused between polls
+	size_t								m_receive_index;
+	std::vector<zmq_pollitem_t>			m_poll_items;
+
 	std::vector<cocaine_endpoint_t>		m_endpoints;
-	size_t								m_current_endpoint_index;
 	std::string							m_socket_identity;
+
+	// load per endpoint, in-flight counts are bumped locally on each send
+	// so a batch doesn't pile up on one endpoint between refreshes
+	endpoint_loads_t					m_loads;
+	std::auto_ptr<balancing_strategy_t>	m_strategy;
+	latency_tracker_t					m_latency;
+
+	// time of last loads update
+	double								m_loads_timestamp;
+
+	// uuid and policy frames are packed here
+	msgpack::sbuffer					m_pack_buffer;
 };
 
 } // namespace dealer
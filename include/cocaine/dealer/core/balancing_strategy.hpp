@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_BALANCING_STRATEGY_HPP_INCLUDED_
+#define _COCAINE_DEALER_BALANCING_STRATEGY_HPP_INCLUDED_
+
+#include <vector>
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include "cocaine/dealer/defaults.hpp"
+#include "cocaine/dealer/core/cocaine_endpoint.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// locally observed load of an endpoint
+struct endpoint_load_t {
+	endpoint_load_t() :
+		in_flight(0),
+		latency(0.0),
+		ejected(false),
+		probing(false) {}
+
+	// messages awaiting response
+	size_t in_flight;
+
+	// peak ewma of route latency, seconds
+	double latency;
+
+	// outlier, no messages go there until ejection expires
+	bool ejected;
+
+	// ejection expired, next message sent there is a probe
+	bool probing;
+};
+
+typedef std::vector<endpoint_load_t> endpoint_loads_t;
+
+// picks endpoint for the next message out of balancer endpoints list
+class balancing_strategy_t : private boost::noncopyable {
+public:
+	virtual ~balancing_strategy_t() {}
+
+	// endpoints is never empty, loads go in the same order as endpoints,
+	// ejected endpoints are skipped unless all of them are ejected
+	virtual size_t select(const std::vector<cocaine_endpoint_t>& endpoints,
+						  const endpoint_loads_t& loads) = 0;
+
+	// false if select() ignores in-flight counts
+	virtual bool uses_in_flight() const = 0;
+
+	// load per node slave, as reported by heartbeats plus our own in-flight
+	static double load_score(const cocaine_endpoint_t& endpoint, size_t in_flight);
+
+	// finagle's peak ewma cost, latency weighted by in-flight messages
+	static double latency_score(const endpoint_load_t& load);
+
+	static bool all_ejected(const endpoint_loads_t& loads);
+
+	static balancing_strategy_t* create(enum e_balancing_type type);
+	static std::string type_name(enum e_balancing_type type);
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_BALANCING_STRATEGY_HPP_INCLUDED_
@@ -24,6 +24,7 @@
 #include <string>
 #include <sys/time.h>
 #include <cstring>
+#include <cstdlib>
 #include <iomanip>
 
 #include <boost/shared_ptr.hpp>
@@ -40,6 +41,7 @@
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/uuid.hpp"
 #include "cocaine/dealer/utils/progress_timer.hpp"
+#include "cocaine/dealer/storage/eblob_journal.hpp"
 
 namespace cocaine {
 namespace dealer {
@@ -55,6 +57,18 @@ public:
 					 const void* data,
 					 size_t data_size);
 
+	// data is copied once, right behind reserved record header, so the
+	// message is stored persistently with a single write and no more copies
+	cached_message_t(const message_path_t& path,
+					 const message_policy_t& policy,
+					 const void* data,
+					 size_t data_size,
+					 bool is_stored);
+
+	cached_message_t(const message_path_t& path,
+					 const message_policy_t& policy,
+					 const DataContainer& data);
+
 	cached_message_t(void* mdata,
 					 size_t mdata_size);
 
@@ -63,12 +77,14 @@ public:
 	void* data();
 	size_t size() const;
 
+	bool share_data(dealer::data_container& data) const;
+
 	DataContainer& data_container();
 	MetadataContainer& mdata_container();
 
 	const message_path_t& path() const;
 	const message_policy_t& policy() const;
-	const std::string& uuid() const;
+	const wuuid_t& uuid() const;
 
 	bool is_sent() const;
 	const time_value& sent_timestamp() const;
@@ -83,6 +99,10 @@ public:
 	void mark_as_sent(bool value);
 
 	bool is_expired();
+	bool is_expired(const time_value& now);
+
+	bool is_discarded() const;
+	void set_discarded(bool value);
 
 	message_iface& operator = (const message_iface& rhs);
 	bool operator == (const message_iface& rhs) const;
@@ -99,38 +119,120 @@ public:
 	void remove_from_persistent_cache();
 
 	void commit_to_eblob(boost::shared_ptr<eblob_t>& blob);
+	boost::uint64_t commit_to_journal(eblob_journal_t& journal, const boost::shared_ptr<eblob_t>& blob);
 
 private:
 	void init();
+
+	// eblob record is packed header followed by message data
+	void pack_header(std::string& header, size_t data_size) const;
+
+	// record built at creation, false once data was replaced
+	bool has_record() const;
+
+	// frees record the adopted data lives in, hint is record container
+	static void release_record(void* data, void* hint);
+
+	struct string_writer_t {
+		explicit string_writer_t(std::string& value_) : value(value_) {}
+
+		void write(const char* data, size_t size) {
+			value.append(data, size);
+		}
+
+		std::string& value;
+	};
 	
 private:
 	DataContainer		m_data;
 	MetadataContainer	m_metadata;
+
+	// header and data in one buffer, empty unless message is stored
+	dealer::data_container	m_record;
+	size_t					m_record_header_size;
 };
 
 template<typename DataContainer, typename MetadataContainer>
-cached_message_t<DataContainer, MetadataContainer>::cached_message_t() {
+cached_message_t<DataContainer, MetadataContainer>::cached_message_t() :
+	m_record_header_size(0)
+{
 	init();
 }
 
 template<typename DataContainer, typename MetadataContainer>
-cached_message_t<DataContainer, MetadataContainer>::cached_message_t(const cached_message_t& message) {
+cached_message_t<DataContainer, MetadataContainer>::cached_message_t(const cached_message_t& message) :
+	m_record_header_size(0)
+{
 	*this = message;
 }
 
 template<typename DataContainer, typename MetadataContainer> void
-cached_message_t<DataContainer, MetadataContainer>::commit_to_eblob(boost::shared_ptr<eblob_t>& blob) {
-	// serialize all metadata
-	msgpack::sbuffer buffer;
-	msgpack::packer<msgpack::sbuffer> pk(&buffer);
+cached_message_t<DataContainer, MetadataContainer>::pack_header(std::string& header, size_t data_size) const {
+	string_writer_t writer(header);
+	msgpack::packer<string_writer_t> pk(&writer);
 	pk.pack(m_metadata.path());
 	pk.pack(m_metadata.policy);
-	pk.pack(m_metadata.uuid);
-	pk.pack_raw(m_data.size());
-	pk.pack_raw_body((const char*)m_data.data(), m_data.size());
+	pk.pack(m_metadata.uuid.as_string());
+	pk.pack_raw(data_size);
+}
+
+template<typename DataContainer, typename MetadataContainer> bool
+cached_message_t<DataContainer, MetadataContainer>::has_record() const {
+	if (m_record.empty()) {
+		return false;
+	}
+
+	const char* record_data = static_cast<const char*>(m_record.data()) + m_record_header_size;
+	return (m_data.data() == record_data && m_data.size() + m_record_header_size == m_record.size());
+}
 
-	// write to eblob_t with uuid as key
-	blob->write(m_metadata.uuid, buffer.data(), buffer.size(), 0);
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::release_record(__attribute__ ((unused)) void* data, void* hint) {
+	delete static_cast<dealer::data_container*>(hint);
+}
+
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::commit_to_eblob(boost::shared_ptr<eblob_t>& blob) {
+	if (has_record()) {
+		blob->write(m_metadata.uuid.as_string(), m_record.data(), m_record.size(), 0);
+		return;
+	}
+
+	std::string header;
+	pack_header(header, m_data.size());
+
+	// data came in its own container, eblob joins header and data into one record
+	struct iovec pieces[2];
+	pieces[0].iov_base = const_cast<char*>(header.data());
+	pieces[0].iov_len = header.size();
+	pieces[1].iov_base = m_data.data();
+	pieces[1].iov_len = m_data.size();
+
+	blob->write(m_metadata.uuid.as_string(), pieces, 2, 0);
+}
+
+template<typename DataContainer, typename MetadataContainer> boost::uint64_t
+cached_message_t<DataContainer, MetadataContainer>::commit_to_journal(eblob_journal_t& journal,
+																	  const boost::shared_ptr<eblob_t>& blob)
+{
+	std::string header;
+
+	// journal keeps a reference to the whole record
+	if (has_record()) {
+		return journal.write(blob, m_metadata.uuid.as_string(), header, m_record, 0);
+	}
+
+	pack_header(header, m_data.size());
+
+	// journal keeps a reference to data if container can share it
+	dealer::data_container shared;
+
+	if (m_data.share_data(shared)) {
+		return journal.write(blob, m_metadata.uuid.as_string(), header, shared, 0);
+	}
+
+	header.append(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+	return journal.write(blob, m_metadata.uuid.as_string(), header, 0);
 }
 
 template<typename DataContainer, typename MetadataContainer>
@@ -152,8 +254,74 @@ cached_message_t<DataContainer, MetadataContainer>::cached_message_t(const messa
 }
 
 template<typename DataContainer, typename MetadataContainer>
-cached_message_t<DataContainer, MetadataContainer>::cached_message_t(void* mdata, size_t mdata_size) {
-	m_metadata.load_data(m_metadata, mdata_size);
+cached_message_t<DataContainer, MetadataContainer>::cached_message_t(const message_path_t& path,
+							   										 const message_policy_t& policy,
+							   										 const void* data,
+							   										 size_t data_size,
+							   										 bool is_stored) :
+	m_record_header_size(0)
+{
+	m_metadata.set_path(path);
+	m_metadata.policy = policy;
+	m_metadata.enqued_timestamp.init_from_current_time();
+
+	if (data_size > MAX_MESSAGE_DATA_SIZE) {
+		throw dealer_error(resource_error, "can't create message, message data too big.");
+	}
+
+	init();
+
+	if (!is_stored || data == NULL || data_size == 0) {
+		m_data.set_data(data, data_size);
+		return;
+	}
+
+	// header is packed from uuid set by init()
+	std::string header;
+	pack_header(header, data_size);
+
+	size_t record_size = header.size() + data_size;
+	char* record = static_cast<char*>(malloc(record_size));
+
+	if (!record) {
+		std::string error_msg = "not enough memory to create message record at ";
+		error_msg += std::string(BOOST_CURRENT_FUNCTION);
+		throw internal_error(error_msg);
+	}
+
+	memcpy(record, header.data(), header.size());
+	memcpy(record + header.size(), data, data_size);
+
+	m_record.adopt_data(record, record_size, dealer::data_container::free_malloced_data);
+	m_record_header_size = header.size();
+
+	// data shares record, which is freed along with the last data reference
+	m_data.adopt_data(record + header.size(), data_size, &release_record, new dealer::data_container(m_record));
+}
+
+template<typename DataContainer, typename MetadataContainer>
+cached_message_t<DataContainer, MetadataContainer>::cached_message_t(const message_path_t& path,
+							   										 const message_policy_t& policy,
+							   										 const DataContainer& data) :
+	m_data(data),
+	m_record_header_size(0)
+{
+	m_metadata.set_path(path);
+	m_metadata.policy = policy;
+	m_metadata.enqued_timestamp.init_from_current_time();
+
+	if (m_data.size() > MAX_MESSAGE_DATA_SIZE) {
+		throw dealer_error(resource_error, "can't create message, message data too big.");
+	}
+
+	init();
+}
+
+template<typename DataContainer, typename MetadataContainer>
+cached_message_t<DataContainer, MetadataContainer>::cached_message_t(void* mdata, size_t mdata_size) :
+	m_record_header_size(0)
+{
+	m_metadata.load_data(mdata, mdata_size);
 }
 
 template<typename DataContainer, typename MetadataContainer>
@@ -162,7 +330,7 @@ cached_message_t<DataContainer, MetadataContainer>::~cached_message_t() {
 
 template<typename DataContainer, typename MetadataContainer> void
 cached_message_t<DataContainer, MetadataContainer>::init() {
-	m_metadata.uuid = wuuid_t().generate();
+	m_metadata.uuid = wuuid_t::create();
 	m_metadata.enqued_timestamp.init_from_current_time();
 }
 
@@ -210,6 +378,11 @@ cached_message_t<DataContainer, MetadataContainer>::size() const {
 	return m_data.size();
 }
 
+template<typename DataContainer, typename MetadataContainer> bool
+cached_message_t<DataContainer, MetadataContainer>::share_data(dealer::data_container& data) const {
+	return m_data.share_data(data);
+}
+
 template<typename DataContainer, typename MetadataContainer> DataContainer&
 cached_message_t<DataContainer, MetadataContainer>::data_container() {
 	return m_data;
@@ -231,6 +404,8 @@ cached_message_t<DataContainer, MetadataContainer>::operator = (const message_if
 
 		m_data = dc.m_data;
 		m_metadata = dc.m_metadata;
+		m_record = dc.m_record;
+		m_record_header_size = dc.m_record_header_size;
 	}
 	catch (const std::exception& ex) {
 		std::string error_msg = ex.what();
@@ -264,7 +439,7 @@ cached_message_t<DataContainer, MetadataContainer>::operator != (const message_i
 	return !(*this == rhs);
 }
 
-template<typename DataContainer, typename MetadataContainer> const std::string&
+template<typename DataContainer, typename MetadataContainer> const wuuid_t&
 cached_message_t<DataContainer, MetadataContainer>::uuid() const {
 	return m_metadata.uuid;
 }
@@ -328,13 +503,16 @@ cached_message_t<DataContainer, MetadataContainer>::mark_as_sent(bool value) {
 
 template<typename DataContainer, typename MetadataContainer> bool
 cached_message_t<DataContainer, MetadataContainer>::is_expired() {
-	// check whether we received server ack or not
-	time_value curr_time = time_value::get_current_time();
+	return is_expired(time_value::get_current_time());
+}
 
+template<typename DataContainer, typename MetadataContainer> bool
+cached_message_t<DataContainer, MetadataContainer>::is_expired(const time_value& curr_time) {
+	// check whether we received server ack or not
 	if (m_metadata.is_sent && !ack_received()) {
 		time_value elapsed_from_sent = curr_time.distance(m_metadata.sent_timestamp);
 
-		if (elapsed_from_sent.as_double() > (ACK_TIMEOUT / 1000.0f)) {
+		if (elapsed_from_sent.as_double() >= (ACK_TIMEOUT / 1000.0f)) {
 			return true;
 		}
 	}
@@ -343,7 +521,7 @@ cached_message_t<DataContainer, MetadataContainer>::is_expired() {
 	if (m_metadata.policy.deadline > 0.0f) {
 		time_value elapsed_from_enqued = curr_time.distance(m_metadata.enqued_timestamp);
 
-		if (elapsed_from_enqued.as_double() > m_metadata.policy.deadline) {
+		if (elapsed_from_enqued.as_double() >= m_metadata.policy.deadline) {
 			return true;
 		}
 	}
@@ -351,6 +529,16 @@ cached_message_t<DataContainer, MetadataContainer>::is_expired() {
 	return false;
 }
 
+template<typename DataContainer, typename MetadataContainer> bool
+cached_message_t<DataContainer, MetadataContainer>::is_discarded() const {
+	return m_metadata.discarded;
+}
+
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::set_discarded(bool value) {
+	m_metadata.discarded = value;
+}
+
 template<typename DataContainer, typename MetadataContainer> void
 cached_message_t<DataContainer, MetadataContainer>::remove_from_persistent_cache() {
 	return m_data.remove_from_persistent_cache();
@@ -29,22 +29,38 @@ namespace dealer {
  // predeclaration
 struct cocaine_endpoint_t {
 public:
-	cocaine_endpoint_t() {}
+	cocaine_endpoint_t() :
+		backlog(0),
+		queue_depth(0),
+		slaves_busy(0),
+		slaves_total(0) {}
 
 	cocaine_endpoint_t(const std::string& endpoint_, const std::string& route_) :
 		endpoint(endpoint_),
-		route(route_) {}
+		route(route_),
+		backlog(0),
+		queue_depth(0),
+		slaves_busy(0),
+		slaves_total(0) {}
 
 	~cocaine_endpoint_t() {}
 
 	cocaine_endpoint_t(const cocaine_endpoint_t& rhs) :
 		endpoint(rhs.endpoint),
-		route(rhs.route) {}
+		route(rhs.route),
+		backlog(rhs.backlog),
+		queue_depth(rhs.queue_depth),
+		slaves_busy(rhs.slaves_busy),
+		slaves_total(rhs.slaves_total) {}
 
 	cocaine_endpoint_t& operator = (const cocaine_endpoint_t& rhs) {
 		if (this != &rhs) {
 			endpoint = rhs.endpoint;
 			route = rhs.route;
+			backlog = rhs.backlog;
+			queue_depth = rhs.queue_depth;
+			slaves_busy = rhs.slaves_busy;
+			slaves_total = rhs.slaves_total;
 		}
 
 		return *this;
@@ -69,6 +85,12 @@ public:
 
 	std::string endpoint;
 	std::string route;
+
+	// load reported by node heartbeat, not part of endpoint identity
+	unsigned int backlog;
+	unsigned int queue_depth;
+	unsigned int slaves_busy;
+	unsigned int slaves_total;
 };
 
 } // namespace dealer
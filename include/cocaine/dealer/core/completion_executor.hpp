@@ -0,0 +1,81 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_COMPLETION_EXECUTOR_HPP_INCLUDED_
+#define _COCAINE_DEALER_COMPLETION_EXECUTOR_HPP_INCLUDED_
+
+#include <deque>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "cocaine/dealer/utils/smart_logger.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// runs async response callbacks, each thread owns a queue of tasks,
+// tasks posted with the same key run in order on the same thread,
+// a task failing is logged and doesn't stop the others
+class completion_executor_t : private boost::noncopyable {
+public:
+	typedef boost::function<void()> task_t;
+
+public:
+	completion_executor_t(size_t threads_count,
+						  const boost::shared_ptr<base_logger_t>& logger);
+
+	// runs tasks already posted and stops
+	~completion_executor_t();
+
+	void post(size_t key, const task_t& task);
+
+	size_t threads_count() const;
+
+private:
+	struct shard_t {
+		shard_t() : is_waiting(false), is_running(true) {}
+
+		std::deque<task_t> tasks;
+		bool is_waiting;
+		bool is_running;
+
+		boost::mutex mutex;
+		boost::condition_variable cond_var;
+	};
+
+	typedef boost::shared_ptr<shard_t> shard_ptr_t;
+
+	void run(shard_t& shard);
+
+private:
+	std::vector<shard_ptr_t> m_shards;
+	boost::thread_group m_threads;
+	boost::shared_ptr<base_logger_t> m_logger;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_COMPLETION_EXECUTOR_HPP_INCLUDED_
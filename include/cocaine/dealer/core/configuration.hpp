@@ -59,6 +59,8 @@ public:
 	unsigned long long default_message_deadline() const;
 	unsigned long long socket_poll_timeout() const;
 	enum e_message_cache_type message_cache_type() const;
+	int io_threads() const;
+	int completion_threads() const;
 	
 	enum e_logger_type logger_type() const;
 	unsigned int logger_flags() const;
@@ -70,6 +72,13 @@ public:
 	int eblob_sync_interval() const;
 	int eblob_thread_pool_size() const;
 	int eblob_defrag_timeout() const;
+
+	bool is_journal_enabled() const;
+	int journal_batch_size() const;
+	int journal_batch_timeout() const;
+	bool journal_wait_durable() const;
+	bool is_spill_enabled() const;
+	size_t spill_min_size() const;
 	
 	bool is_statistics_enabled() const;
 	bool is_remote_statistics_enabled() const;
@@ -88,6 +97,9 @@ private:
 	void parse_persistant_storage_settings(const Json::Value& config_value);
 	void parse_statistics_settings(const Json::Value& config_value);
 	void parse_services_settings(const Json::Value& config_value);
+	void parse_queue_limits(const Json::Value& limits_value,
+							const std::string& service_name,
+							queue_limits_t& limits);
 
 private:
 	// config
@@ -96,6 +108,8 @@ private:
 	// general
 	unsigned long long			m_default_message_deadline;
 	enum e_message_cache_type	m_message_cache_type;
+	int							m_io_threads;
+	int							m_completion_threads;
 	
 	// logger
 	enum e_logger_type	m_logger_type;
@@ -109,6 +123,16 @@ private:
 	int			m_eblob_sync_interval;
 	int			m_eblob_thread_pool_size;
 	int			m_eblob_defrag_timeout;
+
+	// write-behind journal in front of eblobs
+	bool		m_journal_enabled;
+	int			m_journal_batch_size;
+	int			m_journal_batch_timeout;
+	bool		m_journal_wait_durable;
+
+	// message data kept in eblob until sent
+	bool		m_spill_enabled;
+	size_t		m_spill_min_size;
 	
 	// statistics
 	bool		m_statistics_enabled;
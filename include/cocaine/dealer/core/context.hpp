@@ -24,6 +24,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include <zmq.hpp>
 
@@ -39,6 +40,10 @@ namespace cocaine {
 namespace dealer {
 
 class eblob_storage_t;
+class reactor_t;
+class completion_executor_t;
+class eblob_journal_t;
+class refresher;
 
 class context_t : private boost::noncopyable, public boost::enable_shared_from_this<context_t> {
 public:
@@ -53,6 +58,15 @@ public:
 	boost::shared_ptr<configuration_t> config();
 	boost::shared_ptr<zmq::context_t> zmq_context();
 	boost::shared_ptr<eblob_storage_t> storage();
+
+	// empty unless write-behind is enabled
+	boost::shared_ptr<eblob_journal_t> journal();
+
+	// least loaded i/o thread
+	boost::shared_ptr<reactor_t> reactor();
+
+	// runs async responses callbacks
+	boost::shared_ptr<completion_executor_t> executor();
     //boost::shared_ptr<statistics_collector> stats();
 
 private:
@@ -60,6 +74,12 @@ private:
 	boost::shared_ptr<base_logger_t> m_logger;
 	boost::shared_ptr<configuration_t> m_config;
 	boost::shared_ptr<eblob_storage_t> m_storage;
+	boost::shared_ptr<eblob_journal_t> m_journal;
+	std::vector<boost::shared_ptr<reactor_t> > m_reactors;
+	boost::shared_ptr<completion_executor_t> m_executor;
+
+	// gives idle pooled buffers back to the system
+	boost::shared_ptr<refresher> m_buffer_pool_trimmer;
     //boost::shared_ptr<statistics_collector> m_stats;
 };
 
@@ -31,6 +31,7 @@
 #include <boost/date_time.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/xpressive/xpressive.hpp>
 
 #include "cocaine/dealer/forwards.hpp"
@@ -75,6 +76,29 @@ public:
 				 size_t size,
 				 const message_path_t& path);
 
+	response_ptr_t
+	send_message(const data_container& data,
+				 const message_path_t& path,
+				 const message_policy_t& policy);
+
+	response_ptr_t
+	send_message(const data_container& data,
+				 const message_path_t& path);
+
+	void
+	send_message_async(const void* data,
+					   size_t size,
+					   const message_path_t& path,
+					   const message_policy_t& policy,
+					   const chunk_callback_t& on_chunk,
+					   const done_callback_t& on_done);
+
+	void
+	send_message_async(const data_container& data,
+					   const message_path_t& path,
+					   const message_policy_t& policy,
+					   const chunk_callback_t& on_chunk,
+					   const done_callback_t& on_done);
 	
 	responses_list_t
 	send_messages(const void* data,
@@ -93,23 +117,65 @@ public:
 				   const message_path_t& path,
 				   const message_policy_t& policy);
 
+	boost::shared_ptr<message_iface>
+	create_message(const data_container& data,
+				   const message_path_t& path,
+				   const message_policy_t& policy);
+
 	message_policy_t policy_for_service(const std::string& service_alias);
 
+	size_t queued_messages_count(const std::string& service_alias,
+								 const std::string& handle_name);
+
+	size_t queued_bytes(const std::string& service_alias,
+						const std::string& handle_name);
+
 	size_t stored_messages_count(const std::string& service_alias);
+	size_t stored_bytes(const std::string& service_alias);
 	void remove_stored_message(const message_t& message);
 	void remove_stored_message_for(const response_ptr_t& response);
 	void get_stored_messages(const std::string& service_alias,
 							 std::vector<message_t>& messages);
+	void get_stored_messages(const std::string& service_alias,
+							 const stored_message_callback_t& callback);
+	size_t resend_stored_messages(const std::string& service_alias);
 
 private:	
 	void connect();
 	void disconnect();
 
+	void commit_to_persistent_storage(const boost::shared_ptr<message_iface>& msg,
+									  const message_path_t& path,
+									  const message_policy_t& policy,
+									  bool wait_durable);
+
+	// spilled messages keep only metadata in memory, data is read from eblob on send
+	bool is_spilled(size_t size, const message_policy_t& policy);
+
+	boost::shared_ptr<message_iface>
+	create_spilled_message(const void* data,
+						   size_t size,
+						   const message_path_t& path,
+						   const message_policy_t& policy);
+
+	// stored messages are restored after queued writes land
+	void flush_journal();
+
 	void service_hosts_pinged_callback(const service_info_t& service_info,
 									   const handles_endpoints_t& endpoints_for_handles);
 
-	// restoring messages from storage cache
-	void storage_iteration_callback(const std::string& key, void* data, uint64_t size, int column);
+	// restoring messages from storage cache, called from eblob iteration threads
+	void restore_stored_message(const stored_message_callback_t& callback,
+								void* data,
+								uint64_t size,
+								int column);
+
+	void resend_stored_message(const boost::shared_ptr<service_t>& service,
+							   const boost::shared_ptr<eblob_t>& blob,
+							   boost::detail::atomic_count& resent,
+							   void* data,
+							   uint64_t size,
+							   int column);
 
 	bool regex_match(const std::string& regex_str, const std::string& value);
 
@@ -127,14 +193,10 @@ private:
 	std::auto_ptr<heartbeats_collector_t> m_heartbeats_collector;
 
 	// synchronization
-	boost::mutex m_mutex;
 	boost::mutex m_regex_mutex;
 
 	// alive state
 	bool m_is_dead;
-
-	// tmp var to fill with unsent data. used in eblob iterator method (this is god awful code, needs proper fix)
-	std::vector<message_t>* m_messages_ptr;
 };
 
 } // namespace dealer
@@ -35,10 +35,12 @@
 #include <boost/thread/thread.hpp>
 #include <boost/date_time.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "json/json.h"
 
 #include "cocaine/dealer/core/balancer.hpp"
+#include "cocaine/dealer/core/reactor.hpp"
 #include "cocaine/dealer/core/handle_info.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/message_cache.hpp"
@@ -46,6 +48,8 @@
 #include "cocaine/dealer/response_chunk.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
 #include "cocaine/dealer/utils/progress_timer.hpp"
+#include "cocaine/dealer/utils/wakeup_fd.hpp"
+#include "cocaine/dealer/utils/deadline_queue.hpp"
 
 namespace cocaine {
 namespace dealer {
@@ -91,19 +95,70 @@ public:
 	boost::shared_ptr<message_cache_t> messages_cache() const;
 	void kill();
 
+	// called by reactor from it's thread only
+	void start_dispatch();
+	void stop_dispatch();
+	void poll_items(std::vector<zmq_pollitem_t>& items);
+	void process_events(const zmq_pollitem_t* items);
+	long next_poll_timeout();
+
+	static const int responses_batch_size = 100;
+
+	// how often hedged messages are checked for being lost
+	static const int hedge_recheck_interval = 1000; // millisecs
+
 private:
-	void dispatch_messages();
 
 	// working with control messages
 	void dispatch_control_messages(int type, balancer_t& balancer);
 	void establish_control_conection(socket_ptr_t& control_socket);
-	int receive_control_messages(socket_ptr_t& control_socket, int poll_timeout);
-	bool reshedule_message(const std::string& route, const std::string& uuid);
+	int receive_control_message(socket_ptr_t& control_socket);
+	bool reshedule_message(const std::string& route, const wuuid_t& uuid);
 
 	// working with messages
-	bool dispatch_next_available_message(balancer_t& balancer);
+	size_t dispatch_next_available_messages(balancer_t& balancer);
 	void dispatch_next_available_response(balancer_t& balancer);
-	void process_deadlined_messages();
+	void process_deadlined_messages(const time_value& now);
+	static bool is_deadline_reached(const boost::shared_ptr<message_iface>& message, const time_value& now);
+
+	// hedged messages, message is duplicated to another route if no
+	// response starts in time, first route to respond wins
+	struct hedge_t {
+		hedge_t() : hedge_after(0.0), next_check(0.0) {}
+
+		// route message was sent to first, duplicate's route
+		std::string route;
+		std::string hedge_route;
+
+		// route of first response, others are cancelled
+		std::string winner;
+
+		time_value hedge_sent;
+		double hedge_after;
+		double next_check;
+	};
+
+	typedef boost::unordered_map<wuuid_t, hedge_t> hedges_map_t;
+
+	// timer of message which is no longer hedged, dropped on compaction
+	struct stale_hedge_timer_t {
+		stale_hedge_timer_t(const hedges_map_t& hedges_) : hedges(&hedges_) {}
+
+		bool operator () (const wuuid_t& uuid) const {
+			return hedges->find(uuid) == hedges->end();
+		}
+
+		const hedges_map_t* hedges;
+	};
+
+	void track_hedge(const boost::shared_ptr<message_iface>& message, const std::string& route);
+	void process_hedges(balancer_t& balancer, const time_value& now);
+	bool resolve_hedge(hedge_t& hedge, const boost::shared_ptr<response_chunk_t>& response);
+	bool is_hedge_alive(const hedge_t& hedge, const wuuid_t& uuid);
+	bool continue_hedge(const boost::shared_ptr<message_iface>& message, const time_value& now);
+	static const time_value& copy_sent_timestamp(const boost::shared_ptr<message_iface>& message,
+												 const hedge_t* hedge,
+												 const std::string& route);
 
 	// working with responces
 	void enqueue_response(boost::shared_ptr<response_chunk_t>& response);
@@ -112,7 +167,6 @@ private:
 private:
 	handle_info_t		m_info;
 	endpoints_list_t	m_endpoints;
-	boost::thread		m_thread;
 	boost::mutex		m_mutex;
 	volatile bool		m_is_running;
 	volatile bool		m_is_connected;
@@ -122,11 +176,33 @@ private:
 	std::auto_ptr<zmq::socket_t> m_zmq_control_socket;
 	bool m_receiving_control_socket_ok;
 
+	// reactor thread which dispatches our messages
+	boost::shared_ptr<reactor_t> m_reactor;
+
+	// owned by reactor thread
+	std::auto_ptr<balancer_t> m_balancer;
+	socket_ptr_t m_control_socket;
+
+	// number of balancer sockets among our poll items
+	size_t m_balancer_poll_items;
+
+	// signalled whenever new messages are enqueued
+	wakeup_fd_t m_wakeup;
+
 	responce_callback_t m_response_callback;
 
-	progress_timer m_last_response_timer;
-	progress_timer m_deadlined_messages_timer;
-	progress_timer m_control_messages_timer;
+	// max messages sent at once and buffers reused between batches
+	int m_batching_size;
+	message_cache_t::messages_batch_t m_batch;
+	std::vector<std::string> m_batch_routes;
+
+	// endpoint selection and in-flight counts buffer reused between batches
+	enum e_balancing_type m_balancing_type;
+	std::vector<size_t> m_in_flight;
+
+	// messages which may be hedged, owned by reactor thread
+	hedges_map_t m_hedges;
+	deadline_queue_t<wuuid_t> m_hedge_timers;
 };
 
 } // namespace dealer
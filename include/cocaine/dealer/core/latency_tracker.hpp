@@ -0,0 +1,131 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_LATENCY_TRACKER_HPP_INCLUDED_
+#define _COCAINE_DEALER_LATENCY_TRACKER_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/core/balancing_strategy.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// per route peak ewma of ack and response latencies with outlier ejection,
+// all times are in seconds
+class latency_tracker_t : private boost::noncopyable {
+public:
+	latency_tracker_t();
+
+	void ack_received(const std::string& route, double latency, double now);
+	void response_received(const std::string& route, double latency, double now);
+
+	// message was sent to route which had probing flag set
+	void probe_sent(const std::string& route, double now);
+
+	// ejects outliers, expires ejections and fills latency, ejected
+	// and probing fields of loads, same order as endpoints,
+	// returns number of routes ejected by this call
+	size_t update(const std::vector<cocaine_endpoint_t>& endpoints, double now, endpoint_loads_t& loads);
+
+	// forgets routes not found among endpoints
+	void retain(const std::vector<cocaine_endpoint_t>& endpoints);
+
+	// older samples lose half their weight in decay_time * ln(2)
+	static const int decay_time = 10000; // millisecs
+
+	// route is an outlier when its latency exceeds median latency this many times
+	static const int outlier_factor = 3;
+	static const int outlier_min_latency = 50; // millisecs
+	static const int outlier_min_samples = 10;
+
+	// ejection time doubles with each consecutive ejection of a route
+	static const int base_ejection_time = 1000; // millisecs
+	static const int max_ejection_time = 60000; // millisecs
+	static const int max_ejected_percent = 50;
+
+private:
+	// finagle style peak ewma, jumps to peaks at once and decays smoothly
+	struct peak_ewma_t {
+		peak_ewma_t() : cost(0.0), stamp(0.0), samples(0) {}
+
+		void observe(double value, double now);
+		double value(double now) const;
+		void reset(double value, double now);
+
+		double cost;
+		double stamp;
+		size_t samples;
+	};
+
+	enum e_route_state {
+		RS_HEALTHY = 1,
+		RS_EJECTED,
+		RS_PROBE_READY,	// ejection expired, waiting for a probe to be sent
+		RS_PROBING		// probe sent, waiting for its latency
+	};
+
+	struct route_t {
+		route_t() :
+			state(RS_HEALTHY),
+			ejections(0),
+			ejected_until(0.0),
+			probe_sent_at(0.0),
+			healthy_since(0.0),
+			threshold(0.0) {}
+
+		// latency used for balancing and outlier detection
+		double cost(double now) const;
+		const peak_ewma_t& cost_source() const;
+
+		peak_ewma_t ack;
+		peak_ewma_t response;
+
+		enum e_route_state state;
+		int ejections;
+		double ejected_until;
+		double probe_sent_at;
+		double healthy_since;
+
+		// probe latency must not exceed it for route to be restored
+		double threshold;
+	};
+
+	typedef boost::unordered_map<std::string, route_t> routes_map_t;
+
+	void sample_received(route_t& route, const peak_ewma_t& source, double latency, double now);
+	static void eject(route_t& route, double threshold, double now);
+	static double ejection_time(const route_t& route);
+
+private:
+	routes_map_t m_routes;
+
+	// costs of healthy routes, reused between updates
+	std::vector<double> m_costs;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_LATENCY_TRACKER_HPP_INCLUDED_
@@ -25,9 +25,13 @@
 #include <memory>
 #include <map>
 #include <list>
+#include <deque>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <eblob/eblob.hpp>
 
@@ -35,6 +39,11 @@
 #include "cocaine/dealer/core/context.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
+#include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/utils/mpsc_queue.hpp"
+#include "cocaine/dealer/utils/hash_table.hpp"
+#include "cocaine/dealer/utils/deadline_queue.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
 
 namespace cocaine {
 namespace dealer {
@@ -47,11 +56,41 @@ public:
 	typedef std::pair<std::string, message_path_t> message_data_t;
 	typedef std::vector<message_data_t> expired_messages_data_t;
 
-	// <uuid, sent message>
-	typedef std::map<std::string, cached_message_ptr_t> sent_messages_map_t;
+	// sent messages are keyed by binary uuid and interned route id
+	struct sent_key_t {
+		sent_key_t() : route(-1) {}
+		sent_key_t(const wuuid_t& uuid_, int route_) : uuid(uuid_), route(route_) {}
 
-	// <route, sent messages map>
-	typedef std::map<std::string, sent_messages_map_t> route_sent_messages_map_t;
+		bool operator == (const sent_key_t& rhs) const {
+			return route == rhs.route && uuid == rhs.uuid;
+		}
+
+		wuuid_t uuid;
+		int route;
+	};
+
+	struct sent_key_hash_t {
+		size_t operator () (const sent_key_t& key) const {
+			return key.uuid.hash() ^ (static_cast<size_t>(key.route) * 0x9e3779b9);
+		}
+	};
+
+	typedef open_hash_table_t<sent_key_t, cached_message_ptr_t, sent_key_hash_t> sent_messages_table_t;
+
+	// <route, route id>
+	typedef boost::unordered_map<std::string, int> routes_map_t;
+
+	// pending expiration of a message, route is set for ack timeouts only
+	struct expiration_t {
+		expiration_t() : route(-1) {}
+		expiration_t(const cached_message_ptr_t& message_, int route_) :
+			message(message_), route(route_) {}
+
+		boost::weak_ptr<message_iface> message;
+		int route;
+	};
+
+	typedef deadline_queue_t<expiration_t> expirations_queue_t;
 
 public:
 	message_cache_t(const boost::shared_ptr<context_t>& ctx,
@@ -65,36 +104,97 @@ public:
 	size_t new_messages_count();
 	size_t sent_messages_count();
 
+	// messages awaiting response for each endpoint's route
+	void sent_messages_counts(const std::vector<cocaine_endpoint_t>& endpoints,
+							  std::vector<size_t>& counts);
+
 
 	void enqueue_with_priority(const boost::shared_ptr<message_iface>& message);
 	cached_message_ptr_t get_new_message();
+
+	// batched dispatch, each call takes the cache lock once
+	typedef std::vector<cached_message_ptr_t> messages_batch_t;
+
+	size_t take_new_messages(size_t count, messages_batch_t& messages);
+	void return_new_messages(const messages_batch_t& messages, size_t offset);
+
+	// removes oldest message not sent yet, empty if there is none
+	cached_message_ptr_t take_oldest_new_message();
+	void move_messages_to_sent(const messages_batch_t& messages,
+							   const std::vector<std::string>& routes,
+							   size_t count);
 	
 	bool get_sent_message(const std::string& route,
-						  const std::string& uuid,
+						  const wuuid_t& uuid,
 						  boost::shared_ptr<message_iface>& message);
 
 	message_queue_ptr_t new_messages();
 	void move_new_message_to_sent(const std::string& route);
-	void move_sent_message_to_new(const std::string& route, const std::string& uuid);
-	void move_sent_message_to_new_front(const std::string& route, const std::string& uuid);
-	void remove_message_from_cache(const std::string& route, const std::string& uuid);
+
+	// sent message was duplicated to another route (hedged)
+	void add_sent_copy(const cached_message_ptr_t& message,
+					   const std::string& route,
+					   const time_value& sent_timestamp);
+	void move_sent_message_to_new(const std::string& route, const wuuid_t& uuid);
+	void move_sent_message_to_new_front(const std::string& route, const wuuid_t& uuid);
+	// returns removed message, empty if it was not found
+	cached_message_ptr_t remove_message_from_cache(const std::string& route, const wuuid_t& uuid);
 	void make_all_messages_new();
-	void get_expired_messages(message_queue_t& expired_messages);
+	void get_expired_messages(const time_value& now, message_queue_t& expired_messages);
+
+	// earliest time some message may expire, empty if none is tracked
+	time_value next_expiration_time();
 	void make_all_messages_new_for_route(const std::string& route);
 
-	bool reshedule_message(const std::string& route, const std::string& uuid);
+	bool reshedule_message(const std::string& route, const wuuid_t& uuid);
 
 	void lock();
 
 	void log_stats();
 
+	// messages enqueued by clients before handle picks them up
+	static const size_t incoming_queue_size = 4096;
+
+	// expirations fire slightly late so message is surely expired by then
+	static const int expiration_slack = 1; // millisecs
+
 private:
-	static bool is_message_expired(cached_message_ptr_t msg);
+	static bool is_message_discarded(const cached_message_ptr_t& msg);
+
+	// expiration that would be skipped when it's due, dropped on compaction
+	static bool is_expiration_stale(const expiration_t& expiration);
+
+	// moves messages enqueued by clients to new messages, call under m_mutex
+	void drain_incoming();
+
+	// sent messages table helpers, call under m_mutex
+	int intern_route(const std::string& route);
+
+	// route must have no sent messages, its id is reused by next new route
+	void release_route(routes_map_t::iterator it);
+	void release_all_routes();
+	bool make_sent_key(const std::string& route, const wuuid_t& uuid, sent_key_t& key) const;
+	bool take_sent_message(const sent_key_t& key, cached_message_ptr_t& message);
+
+	// expirations helpers, call under m_mutex
+	void track_deadline(const cached_message_ptr_t& message);
+	void track_ack_timeout(const cached_message_ptr_t& message, int route, const time_value& sent_timestamp);
+	bool take_expired_message(const expiration_t& expiration,
+							  const time_value& now,
+							  cached_message_ptr_t& message);
 
 private:
 	enum e_message_cache_type	m_type;
-	route_sent_messages_map_t	m_sent_messages;
+	sent_messages_table_t		m_sent_messages;
+
+	// interned routes and number of messages sent to each,
+	// routes of endpoints gone are released and their ids reused
+	routes_map_t				m_routes;
+	std::vector<size_t>			m_route_sent_counts;
+	std::vector<int>			m_free_route_ids;
 	message_queue_ptr_t			m_new_messages;
+	mpsc_queue_t<cached_message_ptr_t> m_incoming;
+	expirations_queue_t			m_expirations;
 	bool m_locked;
 	boost::mutex m_mutex;
 };
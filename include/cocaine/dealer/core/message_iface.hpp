@@ -27,10 +27,14 @@
 #include "cocaine/dealer/message_path.hpp"
 #include "cocaine/dealer/message_policy.hpp"
 #include "cocaine/dealer/storage/eblob.hpp"
+#include "cocaine/dealer/utils/data_container.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
 
 namespace cocaine {
 namespace dealer {
 
+class eblob_journal_t;
+
 class message_iface {
 public:
 	virtual ~message_iface() {};
@@ -38,6 +42,9 @@ public:
 	virtual void* data() = 0;
 	virtual size_t size() const = 0;
 
+	// references message data without copying, false if not possible
+	virtual bool share_data(data_container& data) const = 0;
+
 	virtual bool is_data_loaded() = 0;
 	virtual void load_data() = 0;
 	virtual void unload_data() = 0;
@@ -46,7 +53,7 @@ public:
 
 	virtual const message_path_t& path() const = 0;
 	virtual const message_policy_t& policy() const = 0;
-	virtual const std::string& uuid() const = 0;
+	virtual const wuuid_t& uuid() const = 0;
 
 	virtual bool is_sent() const = 0;
 	virtual const time_value& sent_timestamp() const = 0;
@@ -65,9 +72,17 @@ public:
 	virtual void mark_as_sent(bool value) = 0;
 
 	virtual bool is_expired() = 0;
+	virtual bool is_expired(const time_value& now) = 0;
+
+	// expired messages left in a queue are discarded and skipped later
+	virtual bool is_discarded() const = 0;
+	virtual void set_discarded(bool value) = 0;
 
 	virtual void commit_to_eblob(boost::shared_ptr<eblob_t>& blob) = 0;
 
+	// queues message for writing, returns journal sequence number
+	virtual boost::uint64_t commit_to_journal(eblob_journal_t& journal, const boost::shared_ptr<eblob_t>& blob) = 0;
+
 	virtual message_iface& operator = (const message_iface& rhs) = 0;
 	virtual bool operator == (const message_iface& rhs) const = 0;
 	virtual bool operator != (const message_iface& rhs) const = 0;
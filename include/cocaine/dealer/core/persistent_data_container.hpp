@@ -48,7 +48,10 @@ public:
 	bool operator == (const persistent_data_container& rhs) const;
 	bool operator != (const persistent_data_container& rhs) const;
 
-	void set_eblob(boost::shared_ptr<eblob_t> blob, const std::string& uuid);
+	// data is read back from the tail of record in given column
+	void set_eblob(boost::shared_ptr<eblob_t> blob, const std::string& uuid, int column = EBLOB_COLUMN);
+
+	// writes record of container's own, it's removed along with container
 	void commit_data();
 
 	void set_data(const void* data, size_t size);
@@ -57,6 +60,9 @@ public:
 	size_t size() const;
 	bool empty() const;
 
+	// data is loaded on demand only, can't be shared
+	bool share_data(data_container& dc) const;
+
 	bool is_data_loaded();
 	void load_data();
 	void unload_data();
@@ -79,6 +85,8 @@ protected:
 
 	// key to store data in eblob_t
 	std::string uuid_;
+	int column_;
+	bool owns_record_;
 };
 
 } // namespace dealer
@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
+#define _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
+
+#include <vector>
+#include <deque>
+
+#include <zmq.hpp>
+
+#include <boost/utility.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "cocaine/dealer/utils/wakeup_fd.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+class handle_t;
+
+// single i/o thread multiplexing any number of handles with one zmq_poll.
+// handle state is only ever touched from the reactor thread, attach() and
+// detach() block until the reactor thread has picked the handle up or let it go.
+class reactor_t : private boost::noncopyable {
+public:
+	reactor_t();
+	virtual ~reactor_t();
+
+	void attach(handle_t* handle);
+	void detach(handle_t* handle);
+
+	size_t handles_count() const;
+
+private:
+	enum e_command_type {
+		ATTACH_HANDLE = 1,
+		DETACH_HANDLE
+	};
+
+	struct command_t {
+		command_t(e_command_type type_, handle_t* handle_) :
+			type(type_), handle(handle_), done(false) {}
+
+		e_command_type	type;
+		handle_t*		handle;
+		bool			done;
+	};
+
+	void run();
+	void execute(command_t& command);
+	void process_commands();
+	void detach_all();
+
+private:
+	// reactor thread only
+	std::vector<handle_t*>		m_handles;
+	std::vector<zmq_pollitem_t>	m_poll_items;
+	std::vector<size_t>			m_poll_offsets;
+
+	// pending attach/detach requests
+	std::deque<command_t*>		m_commands;
+	boost::mutex				m_mutex;
+	boost::condition_variable	m_cond_var;
+
+	wakeup_fd_t		m_wakeup;
+	volatile bool	m_is_running;
+	volatile size_t	m_handles_count;
+
+	boost::thread	m_thread;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
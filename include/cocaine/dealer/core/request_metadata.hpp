@@ -29,6 +29,7 @@
 
 #include "cocaine/dealer/message_path.hpp"
 #include "cocaine/dealer/utils/time_value.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
 #include "cocaine/dealer/storage/eblob.hpp"
 #include <boost/flyweight.hpp>
 
@@ -42,7 +43,8 @@ struct request_metadata_t {
 		data_size(0),
 		ack_received(false),
 		is_sent(false),
-		retries_count(0) {}
+		retries_count(0),
+		discarded(false) {}
 
 	virtual ~request_metadata_t() {}
 
@@ -51,7 +53,7 @@ struct request_metadata_t {
 		s << std::boolalpha;
 		s << "service: "<< path().service_alias << ", handle: ";
 		s << path().handle_name + "\n";
-        s << "uuid: " << uuid << "\n";
+        s << "uuid: " << uuid.as_string() << "\n";
         s << "policy [urgent]: " << policy.urgent << "\n";
         s << "policy [persistent]: " << policy.persistent << "\n";
         s << "policy [timeout]: " << policy.timeout << "\n";
@@ -70,7 +72,7 @@ struct request_metadata_t {
 		path_ = path;
 	}
 
-	std::string			uuid;
+	wuuid_t				uuid;
 	message_policy_t	policy;
 	std::string			destination_endpoint;
 	uint64_t			data_size;
@@ -81,6 +83,7 @@ struct request_metadata_t {
 
 	bool	is_sent;
 	int		retries_count;
+	bool	discarded;
 
 private:
 	boost::flyweight<message_path_t> path_;
@@ -109,10 +112,15 @@ struct persistent_request_metadata_t : public request_metadata_t {
 
 		message_path_t path;
 		unpack_next_value(pac, path);
-		path = path;
+		set_path(path);
 
 		unpack_next_value(pac, policy);
-		unpack_next_value(pac, uuid);
+
+		// stored in text form
+		std::string uuid_str;
+		unpack_next_value(pac, uuid_str);
+		uuid.from_string(uuid_str);
+
 		unpack_next_value(pac, data_size);
 		unpack_next_value(pac, enqued_timestamp);
 	}
@@ -123,12 +131,12 @@ struct persistent_request_metadata_t : public request_metadata_t {
 		msgpack::packer<msgpack::sbuffer> pk(&buffer);
     	pk.pack(path());
     	pk.pack(policy);
-    	pk.pack(uuid);
+    	pk.pack(uuid.as_string());
     	pk.pack(data_size);
     	pk.pack(enqued_timestamp);
 
     	// write to eblob_t with uuid as key
-		blob->write(uuid, buffer.data(), buffer.size(), EBLOB_COLUMN);
+		blob->write(uuid.as_string(), buffer.data(), buffer.size(), EBLOB_COLUMN);
 	}
 
 private:
@@ -141,12 +149,7 @@ private:
 	boost::shared_ptr<eblob_t> blob;
 };
 
-std::ostream& operator << (std::ostream& out, request_metadata_t& req_meta) {
-	out << req_meta.as_string();
-	return out;
-}
-
-std::ostream& operator << (std::ostream& out, persistent_request_metadata_t& req_meta) {
+inline std::ostream& operator << (std::ostream& out, const request_metadata_t& req_meta) {
 	out << req_meta.as_string();
 	return out;
 }
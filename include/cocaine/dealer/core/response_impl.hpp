@@ -28,16 +28,19 @@
 #include <list>
 
 #include <cocaine/dealer/forwards.hpp>
+#include <cocaine/dealer/message_path.hpp>
 #include <cocaine/dealer/utils/data_container.hpp>
 #include <cocaine/dealer/response_chunk.hpp>
 #include <cocaine/dealer/utils/error.hpp>
+#include <cocaine/dealer/core/response_notifier.hpp>
+#include <cocaine/dealer/utils/uuid.hpp>
 
 namespace cocaine {
 namespace dealer {
 
 class response_impl_t {
 public:
-	response_impl_t(const std::string& uuid,
+	response_impl_t(const wuuid_t& uuid,
 					const message_path_t& path);
 
 	~response_impl_t();
@@ -48,8 +51,23 @@ public:
 
 	bool get(data_container* data, double timeout = -1.0f);
 
+	// response in a set signals notifier instead of waking get(),
+	// returns whether it already has chunks or is finished
+	bool set_notifier(const boost::shared_ptr<response_notifier_t>& notifier, size_t slot);
+
+	// has chunks to get or is finished
+	bool is_ready();
+
+	// finished and all chunks were taken, error counts as taken once
+	// get() has thrown it, so a set hands it out only once
+	bool is_done();
+
 private:
 	friend class response_t;
+	friend class response_registry_t;
+
+	// registry to leave when destroyed
+	void set_registry(const boost::shared_ptr<response_registry_t>& registry);
 
 	void add_chunk(const boost::shared_ptr<response_chunk_t>& chunk);
 	bool get_chunk(data_container* data) {
@@ -62,25 +80,38 @@ private:
 		it = m_chunks.begin();
 
 		if ((*it)->rpc_code != SERVER_RPC_MESSAGE_ERROR) {
-			*data = (*it)->data;
-			(*it)->data.clear();
+			data->swap((*it)->data);
 			m_chunks.erase(it);
 			return true;
 		}
 		else {
 			m_message_finished = true;
+			m_error_reported = true;
 			throw dealer_error(static_cast<cocaine::dealer::error_code>((*it)->error_code), 
 							   (*it)->error_message);
 		}
 	}
 
 	std::list<boost::shared_ptr<response_chunk_t> > m_chunks;
-	std::string					m_uuid;
+	wuuid_t						m_uuid;
 	const message_path_t		m_path;
 
 	bool m_response_finished;
 	bool m_message_finished;
 
+	// error chunk stays queued and is thrown by every get()
+	bool m_error_reported;
+
+	// threads blocked in get()
+	int m_waiters;
+
+	// set waiting for this response
+	boost::shared_ptr<response_notifier_t> m_notifier;
+	size_t m_notifier_slot;
+
+	// registry chunks come from, weak so it can go first
+	boost::weak_ptr<response_registry_t> m_registry;
+
 	boost::mutex				m_mutex;
 	boost::condition_variable	m_cond_var;
 };
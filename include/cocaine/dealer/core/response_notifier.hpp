@@ -0,0 +1,64 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_RESPONSE_NOTIFIER_HPP_INCLUDED_
+#define _COCAINE_DEALER_RESPONSE_NOTIFIER_HPP_INCLUDED_
+
+#include <deque>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+// single wake-up point of many responses, each response signals its slot
+// once it gets a chunk or finishes, slots come out in signalling order
+class response_notifier_t : private boost::noncopyable {
+public:
+	response_notifier_t();
+
+	// slot already waiting to be taken is not queued again
+	void notify(size_t slot);
+
+	void wait(size_t& slot);
+
+	// false if nothing was signalled before deadline
+	bool timed_wait(size_t& slot, const boost::system_time& deadline);
+
+private:
+	// call under m_mutex
+	void take(size_t& slot);
+
+private:
+	std::deque<size_t> m_ready;
+	std::vector<bool> m_queued;
+	bool m_is_waiting;
+
+	boost::mutex m_mutex;
+	boost::condition_variable m_cond_var;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_RESPONSE_NOTIFIER_HPP_INCLUDED_
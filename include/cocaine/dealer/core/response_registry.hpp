@@ -0,0 +1,105 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_RESPONSE_REGISTRY_HPP_INCLUDED_
+#define _COCAINE_DEALER_RESPONSE_REGISTRY_HPP_INCLUDED_
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "cocaine/dealer/response_chunk.hpp"
+#include "cocaine/dealer/core/response_impl.hpp"
+#include "cocaine/dealer/core/async_response.hpp"
+#include "cocaine/dealer/core/completion_executor.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// responses awaiting chunks keyed by binary uuid, split in shards with
+// a lock each so senders and i/o threads rarely meet. blocking response
+// is referenced weakly and unregisters itself once destroyed, async one
+// is kept until it finishes
+class response_registry_t : private boost::noncopyable,
+							public boost::enable_shared_from_this<response_registry_t>
+{
+public:
+	typedef boost::shared_ptr<response_chunk_t> response_chunk_ptr_t;
+
+public:
+	explicit response_registry_t(const boost::shared_ptr<completion_executor_t>& executor);
+
+	void add(const wuuid_t& uuid, const boost::shared_ptr<response_impl_t>& response);
+	void add(const wuuid_t& uuid, const boost::shared_ptr<async_response_t>& response);
+
+	// hands chunk over to its response, false if nobody waits for it
+	bool deliver(const response_chunk_ptr_t& chunk);
+
+	// finishes async response which never got registered with an error
+	void fail(const wuuid_t& uuid,
+			  const boost::shared_ptr<async_response_t>& response,
+			  int error_code,
+			  const std::string& error_message);
+
+	// finishes all pending async responses with an error, called
+	// once no more chunks can come
+	void cancel_all(int error_code, const std::string& error_message);
+
+	size_t size();
+
+	static const int shard_bits = 6;
+	static const size_t shards_count = 1 << shard_bits;
+
+private:
+	friend class response_impl_t;
+
+	// called by destroyed response, entry is kept if uuid was
+	// registered again by a live response meanwhile
+	void release(const wuuid_t& uuid);
+
+	struct entry_t {
+		boost::weak_ptr<response_impl_t> response;
+		boost::shared_ptr<async_response_t> async_response;
+	};
+
+	typedef boost::unordered_map<wuuid_t, entry_t> entries_map_t;
+
+	struct shard_t {
+		boost::mutex mutex;
+		entries_map_t entries;
+	};
+
+	// top hash bits pick the shard, map buckets use the low ones
+	shard_t& shard(const wuuid_t& uuid);
+
+private:
+	shard_t m_shards[shards_count];
+	boost::shared_ptr<completion_executor_t> m_executor;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_RESPONSE_REGISTRY_HPP_INCLUDED_
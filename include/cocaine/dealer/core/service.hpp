@@ -27,10 +27,13 @@
 #include <map>
 #include <vector>
 #include <list>
+#include <set>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/function.hpp>
 
 #include "cocaine/dealer/response.hpp"
@@ -42,11 +45,15 @@
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/core/admission_control.hpp"
+#include "cocaine/dealer/core/async_response.hpp"
+#include "cocaine/dealer/core/response_registry.hpp"
 
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/smart_logger.hpp"
 #include "cocaine/dealer/utils/refresher.hpp"
 #include "cocaine/dealer/utils/progress_timer.hpp"
+#include "cocaine/dealer/utils/deadline_queue.hpp"
 
 #include "cocaine/dealer/storage/eblob.hpp"
 
@@ -68,6 +75,18 @@ public:
 
 	typedef std::map<std::string, std::vector<cocaine_endpoint_t> > handles_endpoints_t;
 
+
+	// deadline of unhandled message, valid while message stays in that queue
+	struct unhandled_expiration_t {
+		unhandled_expiration_t() {}
+		unhandled_expiration_t(const cached_message_prt_t& message_,
+							   const messages_deque_ptr_t& queue_) :
+			message(message_), queue(queue_) {}
+
+		boost::weak_ptr<message_iface> message;
+		boost::weak_ptr<cached_messages_deque_t> queue;
+	};
+
 public:
 	service_t(const service_info_t& info,
 			  const boost::shared_ptr<context_t>& ctx,
@@ -77,12 +96,83 @@ public:
 
 	void refresh_handles(const handles_endpoints_t& handles_endpoints);
 
+	// throws resource_error if message wasn't admitted to full queue
 	boost::shared_ptr<response_t> send_message(cached_message_prt_t message);
+
+	// response is delivered to callbacks on completion thread,
+	// full queue is reported to on_done as resource_error
+	void send_message_async(cached_message_prt_t message,
+							const chunk_callback_t& on_chunk,
+							const done_callback_t& on_done);
+
+	enum e_resend_result {
+		RR_QUEUED = 1,
+		RR_IN_FLIGHT,	// message with that uuid is still queued or awaiting response
+		RR_QUEUE_FULL
+	};
+
+	// message restored from persistent storage, nobody waits for its response;
+	// its stored copy is kept unless it was queued
+	e_resend_result resend_message(cached_message_prt_t message);
+
 	bool is_dead();
 
+	// messages queued or awaiting response and their size
+	admission_control_t::usage_t queue_usage();
+	admission_control_t::usage_t queue_usage(const std::string& handle_name);
+
 	service_info_t info() const;
 
 private:
+	// admitted message holds its quota until all its copies are gone
+	// uuids of admitted persistent messages, stored message is resent
+	// only while no message with its uuid is in service
+	struct stored_in_flight_t : private boost::noncopyable {
+		bool insert(const wuuid_t& uuid) {
+			boost::mutex::scoped_lock lock(mutex);
+			return uuids.insert(uuid).second;
+		}
+
+		void erase(const wuuid_t& uuid) {
+			boost::mutex::scoped_lock lock(mutex);
+			uuids.erase(uuid);
+		}
+
+		boost::mutex mutex;
+		std::set<wuuid_t> uuids;
+	};
+
+	struct admitted_message_deleter_t {
+		admitted_message_deleter_t(const cached_message_prt_t& message_,
+								   const boost::shared_ptr<admission_control_t>& admission_,
+								   const boost::shared_ptr<stored_in_flight_t>& in_flight_,
+								   size_t bytes_) :
+			message(message_), admission(admission_), in_flight(in_flight_), bytes(bytes_) {}
+
+		void operator () (message_iface*) {
+			admission->release(message->path().handle_name, bytes);
+
+			if (in_flight) {
+				in_flight->erase(message->uuid());
+			}
+
+			message.reset();
+		}
+
+		cached_message_prt_t message;
+		boost::shared_ptr<admission_control_t> admission;
+		boost::shared_ptr<stored_in_flight_t> in_flight;
+		size_t bytes;
+	};
+
+	// empty pointer if message wasn't admitted, message itself if nothing is tracked
+	cached_message_prt_t admit_message(const cached_message_prt_t& message);
+	void reject_message(const cached_message_prt_t& message);
+	void dispatch_message(const cached_message_prt_t& message);
+	bool drop_oldest_message(const std::string& handle_name, bool any_handle);
+	cached_message_prt_t take_oldest_message(const std::string& handle_name);
+	void remove_from_persistent_storage(const cached_message_prt_t& message);
+
 	void create_new_handles(const handles_info_list_t& handles_info,
 							const handles_endpoints_t& handles_endpoints);
 
@@ -102,6 +192,13 @@ private:
 	void append_to_unhandled(const std::string& handle_name,
 							 const messages_deque_ptr_t& handle_queue);
 
+	// deadline that would be skipped when it's due, dropped on compaction
+	static bool is_unhandled_expiration_stale(const unhandled_expiration_t& expiration);
+
+	// call under m_unhandled_mutex
+	void track_unhandled_deadline(const cached_message_prt_t& message,
+								  const messages_deque_ptr_t& queue);
+
 	void get_outstanding_handles(const handles_endpoints_t& handles_endpoints,
 								 handles_info_list_t& outstanding_handles);
 
@@ -122,13 +219,23 @@ private:
 	// service messages for non-existing handles <handle name, handle ptr>
 	unhandled_messages_map_t m_unhandled_messages;
 
-	// responces map <uuid, response_t>
-	std::map<std::string, boost::shared_ptr<response_t> > m_responses;
+	// deadlines of unhandled messages, earliest first
+	deadline_queue_t<unhandled_expiration_t> m_unhandled_expirations;
+
+	// queued messages watermarks
+	boost::shared_ptr<admission_control_t> m_admission;
+
+	// responses awaiting chunks, sharded by uuid
+	boost::shared_ptr<response_registry_t> m_registry;
+
+	// empty unless messages are stored persistently
+	boost::shared_ptr<stored_in_flight_t> m_stored_in_flight;
 
-	boost::mutex				m_responces_mutex;
-	boost::mutex				m_handles_mutex;
 	boost::mutex				m_unhandled_mutex;
 
+	// senders only read handles map, heartbeats update it
+	boost::shared_mutex			m_handles_mutex;
+
 	volatile bool m_is_running;
 
 	// deadlined messages refresher
@@ -136,8 +243,6 @@ private:
 
 	static const int deadline_check_interval = 1000; // millisecs
 
-	progress_timer m_responces_cleanup_timer;
-
 	bool m_is_dead;
 };
 
@@ -27,16 +27,27 @@
 
 #include "cocaine/dealer/defaults.hpp"
 #include "cocaine/dealer/message_policy.hpp"
+#include "cocaine/dealer/core/balancing_strategy.hpp"
+#include "cocaine/dealer/core/admission_control.hpp"
 
 namespace cocaine {
 namespace dealer {
 
 struct service_info_t {
 public:	
-	service_info_t() : discovery_type(AT_UNDEFINED) {};
+	service_info_t() :
+		discovery_type(AT_UNDEFINED),
+		batching_size(defaults_t::batching_size),
+		balancing_type(defaults_t::balancing_type),
+		overflow_policy(defaults_t::overflow_policy),
+		block_timeout(defaults_t::block_timeout / 1000.0) {};
 	
 	service_info_t(const service_info_t& info) : 
-		discovery_type(AT_UNDEFINED)
+		discovery_type(AT_UNDEFINED),
+		batching_size(defaults_t::batching_size),
+		balancing_type(defaults_t::balancing_type),
+		overflow_policy(defaults_t::overflow_policy),
+		block_timeout(defaults_t::block_timeout / 1000.0)
 	{
 		*this = info;
 	}
@@ -50,7 +61,11 @@ public:
 					  description(description),
 					  app(app),
 					  hosts_source(hosts_source),
-					  discovery_type(discovery_type) {}
+					  discovery_type(discovery_type),
+					  batching_size(defaults_t::batching_size),
+					  balancing_type(defaults_t::balancing_type),
+					  overflow_policy(defaults_t::overflow_policy),
+					  block_timeout(defaults_t::block_timeout / 1000.0) {}
 	
 	bool operator == (const service_info_t& rhs) {
 		return (name == rhs.name &&
@@ -85,6 +100,12 @@ public:
 				break;
 		}
 
+		out << "batching size: " << batching_size << "\n";
+		out << "balancing: " << balancing_strategy_t::type_name(balancing_type) << "\n";
+		out << "service queue limits: " << limits_as_string(service_queue_limits) << "\n";
+		out << "handle queue limits: " << limits_as_string(handle_queue_limits) << "\n";
+		out << "overflow: " << overflow_policy_name(overflow_policy) << "\n";
+
 		return out.str();
 	}
 
@@ -98,8 +119,45 @@ public:
 	enum e_autodiscovery_type discovery_type;
 	short default_discovery_port;
 
+	// max messages handle sends at once
+	int batching_size;
+
+	// how handle picks endpoint for each message
+	enum e_balancing_type balancing_type;
+
+	// queued messages watermarks and what to do when they're reached
+	queue_limits_t service_queue_limits;
+	queue_limits_t handle_queue_limits;
+	enum e_overflow_policy overflow_policy;
+	double block_timeout; // seconds
+
 	// default service message policy
 	message_policy_t policy;
+
+	static std::string limits_as_string(const queue_limits_t& limits) {
+		if (limits.high_messages == 0 && limits.high_bytes == 0) {
+			return "unlimited";
+		}
+
+		std::stringstream out;
+		out << "messages " << limits.low_messages << " - " << limits.high_messages;
+		out << ", bytes " << limits.low_bytes << " - " << limits.high_bytes;
+
+		return out.str();
+	}
+
+	static std::string overflow_policy_name(enum e_overflow_policy type) {
+		switch (type) {
+			case OP_BLOCK:
+				return "BLOCK";
+
+			case OP_DROP_OLDEST:
+				return "DROP_OLDEST";
+
+			default:
+				return "FAIL";
+		}
+	}
 };
 
 } // namespace dealer
@@ -28,6 +28,7 @@
 
 #include <cocaine/dealer/message.hpp>
 #include <cocaine/dealer/response.hpp>
+#include <cocaine/dealer/response_set.hpp>
 #include <cocaine/dealer/utils/data_container.hpp>
 #include <cocaine/dealer/message_path.hpp>
 #include <cocaine/dealer/message_policy.hpp>
@@ -58,6 +59,36 @@ public:
 				 size_t size,
 				 const message_path_t& path);
 
+	// data is referenced, not copied, use data_container::adopt_data()
+	// to hand over caller's buffer
+	response_ptr_t
+	send_message(const data_container& data,
+				 const message_path_t& path,
+				 const message_policy_t& policy);
+
+	response_ptr_t
+	send_message(const data_container& data,
+				 const message_path_t& path);
+
+	// returns at once, on_chunk gets each response chunk and on_done is
+	// called last, both from dealer's completion threads, never blocking
+	// a client thread per message. full queue and dealer shutdown are
+	// reported to on_done as resource_error
+	void
+	send_message_async(const void* data,
+					   size_t size,
+					   const message_path_t& path,
+					   const message_policy_t& policy,
+					   const chunk_callback_t& on_chunk,
+					   const done_callback_t& on_done);
+
+	void
+	send_message_async(const data_container& data,
+					   const message_path_t& path,
+					   const message_policy_t& policy,
+					   const chunk_callback_t& on_chunk,
+					   const done_callback_t& on_done);
+
 	responses_list_t
 	send_messages(const void* data,
 				  size_t size,
@@ -74,28 +105,60 @@ public:
 				 const message_path_t& path,
 				 const message_policy_t& policy)
 	{
-		msgpack::sbuffer buffer;
-		msgpack::pack(buffer, object);
-		return send_message(reinterpret_cast<const void*>(buffer.data()), buffer.size(), path, policy);
+		data_container data;
+		pack_object(object, data);
+		return send_message(data, path, policy);
 	}
 
 	template <typename T> response_ptr_t
 	send_message(const T& object,
 				 const message_path_t& path)
 	{
-		msgpack::sbuffer buffer;
-		msgpack::pack(buffer, object);
-		return send_message(reinterpret_cast<const void*>(buffer.data()), buffer.size(), path);
+		data_container data;
+		pack_object(object, data);
+		return send_message(data, path);
 	}
 
+	// cheap to poll, messages still queued in write-behind journal aren't counted yet
 	size_t stored_messages_count(const std::string& service_alias);
+	size_t stored_bytes(const std::string& service_alias);
+
 	void remove_stored_message(const message_t& message);
 	void remove_stored_message_for(const response_ptr_t& response);
 	void get_stored_messages(const std::string& service_alias,
 							 std::vector<message_t>& messages);
 
+	// streams stored messages to callback, which is called concurrently
+	// from storage iteration threads, nothing is collected in memory
+	void get_stored_messages(const std::string& service_alias,
+							 const stored_message_callback_t& callback);
+
+	// queues stored messages to service again under their ids, responses are
+	// dropped and stored copies removed once done, returns number of messages queued;
+	// messages still queued or awaiting response are skipped, messages which
+	// didn't fit service queue stay stored
+	size_t resend_stored_messages(const std::string& service_alias);
+
 	message_policy_t policy_for_service(const std::string& service_alias);
+
+	// messages queued or awaiting response, of whole service if handle name is empty
+	size_t queued_messages_count(const std::string& service_alias,
+								 const std::string& handle_name = "");
+
+	size_t queued_bytes(const std::string& service_alias,
+						const std::string& handle_name = "");
 	
+private:
+	// packed buffer is handed over to container as is
+	template <typename T> static void
+	pack_object(const T& object, data_container& data) {
+		msgpack::sbuffer buffer;
+		msgpack::pack(buffer, object);
+
+		size_t size = buffer.size();
+		data.adopt_data(buffer.release(), size, &data_container::free_malloced_data);
+	}
+
 private:
 	boost::shared_ptr<dealer_impl_t> m_impl;
 };
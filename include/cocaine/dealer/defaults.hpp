@@ -52,6 +52,21 @@ enum e_message_cache_type {
 	PERSISTENT
 };
 
+enum e_balancing_type {
+	BT_ROUND_ROBIN = 1,
+	BT_LEAST_OUTSTANDING,
+	BT_BACKLOG_WEIGHTED,
+	BT_POWER_OF_TWO,
+	BT_PEAK_EWMA
+};
+
+// what send_message does when service or handle queue is full
+enum e_overflow_policy {
+	OP_FAIL = 1,
+	OP_BLOCK,
+	OP_DROP_OLDEST
+};
+
 struct defaults_t {
 	// logger
 	static const enum e_logger_type logger_type = STDOUT_LOGGER;
@@ -64,12 +79,21 @@ struct defaults_t {
 	static const int protocol_version = 1;
 	static const unsigned long long default_message_deadline = 500;	// milliseconds
 	static const unsigned long long socket_ping_timeout = 1000; // milliseconds
+	static const int io_threads = 0; // 0 - one per cpu core
+	static const int completion_threads = 0; // 0 - one per cpu core
+	static const int batching_size = 100; // messages sent per handle dispatch
+	static const enum e_balancing_type balancing_type = BT_ROUND_ROBIN;
+	static const enum e_overflow_policy overflow_policy = OP_FAIL;
+	static const int block_timeout = 1000; // millisecs
 
 	static const std::string eblob_path;
 	static const size_t eblob_blob_size = 2147483648; // 2 gb
 	static const int eblob_sync_interval = 2;
 	static const int eblob_thread_pool_size = 16;
 	static const int eblob_defrag_timeout = 9999999;
+	static const int journal_batch_size = 256; // messages
+	static const int journal_batch_timeout = 5; // millisecs
+	static const int spill_min_size = 65536; // bytes
 
 	static const unsigned short control_port = 5000;
 	static const unsigned long long heartbeat_interval = 2;	// seconds
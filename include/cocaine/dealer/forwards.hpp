@@ -31,6 +31,9 @@ class service_t;
 
 class response_t;
 class response_impl_t;
+class response_set_t;
+class response_notifier_t;
+class response_registry_t;
 
 } // namespace dealer
 } // namespace cocaine
@@ -23,6 +23,8 @@
 
 #include <string>
 
+#include <boost/function.hpp>
+
 #include <cocaine/dealer/message_path.hpp>
 #include <cocaine/dealer/message_policy.hpp>
 #include <cocaine/dealer/utils/data_container.hpp>
@@ -40,6 +42,8 @@ public:
     std::string         id;
 };
 
+typedef boost::function<void(const message_t&)> stored_message_callback_t;
+
 } // namespace dealer
 } // namespace cocaine
 
@@ -38,18 +38,21 @@ struct message_policy_t {
         persistent(false),
         timeout(0.0f),
         deadline(0.0f),
-        max_retries(0) {}
+        max_retries(0),
+        hedge_after(0.0f) {}
 
     message_policy_t(bool urgent_,
                      bool persistent_,
                      float timeout_,
                      float deadline_,
-                     int max_retries_) :
+                     int max_retries_,
+                     float hedge_after_ = 0.0f) :
         urgent(urgent_),
         persistent(persistent_),
         timeout(timeout_),
         deadline(deadline_),
-        max_retries(max_retries_) {}
+        max_retries(max_retries_),
+        hedge_after(hedge_after_) {}
 
     message_policy_t(const message_policy_t& mp) {
         *this = mp;
@@ -65,6 +68,7 @@ struct message_policy_t {
         timeout = rhs.timeout;
         deadline = rhs.deadline;
         max_retries = rhs.max_retries;
+        hedge_after = rhs.hedge_after;
 
         return *this;
     }
@@ -74,7 +78,8 @@ struct message_policy_t {
                 persistent  == rhs.persistent &&
                 timeout     == rhs.timeout &&
                 deadline    == rhs.deadline &&
-                max_retries == rhs.max_retries);
+                max_retries == rhs.max_retries &&
+                hedge_after == rhs.hedge_after);
     }
 
     bool operator != (const message_policy_t& rhs) const {
@@ -97,7 +102,8 @@ struct message_policy_t {
         sstream << "persistent: " << persistent << ", ";
         sstream << "timeout: " << timeout << ", ";
         sstream << "deadline: " << deadline << ", ";
-        sstream << "max_retries: " << max_retries;
+        sstream << "max_retries: " << max_retries << ", ";
+        sstream << "hedge_after: " << hedge_after;
 
         return sstream.str();
     }
@@ -108,10 +114,15 @@ struct message_policy_t {
     double      deadline;
     int         max_retries;
 
+    // idempotent messages only, seconds: duplicate is sent to another
+    // handle if no response starts within it, first response wins
+    double      hedge_after;
+
     MSGPACK_DEFINE(urgent,
                    timeout,
                    deadline,
-                   max_retries);
+                   max_retries,
+                   hedge_after);
 };
 
 } // namespace dealer
@@ -24,18 +24,25 @@
 #include <string>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 
 #include <cocaine/dealer/forwards.hpp>
 #include <cocaine/dealer/utils/data_container.hpp>
+#include <cocaine/dealer/utils/uuid.hpp>
 #include <cocaine/dealer/response_chunk.hpp>
 #include <cocaine/dealer/message_path.hpp>
 
 namespace cocaine {
 namespace dealer {
 
+// async response callbacks are called from dealer's completion threads,
+// chunk data can be swapped out, error code is 0 when message is done
+typedef boost::function<void(data_container&)> chunk_callback_t;
+typedef boost::function<void(int, const std::string&)> done_callback_t;
+
 class response_t {
 public:
-	response_t(const std::string& uuid, const message_path_t& path);
+	response_t(const wuuid_t& uuid, const message_path_t& path);
 
 	virtual ~response_t();
 
@@ -43,6 +50,7 @@ public:
 
 private:
 	friend class service_t;
+	friend class response_set_t;
 
     void add_chunk(const boost::shared_ptr<response_chunk_t>& chunk);
 
@@ -0,0 +1,78 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_RESPONSE_SET_HPP_INCLUDED_
+#define _COCAINE_DEALER_RESPONSE_SET_HPP_INCLUDED_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <cocaine/dealer/forwards.hpp>
+#include <cocaine/dealer/response.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+// waits on many responses at once and hands them out in completion order,
+// set is used by one thread, response belongs to one set at a time
+class response_set_t : private boost::noncopyable {
+public:
+	typedef boost::shared_ptr<response_t> response_ptr_t;
+
+public:
+	response_set_t();
+	virtual ~response_set_t();
+
+	void add(const response_ptr_t& response);
+	void add(const std::vector<response_ptr_t>& responses);
+
+	// returns response which got chunks or finished, take them with
+	// get(&data, 0.0) until it returns false, response not drained is
+	// returned again, drained finished one leaves the set on next call,
+	// so does one whose error get() has thrown.
+	// empty pointer if set is empty or nothing came before timeout,
+	// timeout < 0 - block until some response is ready
+	response_ptr_t wait_any(double timeout = -1.0);
+
+	size_t size() const;
+	bool empty() const;
+
+private:
+	void check_returned();
+	void remove(size_t slot);
+
+private:
+	// responses by slot, free slots are reused
+	std::vector<response_ptr_t> m_responses;
+	std::vector<size_t> m_free_slots;
+	size_t m_size;
+
+	boost::shared_ptr<response_notifier_t> m_notifier;
+
+	// slot of response returned last, checked on next wait_any()
+	size_t m_returned_slot;
+	bool m_has_returned;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_RESPONSE_SET_HPP_INCLUDED_
@@ -23,13 +23,17 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <utility>
 #include <stdexcept>
+#include <sys/uio.h>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/current_function.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <eblob/eblob.hpp>
 
@@ -44,6 +48,23 @@ class eblob_t : public dealer_object_t {
 public:
 	typedef boost::function<void(const std::string&, void*, uint64_t, int)> iteration_callback_t;
 
+	// message records in data column, kept up to date on write and remove
+	struct stats_t {
+		stats_t() : alive_items(0), alive_bytes(0) {}
+
+		unsigned long long alive_items;
+		unsigned long long alive_bytes;
+	};
+
+	// where record data lies in blob file
+	struct location_t {
+		location_t() : fd(-1), offset(0), size(0) {}
+
+		int fd;
+		uint64_t offset;
+		uint64_t size;
+	};
+
 	eblob_t();
 
 	eblob_t(const std::string& path,
@@ -57,15 +78,26 @@ public:
 	virtual	~eblob_t();
 
 	void write(const std::string& key, const std::string& value, int column = EBLOB_TYPE_DATA);
-	void write(const std::string& key, void* data, size_t size, int column = EBLOB_TYPE_DATA);
+	void write(const std::string& key, const void* data, size_t size, int column = EBLOB_TYPE_DATA);
+
+	// stores record with a single write, several nonempty pieces are
+	// copied into one buffer first, a single one is written in place
+	void write(const std::string& key, const struct iovec* pieces, size_t count, int column = EBLOB_TYPE_DATA);
+
 	std::string read(const std::string& key, int column = EBLOB_TYPE_DATA);
 
+	// reads record straight into caller's buffer of location.size bytes
+	bool locate(const std::string& key, location_t& location, int column = EBLOB_TYPE_DATA);
+	void read(const location_t& location, void* buffer);
+
 	void remove_all(const std::string &key);
 	void remove(const std::string& key, int column = EBLOB_TYPE_DATA);
 
 	unsigned long long items_count();
 	unsigned long long alive_items_count();
+	stats_t stats();
 
+	// callback is called concurrently from eblob iteration threads
 	void iterate(iteration_callback_t callback);
 
 public:
@@ -75,26 +107,52 @@ public:
 	static const int DEFAULT_THREAD_POOL_SIZE = 4;
 
 private:
+	static const size_t key_locks_count = 64;
+
+	struct open_scan_t {
+		boost::mutex mutex;
+		stats_t stats;
+		std::vector<std::pair<eblob_key, int> > spilled;
+	};
+
+	void check_storage(const std::string& key, int column, const char* function);
+
+	// writes and removes of a key are serialized to account them exactly
+	boost::mutex& key_lock(const std::string& key);
+	bool record_size(const eblob_key& ekey, uint64_t& size);
+	void update_stats(bool existed, uint64_t old_size, bool exists, uint64_t new_size);
+
+	// counted once at open, then followed by writes and removes;
+	// spilled records left in other columns are purged at the same pass
+	void scan_at_open();
+
 	void create_eblob(const std::string& path,
 		  			  uint64_t blob_size,
 		  			  int sync_interval,
 		  			  int defrag_timeout);
 
+	void run_iteration(iteration_callback_t& callback);
+
+	static int scan_callback(eblob_disk_control* dc,
+							 eblob_ram_control* rc,
+							 void* data,
+							 void* priv,
+							 void* thread_priv);
+
 	static int iteration_callback(eblob_disk_control* dc,
 								 eblob_ram_control* rc,
 								 void* data,
 								 void* priv,
 								 void* thread_priv);
 
-	void iteration_callback_instance(const std::string& key, void* data, uint64_t size, int column);
-	void counting_iteration_callback(const std::string& key, void* data, uint64_t size, int column);
-
 private:
 	std::string				m_path;
-	iteration_callback_t	m_iteration_callback;
-	int 					m_alive_items_count;
 	int						m_thread_pool_size;
 
+	stats_t					m_stats;
+	boost::mutex			m_stats_mutex;
+	boost::mutex			m_key_locks[key_locks_count];
+
 	boost::shared_ptr<ioremap::eblob::eblob>			m_storage;
 	boost::shared_ptr<ioremap::eblob::eblob_logger>		m_eblob_logger;
 };
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+#ifndef _COCAINE_DEALER_EBLOB_JOURNAL_HPP_INCLUDED_
+#define _COCAINE_DEALER_EBLOB_JOURNAL_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "cocaine/dealer/utils/smart_logger.hpp"
+#include "cocaine/dealer/utils/data_container.hpp"
+#include "cocaine/dealer/storage/eblob.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// write-behind stage in front of eblobs. clients queue writes and
+// removals, writer thread takes everything queued at once when batch
+// is full, oldest entry is batch_timeout old or somebody waits, so
+// concurrent senders share commits. entries are applied in order,
+// removal never overtakes write of the same key
+class eblob_journal_t : private boost::noncopyable {
+public:
+	eblob_journal_t(const boost::shared_ptr<base_logger_t>& logger,
+					size_t batch_size,
+					int batch_timeout);
+
+	// writes everything queued and stops
+	~eblob_journal_t();
+
+	// value is swapped out, returns sequence number to wait for
+	boost::uint64_t write(const boost::shared_ptr<eblob_t>& blob,
+						  const std::string& key,
+						  std::string& value,
+						  int column);
+
+	// record is value followed by shared data, stored as a single record write,
+	// nonempty value makes eblob join them, so pass whole record as data
+	boost::uint64_t write(const boost::shared_ptr<eblob_t>& blob,
+						  const std::string& key,
+						  std::string& value,
+						  const data_container& data,
+						  int column);
+
+	void remove_all(const boost::shared_ptr<eblob_t>& blob, const std::string& key);
+
+	// blocks until entry is written to eblob, false if write failed or
+	// entry is older than failure evicted from failed writes set
+	bool wait(boost::uint64_t sequence);
+
+	// blocks until everything queued so far is written
+	void flush();
+
+	boost::uint64_t batches_count();
+
+private:
+	struct entry_t {
+		entry_t() : column(0), is_removal(false), sequence(0) {}
+
+		boost::shared_ptr<eblob_t> blob;
+		std::string key;
+		std::string value;
+		data_container data;
+		int column;
+		bool is_removal;
+		boost::uint64_t sequence;
+	};
+
+	typedef std::vector<entry_t> entries_t;
+
+	entry_t& enqueue(const boost::shared_ptr<eblob_t>& blob, const std::string& key);
+	void run();
+	void commit(entries_t& batch, std::vector<boost::uint64_t>& failed);
+
+private:
+	boost::shared_ptr<base_logger_t> m_logger;
+	size_t m_batch_size;
+	int m_batch_timeout; // millisecs
+
+	entries_t m_queue;
+	boost::system_time m_oldest_queued;
+
+	// last queued and last written sequence numbers
+	boost::uint64_t m_queued;
+	boost::uint64_t m_written;
+
+	// failed writes nobody asked about yet, newest evicted one
+	std::set<boost::uint64_t> m_failed;
+	boost::uint64_t m_evicted_failure;
+
+	boost::uint64_t m_batches_count;
+	int m_waiters;
+	bool m_is_running;
+
+	boost::mutex m_mutex;
+	boost::condition_variable m_queued_cond;
+	boost::condition_variable m_written_cond;
+	boost::thread m_thread;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_EBLOB_JOURNAL_HPP_INCLUDED_
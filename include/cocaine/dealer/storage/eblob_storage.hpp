@@ -26,6 +26,7 @@
 #include <stdexcept>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -34,6 +35,7 @@
 #include "cocaine/dealer/utils/smart_logger.hpp"
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/storage/eblob.hpp"
+#include "cocaine/dealer/storage/eblob_journal.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 
 namespace cocaine {
@@ -100,6 +102,24 @@ public:
 		return it->second;
 	}
 
+	// removals go through write-behind journal when there is one
+	void set_journal(const boost::shared_ptr<eblob_journal_t>& journal) {
+		m_journal = journal;
+	}
+
+	// removal is queued after write of the same key, if it's still in journal
+	void remove_all(const std::string& nm, const std::string& key) {
+		boost::shared_ptr<eblob_t> eb = get_eblob(nm);
+		boost::shared_ptr<eblob_journal_t> journal = m_journal.lock();
+
+		if (journal) {
+			journal->remove_all(eb, key);
+		}
+		else {
+			eb->remove_all(key);
+		}
+	}
+
 	void close_eblob(const std::string& nm) {
 		std::map<std::string, boost::shared_ptr<eblob_t> >::iterator it = m_eblobs.find(nm);
 
@@ -113,6 +133,7 @@ public:
 
 private:
 	std::map<std::string, boost::shared_ptr<eblob_t> > m_eblobs;
+	boost::weak_ptr<eblob_journal_t> m_journal;
 
 	std::string	m_path;
 	uint64_t	m_blob_size;
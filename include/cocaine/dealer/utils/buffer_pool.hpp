@@ -0,0 +1,101 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_BUFFER_POOL_HPP_INCLUDED_
+#define _COCAINE_DEALER_BUFFER_POOL_HPP_INCLUDED_
+
+#include <string>
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace cocaine {
+namespace dealer {
+
+// size-class pool for data container buffers. buffers up to max_pooled_size come
+// from power of two buckets served by per-thread free lists, bigger ones are
+// malloc'ed directly. every buffer carries it's reference counter in front of it.
+class buffer_pool_t {
+public:
+	struct stats_t {
+		stats_t();
+
+		stats_t& operator += (const stats_t& rhs);
+		std::string as_string() const;
+
+		uint64_t allocations;
+		uint64_t deallocations;
+
+		// served from calling thread's free list
+		uint64_t thread_cache_hits;
+
+		// batches taken from free lists shared by all threads
+		uint64_t shared_refills;
+
+		// malloc calls, pooled and large buffers
+		uint64_t system_allocations;
+		uint64_t large_allocations;
+
+		// idle pooled buffers given back to the system
+		uint64_t trimmed;
+	};
+
+	// returns buffer of at least size bytes with single reference
+	static void* allocate(size_t size);
+	static void deallocate(void* buffer);
+
+	static void add_ref(void* buffer);
+
+	// true if the last reference was dropped, buffer is to be deallocated then
+	static bool release(void* buffer);
+
+	static stats_t stats();
+
+	// frees shared buffers no thread took since previous trim, called
+	// periodically so pools shrink back once load goes down
+	static void trim();
+
+	static const size_t min_pooled_size = 64;
+	static const size_t max_pooled_size = 64 * 1024;
+	static const size_t size_classes_count = 11;
+
+	// free buffers kept by each thread per size class
+	static const size_t thread_cache_size = 64;
+	static const size_t refill_batch_size = 16;
+
+private:
+	struct header_t;
+	struct thread_cache_t;
+	struct shared_lists_t;
+
+	static header_t* header(void* buffer);
+	static int size_class(size_t size);
+
+	static thread_cache_t& thread_cache();
+	static shared_lists_t& shared_lists();
+
+	static void refill(thread_cache_t& cache, int size_class);
+	static void flush(thread_cache_t& cache, int size_class, size_t count);
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_BUFFER_POOL_HPP_INCLUDED_
@@ -26,13 +26,16 @@
 #include <sys/time.h>
 
 #include <boost/shared_ptr.hpp>
-#include <boost/detail/atomic_count.hpp>
 
 namespace cocaine {
 namespace dealer {
 
 class data_container {
 
+public:
+	// releases adopted data, hint is passed as is
+	typedef void (*free_fn_t)(void* data, void* hint);
+
 public:
 	data_container();
 	data_container(const void* data, size_t size);
@@ -45,6 +48,24 @@ public:
 
 	void set_data(const void* data, size_t size);
 
+	// takes ownership of data without copying, free_fn is called once the last
+	// container sharing it is released, data is delete[]'d if free_fn is NULL
+	void adopt_data(void* data, size_t size, free_fn_t free_fn = NULL, void* hint = NULL);
+
+	// makes dc reference the same data, no copying
+	bool share_data(data_container& dc) const;
+
+	// exchanges contents without touching reference counters
+	void swap(data_container& dc);
+
+	// free_fn_t for malloc'ed buffers, i.e. released msgpack::sbuffer
+	static void free_malloced_data(void* data, void* hint);
+
+	// keeps data alive past container lifetime, returned hint is to be
+	// passed to release_buffer() along with data(), zmq free_fn style
+	void* retain_buffer() const;
+	static void release_buffer(void* data, void* hint);
+
 	void* data() const;
 	size_t size() const;
 	bool empty() const;
@@ -66,24 +87,32 @@ protected:
 	// max amount of data that does not need sha1 signature 1 mb
 	static const size_t SMALL_DATA_SIZE = 1024 * 1024;
 
-	typedef boost::detail::atomic_count reference_counter;
-	
+	// pooled control block of adopted data
+	struct adopted_data_t {
+		free_fn_t free_fn;
+		void* hint;
+	};
+
 	void init();
 	void release();
 
-	void sign_data(unsigned char* data, size_t& size, unsigned char signature[SHA1_SIZE]);
+	// signature is computed on first comparison of big containers only,
+	// shared container may be compared from several threads at once
+	const unsigned char* signature() const;
+	static void sign_data(unsigned char* data, size_t size, unsigned char signature[SHA1_SIZE]);
 
 protected:
 	// data
 	unsigned char* data_;
 	size_t size_;
 
-	// data sha1 signature
-	bool signed_;
-	unsigned char signature_[SHA1_SIZE];
+	// pooled buffer holding data and reference counter, or adopted_data_t
+	void* buffer_;
 
-	// data reference counter
-	boost::shared_ptr<reference_counter> ref_counter_;
+	// data sha1 signature, lazily cached. both are set once under
+	// signature mutex, signature doesn't change after that
+	mutable bool signed_;
+	mutable unsigned char signature_[SHA1_SIZE];
 };
 
 } // namespace dealer
@@ -0,0 +1,147 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_DEADLINE_QUEUE_HPP_INCLUDED_
+#define _COCAINE_DEALER_DEADLINE_QUEUE_HPP_INCLUDED_
+
+#include <vector>
+#include <algorithm>
+
+namespace cocaine {
+namespace dealer {
+
+// min-heap of (deadline, value) pairs. entries are never removed explicitly,
+// owners are expected to validate popped values and skip stale ones, so both
+// push and pop stay O(log n) and expiry costs O(expired) instead of a full scan.
+// owners that may leave many stale entries behind push with a staleness check,
+// heap is then compacted each time it doubles, which keeps it within twice the
+// number of live entries at amortized O(1) cost per push.
+template <typename T>
+class deadline_queue_t {
+public:
+	deadline_queue_t() :
+		m_compact_size(min_compact_size) {}
+
+	void push(double deadline, const T& value) {
+		m_heap.push_back(entry_t(deadline, value));
+		std::push_heap(m_heap.begin(), m_heap.end(), later_t());
+	}
+
+	// is_stale(value) tells entries which would be skipped when popped
+	template <typename StalePredicate>
+	void push(double deadline, const T& value, StalePredicate is_stale) {
+		push(deadline, value);
+
+		if (m_heap.size() >= m_compact_size) {
+			compact(is_stale);
+		}
+	}
+
+	// drops stale entries, returns number of entries dropped
+	template <typename StalePredicate>
+	size_t compact(StalePredicate is_stale) {
+		size_t size = m_heap.size();
+
+		m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(), stale_entry_t<StalePredicate>(is_stale)),
+					 m_heap.end());
+
+		std::make_heap(m_heap.begin(), m_heap.end(), later_t());
+		m_compact_size = std::max(min_compact_size, 2 * m_heap.size());
+
+		// memory of a burst is given back once it's over
+		if (m_heap.capacity() > 4 * m_compact_size) {
+			std::vector<entry_t>(m_heap).swap(m_heap);
+		}
+
+		return size - m_heap.size();
+	}
+
+	// pops next entry if it's deadline is not after 'now'
+	bool pop_due(double now, T& value) {
+		if (m_heap.empty() || m_heap.front().deadline > now) {
+			return false;
+		}
+
+		std::pop_heap(m_heap.begin(), m_heap.end(), later_t());
+		value = m_heap.back().value;
+		m_heap.pop_back();
+
+		return true;
+	}
+
+	// earliest deadline, only meaningful when queue is not empty
+	double next_deadline() const {
+		return m_heap.front().deadline;
+	}
+
+	bool empty() const {
+		return m_heap.empty();
+	}
+
+	size_t size() const {
+		return m_heap.size();
+	}
+
+	void clear() {
+		m_heap.clear();
+		m_compact_size = min_compact_size;
+	}
+
+private:
+	static const size_t min_compact_size = 1024;
+
+	struct entry_t {
+		entry_t(double deadline_, const T& value_) :
+			deadline(deadline_), value(value_) {}
+
+		double deadline;
+		T value;
+	};
+
+	struct later_t {
+		bool operator () (const entry_t& lhs, const entry_t& rhs) const {
+			return lhs.deadline > rhs.deadline;
+		}
+	};
+
+	template <typename StalePredicate>
+	struct stale_entry_t {
+		stale_entry_t(StalePredicate is_stale_) : is_stale(is_stale_) {}
+
+		bool operator () (const entry_t& entry) const {
+			return is_stale(entry.value);
+		}
+
+		StalePredicate is_stale;
+	};
+
+	std::vector<entry_t> m_heap;
+
+	// heap size next compaction happens at
+	size_t m_compact_size;
+};
+
+template <typename T>
+const size_t deadline_queue_t<T>::min_compact_size;
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_DEADLINE_QUEUE_HPP_INCLUDED_
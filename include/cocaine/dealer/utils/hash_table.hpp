@@ -0,0 +1,198 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_HASH_TABLE_HPP_INCLUDED_
+#define _COCAINE_DEALER_HASH_TABLE_HPP_INCLUDED_
+
+#include <vector>
+#include <cstddef>
+
+namespace cocaine {
+namespace dealer {
+
+// open addressing hash table with linear probing and backward shift deletion,
+// no tombstones and no allocations unless it has to grow or shrink. it shrinks
+// back towards initial capacity once load falls under 0.2. slots can be walked
+// by index with capacity()/is_used()/key()/value(), erasing while walking
+// moves elements around, so collect keys first.
+template <typename Key, typename Value, typename Hash>
+class open_hash_table_t {
+public:
+	explicit open_hash_table_t(size_t initial_capacity = 64) :
+		m_size(0),
+		m_min_capacity(8)
+	{
+		while (m_min_capacity < initial_capacity) {
+			m_min_capacity <<= 1;
+		}
+
+		m_slots.resize(m_min_capacity);
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+
+	bool empty() const {
+		return m_size == 0;
+	}
+
+	size_t capacity() const {
+		return m_slots.size();
+	}
+
+	bool is_used(size_t index) const {
+		return m_slots[index].used;
+	}
+
+	const Key& key(size_t index) const {
+		return m_slots[index].key;
+	}
+
+	Value& value(size_t index) {
+		return m_slots[index].value;
+	}
+
+	// inserts or replaces value for key, true if key wasn't there
+	bool insert(const Key& key, const Value& value) {
+		// keep load factor under 0.7
+		if ((m_size + 1) * 10 > m_slots.size() * 7) {
+			rehash(m_slots.size() * 2);
+		}
+
+		size_t index = find_slot(key);
+		bool inserted = !m_slots[index].used;
+
+		if (inserted) {
+			m_slots[index].used = true;
+			m_slots[index].key = key;
+			++m_size;
+		}
+
+		m_slots[index].value = value;
+		return inserted;
+	}
+
+	Value* find(const Key& key) {
+		size_t index = find_slot(key);
+		return m_slots[index].used ? &m_slots[index].value : NULL;
+	}
+
+	bool erase(const Key& key) {
+		size_t index = find_slot(key);
+
+		if (!m_slots[index].used) {
+			return false;
+		}
+
+		erase_slot(index);
+
+		// load stays under 0.4 after shrink, far from growing again
+		if (m_slots.size() > m_min_capacity && m_size * 5 < m_slots.size()) {
+			rehash(m_slots.size() / 2);
+		}
+
+		return true;
+	}
+
+	void clear() {
+		std::vector<slot_t>(m_min_capacity).swap(m_slots);
+		m_size = 0;
+	}
+
+private:
+	struct slot_t {
+		slot_t() : used(false) {}
+
+		bool	used;
+		Key		key;
+		Value	value;
+	};
+
+	size_t mask() const {
+		return m_slots.size() - 1;
+	}
+
+	// slot holding key or the empty slot where it belongs
+	size_t find_slot(const Key& key) const {
+		size_t index = m_hash(key) & mask();
+
+		while (m_slots[index].used && !(m_slots[index].key == key)) {
+			index = (index + 1) & mask();
+		}
+
+		return index;
+	}
+
+	void erase_slot(size_t index) {
+		size_t next = index;
+
+		for (;;) {
+			next = (next + 1) & mask();
+
+			if (!m_slots[next].used) {
+				break;
+			}
+
+			// leave element alone if it's home slot lies cyclically in (index, next]
+			size_t home = m_hash(m_slots[next].key) & mask();
+
+			bool in_place = (index <= next) ?
+				(index < home && home <= next) :
+				(index < home || home <= next);
+
+			if (in_place) {
+				continue;
+			}
+
+			m_slots[index] = m_slots[next];
+			index = next;
+		}
+
+		m_slots[index] = slot_t();
+		--m_size;
+	}
+
+	void rehash(size_t capacity) {
+		std::vector<slot_t> old_slots(capacity);
+		old_slots.swap(m_slots);
+		m_size = 0;
+
+		for (size_t i = 0; i < old_slots.size(); ++i) {
+			if (old_slots[i].used) {
+				size_t index = find_slot(old_slots[i].key);
+
+				m_slots[index] = old_slots[i];
+				++m_size;
+			}
+		}
+	}
+
+private:
+	std::vector<slot_t> m_slots;
+	size_t m_size;
+	size_t m_min_capacity;
+	Hash m_hash;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_HASH_TABLE_HPP_INCLUDED_
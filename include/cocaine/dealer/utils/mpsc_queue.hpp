@@ -0,0 +1,146 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_MPSC_QUEUE_HPP_INCLUDED_
+#define _COCAINE_DEALER_MPSC_QUEUE_HPP_INCLUDED_
+
+#include <cstddef>
+
+#include <boost/utility.hpp>
+#include <stdint.h>
+
+namespace cocaine {
+namespace dealer {
+
+// bounded lock-free queue for many producers and a single consumer,
+// based on dmitry vyukov's bounded mpmc queue. push() never blocks and
+// fails when the queue is full, pop() must only be called by one thread
+// at a time (or under a lock shared by all consumers).
+template <typename T>
+class mpsc_queue_t : private boost::noncopyable {
+public:
+	explicit mpsc_queue_t(size_t capacity) :
+		m_buffer(NULL),
+		m_mask(0),
+		m_enqueue_pos(0),
+		m_dequeue_pos(0)
+	{
+		// round capacity up to power of two
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+
+		m_buffer = new cell_t[size];
+		m_mask = size - 1;
+
+		for (size_t i = 0; i < size; ++i) {
+			m_buffer[i].sequence = i;
+		}
+	}
+
+	virtual ~mpsc_queue_t() {
+		delete [] m_buffer;
+	}
+
+	bool push(const T& value) {
+		cell_t* cell = NULL;
+		size_t pos = m_enqueue_pos;
+
+		for (;;) {
+			cell = &m_buffer[pos & m_mask];
+			size_t sequence = cell->sequence;
+			__sync_synchronize();
+
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&m_enqueue_pos, pos, pos + 1)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				// full
+				return false;
+			}
+
+			pos = m_enqueue_pos;
+		}
+
+		cell->value = value;
+		__sync_synchronize();
+		cell->sequence = pos + 1;
+
+		return true;
+	}
+
+	bool pop(T& value) {
+		size_t pos = m_dequeue_pos;
+		cell_t* cell = &m_buffer[pos & m_mask];
+
+		size_t sequence = cell->sequence;
+		__sync_synchronize();
+
+		if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0) {
+			// empty
+			return false;
+		}
+
+		value = cell->value;
+		cell->value = T();
+		__sync_synchronize();
+
+		cell->sequence = pos + m_mask + 1;
+		m_dequeue_pos = pos + 1;
+
+		return true;
+	}
+
+	bool empty() const {
+		return m_enqueue_pos == m_dequeue_pos;
+	}
+
+	size_t capacity() const {
+		return m_mask + 1;
+	}
+
+private:
+	static const size_t cacheline_size = 64;
+
+	struct cell_t {
+		volatile size_t sequence;
+		T value;
+	};
+
+	cell_t* m_buffer;
+	size_t m_mask;
+
+	// keep producers and consumer positions on separate cache lines
+	char m_pad0[cacheline_size];
+	volatile size_t m_enqueue_pos;
+	char m_pad1[cacheline_size];
+	volatile size_t m_dequeue_pos;
+	char m_pad2[cacheline_size];
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_MPSC_QUEUE_HPP_INCLUDED_
@@ -31,6 +31,7 @@
 #include <zmq.hpp>
 
 #include <cocaine/dealer/utils/error.hpp>
+#include <cocaine/dealer/utils/data_container.hpp>
 
 namespace cocaine {
 namespace dealer {
@@ -46,6 +47,10 @@ public:
     static bool recv_zmq_message(zmq::socket_t& sock, zmq::message_t& msg, std::string& str, int flags = ZMQ_NOBLOCK);
     static bool recv_zmq_message(zmq::socket_t& sock, zmq::message_t& msg, msgpack::object& obj, int flags = ZMQ_NOBLOCK);
 
+    // data takes over zmq message storage, nothing is copied
+    static bool recv_zmq_message(zmq::socket_t& sock, zmq::message_t& msg, data_container& data, int flags = ZMQ_NOBLOCK);
+    static void free_zmq_message(void* data, void* hint);
+
     template <typename T>
     static bool recv_zmq_message(zmq::socket_t& sock,
                                  zmq::message_t& msg,
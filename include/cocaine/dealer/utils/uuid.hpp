@@ -21,14 +21,30 @@
 #ifndef _COCAINE_DEALER_UUID_HPP_INCLUDED_
 #define _COCAINE_DEALER_UUID_HPP_INCLUDED_
 
+#include <string>
 #include <uuid/uuid.h>
 
+#include <boost/cstdint.hpp>
+
 namespace cocaine {
 namespace dealer {
 
+// 128 bit uuid kept in binary form, text form is only produced on demand
 class wuuid_t {
 public:
-	wuuid_t() {}
+	static const size_t string_length = 36;
+
+	wuuid_t() :
+		m_hi(0), m_lo(0) {}
+
+	wuuid_t(boost::uint64_t hi, boost::uint64_t lo) :
+		m_hi(hi), m_lo(lo) {}
+
+	explicit wuuid_t(const std::string& str) :
+		m_hi(0), m_lo(0)
+	{
+		from_string(str);
+	}
 
 	static const std::string generate() {
 		uuid_t uuid;
@@ -38,8 +54,122 @@ public:
 		uuid_unparse(uuid, buff);
 		return buff;
 	}
+
+	// unique id made of per-thread random prefix and counter,
+	// unlike generate() takes no syscall or entropy per call
+	static wuuid_t create();
+
+	// parses canonical xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx form
+	bool from_string(const std::string& str) {
+		return from_chars(str.data(), str.size());
+	}
+
+	bool from_chars(const char* str, size_t size) {
+		if (size != string_length) {
+			return false;
+		}
+
+		boost::uint64_t value[2] = { 0, 0 };
+		size_t nibbles = 0;
+
+		for (size_t i = 0; i < size; ++i) {
+			if (i == 8 || i == 13 || i == 18 || i == 23) {
+				if (str[i] != '-') {
+					return false;
+				}
+
+				continue;
+			}
+
+			int nibble = hex_value(str[i]);
+
+			if (nibble < 0) {
+				return false;
+			}
+
+			boost::uint64_t& half = value[nibbles / 16];
+			half = (half << 4) | static_cast<boost::uint64_t>(nibble);
+			++nibbles;
+		}
+
+		m_hi = value[0];
+		m_lo = value[1];
+
+		return true;
+	}
+
+	std::string as_string() const {
+		char buff[string_length];
+		to_chars(buff);
+
+		return std::string(buff, sizeof(buff));
+	}
+
+	// writes string_length chars of text form, no terminating zero
+	void to_chars(char* buff) const {
+		static const char digits[] = "0123456789abcdef";
+
+		size_t pos = 0;
+		for (int i = 0; i < 32; ++i) {
+			if (i == 8 || i == 12 || i == 16 || i == 20) {
+				buff[pos++] = '-';
+			}
+
+			boost::uint64_t half = (i < 16) ? m_hi : m_lo;
+			int shift = (15 - (i % 16)) * 4;
+			buff[pos++] = digits[(half >> shift) & 0xf];
+		}
+	}
+
+	size_t hash() const {
+		// murmur3 finalizer over both halves
+		boost::uint64_t h = m_hi ^ (m_lo * 0x9e3779b97f4a7c15ULL);
+
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+
+		return static_cast<size_t>(h);
+	}
+
+	bool empty() const {
+		return m_hi == 0 && m_lo == 0;
+	}
+
+	bool operator == (const wuuid_t& rhs) const {
+		return m_hi == rhs.m_hi && m_lo == rhs.m_lo;
+	}
+
+	bool operator != (const wuuid_t& rhs) const {
+		return !(*this == rhs);
+	}
+
+	bool operator < (const wuuid_t& rhs) const {
+		return m_hi < rhs.m_hi || (m_hi == rhs.m_hi && m_lo < rhs.m_lo);
+	}
+
+private:
+	static int hex_value(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+		return -1;
+	}
+
+private:
+	boost::uint64_t m_hi;
+	boost::uint64_t m_lo;
 };
 
+// lets boost::hash and unordered containers take wuuid_t as key
+inline size_t
+hash_value(const wuuid_t& uuid) {
+	return uuid.hash();
+}
+
 } // namespace dealer
 } // namespace cocaine
 
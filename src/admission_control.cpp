@@ -0,0 +1,192 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include "cocaine/dealer/core/admission_control.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+admission_control_t::admission_control_t(const queue_limits_t& service_limits,
+										 const queue_limits_t& handle_limits) :
+	m_service_limits(service_limits),
+	m_handle_limits(handle_limits)
+{
+}
+
+bool
+admission_control_t::is_enabled() const {
+	return (m_service_limits.high_messages > 0 ||
+			m_service_limits.high_bytes > 0 ||
+			m_handle_limits.high_messages > 0 ||
+			m_handle_limits.high_bytes > 0);
+}
+
+bool
+admission_control_t::fits(const usage_t& usage, const queue_limits_t& limits, size_t bytes) {
+	if (limits.high_messages > 0 && usage.messages + 1 > limits.high_messages) {
+		return false;
+	}
+
+	// message bigger than the limit itself still passes into empty queue
+	if (limits.high_bytes > 0 && usage.messages > 0 && usage.bytes + bytes > limits.high_bytes) {
+		return false;
+	}
+
+	return true;
+}
+
+bool
+admission_control_t::drained(const usage_t& usage, const queue_limits_t& limits) {
+	if (limits.high_messages > 0 && usage.messages > limits.low_messages) {
+		return false;
+	}
+
+	if (limits.high_bytes > 0 && usage.bytes > limits.low_bytes) {
+		return false;
+	}
+
+	return true;
+}
+
+bool
+admission_control_t::try_acquire_locked(usage_t& handle, size_t bytes, bool respect_closed) {
+	if (respect_closed && (m_service_usage.closed || handle.closed)) {
+		return false;
+	}
+
+	bool admitted = true;
+
+	if (!fits(m_service_usage, m_service_limits, bytes)) {
+		m_service_usage.closed = true;
+		admitted = false;
+	}
+
+	if (!fits(handle, m_handle_limits, bytes)) {
+		handle.closed = true;
+		admitted = false;
+	}
+
+	if (!admitted) {
+		return false;
+	}
+
+	++m_service_usage.messages;
+	m_service_usage.bytes += bytes;
+
+	++handle.messages;
+	handle.bytes += bytes;
+
+	return true;
+}
+
+bool
+admission_control_t::try_acquire(const std::string& handle_name, size_t bytes) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return try_acquire_locked(m_handles_usage[handle_name], bytes, true);
+}
+
+bool
+admission_control_t::acquire(const std::string& handle_name, size_t bytes, double timeout) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	usage_t& handle = m_handles_usage[handle_name];
+
+	if (try_acquire_locked(handle, bytes, true)) {
+		return true;
+	}
+
+	boost::system_time deadline = boost::get_system_time();
+	deadline += boost::posix_time::microseconds(static_cast<boost::int64_t>(timeout * 1000000.0));
+
+	while (m_opened.timed_wait(lock, deadline)) {
+		if (try_acquire_locked(handle, bytes, true)) {
+			return true;
+		}
+	}
+
+	// one last chance, room might have appeared right at the deadline
+	return try_acquire_locked(handle, bytes, true);
+}
+
+bool
+admission_control_t::try_acquire_dropped(const std::string& handle_name, size_t bytes) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return try_acquire_locked(m_handles_usage[handle_name], bytes, false);
+}
+
+bool
+admission_control_t::handle_fits(const std::string& handle_name, size_t bytes) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return fits(m_handles_usage[handle_name], m_handle_limits, bytes);
+}
+
+void
+admission_control_t::release(const std::string& handle_name, size_t bytes) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	usage_t& handle = m_handles_usage[handle_name];
+
+	--m_service_usage.messages;
+	m_service_usage.bytes -= bytes;
+
+	--handle.messages;
+	handle.bytes -= bytes;
+
+	bool opened = false;
+
+	if (m_service_usage.closed && drained(m_service_usage, m_service_limits)) {
+		m_service_usage.closed = false;
+		opened = true;
+	}
+
+	if (handle.closed && drained(handle, m_handle_limits)) {
+		handle.closed = false;
+		opened = true;
+	}
+
+	if (opened) {
+		m_opened.notify_all();
+	}
+}
+
+admission_control_t::usage_t
+admission_control_t::service_usage() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_service_usage;
+}
+
+admission_control_t::usage_t
+admission_control_t::handle_usage(const std::string& handle_name) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	std::map<std::string, usage_t>::const_iterator it = m_handles_usage.find(handle_name);
+
+	if (it == m_handles_usage.end()) {
+		return usage_t();
+	}
+
+	return it->second;
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,86 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/dealer/core/async_response.hpp"
+#include "cocaine/dealer/utils/error.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+async_response_t::async_response_t(const chunk_callback_t& on_chunk,
+								   const done_callback_t& on_done) :
+	m_on_chunk(on_chunk),
+	m_on_done(on_done),
+	m_is_finished(false)
+{
+}
+
+bool
+async_response_t::accept(const response_chunk_t& chunk) {
+	if (m_is_finished) {
+		return false;
+	}
+
+	switch (chunk.rpc_code) {
+		case SERVER_RPC_MESSAGE_CHUNK:
+			break;
+
+		case SERVER_RPC_MESSAGE_CHOKE:
+		case SERVER_RPC_MESSAGE_ERROR:
+			m_is_finished = true;
+			break;
+
+		default:
+			throw internal_error("async response received chunk with invalid RPC code: %d", chunk.rpc_code);
+	}
+
+	return true;
+}
+
+bool
+async_response_t::is_finished() const {
+	return m_is_finished;
+}
+
+void
+async_response_t::deliver(const boost::shared_ptr<response_chunk_t>& chunk) {
+	switch (chunk->rpc_code) {
+		case SERVER_RPC_MESSAGE_CHUNK:
+			if (m_on_chunk) {
+				m_on_chunk(chunk->data);
+			}
+			break;
+
+		case SERVER_RPC_MESSAGE_CHOKE:
+			if (m_on_done) {
+				m_on_done(0, "");
+			}
+			break;
+
+		case SERVER_RPC_MESSAGE_ERROR:
+			if (m_on_done) {
+				m_on_done(chunk->error_code, chunk->error_message);
+			}
+			break;
+	}
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -32,14 +32,19 @@ namespace dealer {
 balancer_t::balancer_t(const std::string& identity,
 					   const std::vector<cocaine_endpoint_t>& endpoints,
 					   const boost::shared_ptr<context_t>& ctx,
+					   enum e_balancing_type balancing_type,
 					   bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
+	m_connected(false),
+	m_receive_index(0),
 	m_endpoints(endpoints),
-	m_current_endpoint_index(0),
-	m_socket_identity(identity)
+	m_socket_identity(identity),
+	m_strategy(balancing_strategy_t::create(balancing_type)),
+	m_loads_timestamp(0.0)
 {
 	std::sort(m_endpoints.begin(), m_endpoints.end());
-	recreate_socket();
+	m_loads.resize(m_endpoints.size());
+	m_endpoint_sockets.resize(m_endpoints.size(), NULL);
 }
 
 balancer_t::~balancer_t() {
@@ -48,33 +53,27 @@ balancer_t::~balancer_t() {
 
 void
 balancer_t::connect(const std::vector<cocaine_endpoint_t>& endpoints) {
-
 	if (log_flag_enabled(PLOG_DEBUG)) {
 		log(PLOG_DEBUG, "connect " + m_socket_identity);
 	}
 
-	if (endpoints.empty()) {
-		return;
-	}
+	std::vector<cocaine_endpoint_t> endpoints_tmp = endpoints;
+	std::sort(endpoints_tmp.begin(), endpoints_tmp.end());
 
-	assert(m_socket);
+	bool changed = (m_endpoints != endpoints_tmp);
+	m_endpoints.swap(endpoints_tmp);
 
-	std::string connection_str;
-	try {
-		for (size_t i = 0; i < endpoints.size(); ++i) {
-			connection_str = endpoints[i].endpoint;
-			m_socket->connect(connection_str.c_str());
-		}
-	}
-	catch (const std::exception& ex) {
-		std::string error_msg = "balancer with identity " + m_socket_identity + " could not connect to ";
-		error_msg += connection_str + " at " + std::string(BOOST_CURRENT_FUNCTION);
-		throw internal_error(error_msg);
+	if (changed) {
+		m_loads.assign(m_endpoints.size(), endpoint_load_t());
+		m_latency.retain(m_endpoints);
 	}
+
+	m_connected = true;
+	sync_sockets();
 }
 
 void balancer_t::disconnect() {
-	if (!m_socket) {
+	if (!m_connected) {
 		return;
 	}
 
@@ -82,7 +81,8 @@ void balancer_t::disconnect() {
 		log(PLOG_DEBUG, "disconnect balancer " + m_socket_identity);
 	}
 
-	m_socket.reset();
+	m_connected = false;
+	sync_sockets();
 }
 
 void	
@@ -94,34 +94,78 @@ balancer_t::update_endpoints(const std::vector<cocaine_endpoint_t>& endpoints,
 
 	if (m_endpoints.size() == endpoints_tmp.size()) {
 		if (std::equal(m_endpoints.begin(), m_endpoints.end(), endpoints_tmp.begin())) {
+			// same endpoints, pick up fresh load reported by heartbeats
+			m_endpoints.swap(endpoints_tmp);
 			return;
 		}
 	}
 
 	std::vector<cocaine_endpoint_t> new_endpoints;
-	get_endpoints_diff(endpoints, new_endpoints, missing_endpoints);
+	get_endpoints_diff(endpoints_tmp, new_endpoints, missing_endpoints);
+
+	if (log_flag_enabled(PLOG_DEBUG)) {
+		log(PLOG_DEBUG, "endpoints update on %s, new: %d, missing: %d",
+			m_socket_identity.c_str(), new_endpoints.size(), missing_endpoints.size());
+	}
 
-	if (!missing_endpoints.empty()) {
+	m_endpoints.swap(endpoints_tmp);
+	m_loads.assign(m_endpoints.size(), endpoint_load_t());
+	m_latency.retain(m_endpoints);
 
-		if (log_flag_enabled(PLOG_DEBUG)) {
-			log(PLOG_DEBUG, "missing endpoints on " + m_socket_identity);
-		}
+	// only sockets of changed endpoints are connected or closed
+	sync_sockets();
+}
+
+const std::vector<cocaine_endpoint_t>&
+balancer_t::endpoints() const {
+	return m_endpoints;
+}
+
+bool
+balancer_t::uses_in_flight() const {
+	return m_strategy->uses_in_flight();
+}
 
-		recreate_socket();
-		connect(endpoints);
+void
+balancer_t::set_in_flight(const std::vector<size_t>& in_flight) {
+	if (in_flight.size() != m_loads.size()) {
+		return;
 	}
-	else {
-		if (!new_endpoints.empty()) {
 
-			if (log_flag_enabled(PLOG_DEBUG)) {
-				log(PLOG_DEBUG, "new endpoints on " + m_socket_identity);
-			}
+	for (size_t i = 0; i < in_flight.size(); ++i) {
+		m_loads[i].in_flight = in_flight[i];
+	}
+}
 
-			connect(new_endpoints);
-		}
+void
+balancer_t::ack_received(const std::string& route, const time_value& sent_timestamp) {
+	time_value now = time_value::get_current_time();
+	m_latency.ack_received(route, now.distance(sent_timestamp), now.as_double());
+}
+
+void
+balancer_t::response_received(const std::string& route, const time_value& sent_timestamp) {
+	time_value now = time_value::get_current_time();
+	m_latency.response_received(route, now.distance(sent_timestamp), now.as_double());
+}
+
+void
+balancer_t::update_loads() {
+	m_loads_timestamp = time_value::get_current_time().as_double();
+
+	if (0 == m_latency.update(m_endpoints, m_loads_timestamp, m_loads)) {
+		return;
 	}
 
-	m_endpoints = endpoints;
+	if (log_flag_enabled(PLOG_WARNING)) {
+		for (size_t i = 0; i < m_loads.size(); ++i) {
+			if (m_loads[i].ejected) {
+				std::string message = "endpoint ejected for slow responses on " + m_socket_identity;
+				message += ", " + m_endpoints[i].as_string() + ", latency: %.3f";
+				log(PLOG_WARNING, message, m_loads[i].latency);
+			}
+		}
+	}
 }
 
 void
@@ -142,131 +186,306 @@ balancer_t::get_endpoints_diff(const std::vector<cocaine_endpoint_t>& updated_en
 	}
 }
 
-void
-balancer_t::recreate_socket() {
+balancer_t::socket_ptr_t
+balancer_t::create_socket(const std::string& endpoint) {
 	if (log_flag_enabled(PLOG_DEBUG)) {
-		log(PLOG_DEBUG, "recreate_socket " + m_socket_identity);
+		log(PLOG_DEBUG, "connect " + m_socket_identity + " to " + endpoint);
 	}
 
 	int timeout = balancer_t::socket_timeout;
 	int64_t hwm = balancer_t::socket_hwm;
-	m_socket.reset(new zmq::socket_t(*(context()->zmq_context()), ZMQ_ROUTER));
-	m_socket->setsockopt(ZMQ_LINGER, &timeout, sizeof(timeout));
-	m_socket->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
-	m_socket->setsockopt(ZMQ_IDENTITY, m_socket_identity.c_str(), m_socket_identity.length());
+
+	socket_ptr_t socket(new zmq::socket_t(*(context()->zmq_context()), ZMQ_ROUTER));
+	socket->setsockopt(ZMQ_LINGER, &timeout, sizeof(timeout));
+	socket->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+	socket->setsockopt(ZMQ_IDENTITY, m_socket_identity.c_str(), m_socket_identity.length());
+	socket->connect(endpoint.c_str());
+
+	return socket;
 }
 
-cocaine_endpoint_t&
-balancer_t::get_next_endpoint() {
-	if (m_current_endpoint_index < m_endpoints.size() - 1) {
-		++m_current_endpoint_index;
+void
+balancer_t::sync_sockets() {
+	sockets_map_t sockets;
+	std::string connection_str;
+
+	if (m_connected) {
+		try {
+			for (size_t i = 0; i < m_endpoints.size(); ++i) {
+				connection_str = m_endpoints[i].endpoint;
+
+				if (sockets.find(connection_str) != sockets.end()) {
+					continue;
+				}
+
+				sockets_map_t::iterator it = m_sockets.find(connection_str);
+				socket_ptr_t socket = (it != m_sockets.end()) ? it->second : create_socket(connection_str);
+				sockets.insert(std::make_pair(connection_str, socket));
+			}
+		}
+		catch (const std::exception& ex) {
+			std::string error_msg = "balancer with identity " + m_socket_identity + " could not connect to ";
+			error_msg += connection_str + " at " + std::string(BOOST_CURRENT_FUNCTION);
+			throw internal_error(error_msg);
+		}
 	}
-	else {
-		m_current_endpoint_index = 0;	
+
+	// sockets of addresses no longer in use are closed here
+	m_sockets.swap(sockets);
+	m_receive_index = 0;
+
+	m_endpoint_sockets.assign(m_endpoints.size(), NULL);
+
+	for (size_t i = 0; i < m_endpoints.size(); ++i) {
+		sockets_map_t::iterator it = m_sockets.find(m_endpoints[i].endpoint);
+
+		if (it != m_sockets.end()) {
+			m_endpoint_sockets[i] = it->second.get();
+		}
+	}
+}
+
+size_t
+balancer_t::get_next_endpoint() {
+	assert(!m_endpoints.empty());
+
+	size_t index = m_strategy->select(m_endpoints, m_loads);
+	endpoint_load_t& load = m_loads[index];
+	++load.in_flight;
+
+	// single probe is sent to route, which was ejected before
+	if (load.probing) {
+		m_latency.probe_sent(m_endpoints[index].route, m_loads_timestamp);
+		load.probing = false;
+		load.ejected = true;
 	}
 
-	return m_endpoints[m_current_endpoint_index];
+	return index;
 }
 
 bool
 balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t& endpoint) {
-	assert(m_socket);
+	try {
+		update_loads();
+
+		size_t index = get_next_endpoint();
+		endpoint = m_endpoints[index];
+
+		return send_frames(message, index);
+	}
+	catch (const std::exception& ex) {
+		std::string error_msg = "balancer with identity " + m_socket_identity;
+		error_msg += " could not send message, details: ";
+		error_msg += ex.what();
+		throw internal_error(error_msg);
+	}
+
+	return true;
+}
+
+size_t
+balancer_t::send_batch(const std::vector<boost::shared_ptr<message_iface> >& messages,
+					   std::vector<std::string>& routes)
+{
+	routes.resize(messages.size());
+	size_t sent = 0;
 
 	try {
-		// send ident
-		endpoint = get_next_endpoint();
-		zmq::message_t ident_chunk(endpoint.route.size());
-		memcpy((void *)ident_chunk.data(), endpoint.route.data(), endpoint.route.size());
+		update_loads();
 
-		if (true != m_socket->send(ident_chunk, ZMQ_SNDMORE)) {
-			return false;
-		}
+		for (; sent < messages.size(); ++sent) {
+			size_t index = get_next_endpoint();
 
-		// send header
-		zmq::message_t empty_message(0);
-		if (true != m_socket->send(empty_message, ZMQ_SNDMORE)) {
-			return false;
+			if (!send_frames(messages[sent], index)) {
+				break;
+			}
+
+			routes[sent] = m_endpoints[index].route;
 		}
+	}
+	catch (const std::exception& ex) {
+		std::string error_msg = "balancer with identity " + m_socket_identity;
+		error_msg += " could not send message batch, details: ";
+		error_msg += ex.what();
+		throw internal_error(error_msg);
+	}
 
-		// send message uuid
-		const std::string& uuid = message->uuid();
-		msgpack::sbuffer sbuf;
-		msgpack::pack(sbuf, uuid);
-		zmq::message_t uuid_chunk(sbuf.size());
-		memcpy((void *)uuid_chunk.data(), sbuf.data(), sbuf.size());
+	return sent;
+}
 
-		if (true != m_socket->send(uuid_chunk, ZMQ_SNDMORE)) {
-			return false;
-		}
+bool
+balancer_t::send_hedge(const boost::shared_ptr<message_iface>& message,
+					   const std::string& excluded_route,
+					   cocaine_endpoint_t& endpoint)
+{
+	try {
+		update_loads();
 
-		// send message policy
-		policy_t server_policy = message->policy().server_policy();
+		// strategies never pick ejected endpoints while there are others
+		size_t excluded = m_endpoints.size();
 
-		if (server_policy.deadline > 0.0) {
-			// awful semantics! convert deadline [timeout value] to actual [deadline time]
-			time_value server_deadline = message->enqued_timestamp();
-			server_deadline += server_policy.deadline;
-			server_policy.deadline = server_deadline.as_double();
+		for (size_t i = 0; i < m_endpoints.size(); ++i) {
+			if (m_endpoints[i].route == excluded_route) {
+				excluded = i;
+				break;
+			}
 		}
 
-		sbuf.clear();
-        msgpack::pack(sbuf, server_policy);
-		zmq::message_t policy_chunk(sbuf.size());
-		memcpy((void *)policy_chunk.data(), sbuf.data(), sbuf.size());
+		bool was_ejected = false;
 
-		if (true != m_socket->send(policy_chunk, ZMQ_SNDMORE)) {
-			return false;
+		if (excluded < m_endpoints.size()) {
+			was_ejected = m_loads[excluded].ejected;
+			m_loads[excluded].ejected = true;
 		}
 
-		// send data
-		size_t data_size = message->size();
-		zmq::message_t data_chunk(data_size);
+		bool has_endpoint = !balancing_strategy_t::all_ejected(m_loads);
+		size_t index = 0;
 
-		if (data_size > 0) {
-			message->load_data();
-			memcpy((void *)data_chunk.data(), message->data(), data_size);
-			message->unload_data();
+		if (has_endpoint) {
+			index = get_next_endpoint();
+			endpoint = m_endpoints[index];
 		}
 
-		if (true != m_socket->send(data_chunk)) {
-			return false;
+		if (excluded < m_endpoints.size()) {
+			m_loads[excluded].ejected = was_ejected;
 		}
+
+		return has_endpoint && send_frames(message, index);
 	}
 	catch (const std::exception& ex) {
 		std::string error_msg = "balancer with identity " + m_socket_identity;
-		error_msg += " could not send message, details: ";
+		error_msg += " could not send hedged message, details: ";
 		error_msg += ex.what();
 		throw internal_error(error_msg);
 	}
 
-	return true;
+	return false;
 }
 
 bool
-balancer_t::check_for_responses(int poll_timeout) const {
-	assert(m_socket);
+balancer_t::send_frames(const boost::shared_ptr<message_iface>& message, size_t endpoint_index) {
+	zmq::socket_t* socket = m_endpoint_sockets[endpoint_index];
 
-	// poll for responce
-	zmq_pollitem_t poll_items[1];
-	poll_items[0].socket = *m_socket;
-	poll_items[0].fd = 0;
-	poll_items[0].events = ZMQ_POLLIN;
-	poll_items[0].revents = 0;
+	if (!socket) {
+		return false;
+	}
+
+	const cocaine_endpoint_t& endpoint = m_endpoints[endpoint_index];
+
+	// send ident
+	zmq::message_t ident_chunk(endpoint.route.size());
+	memcpy((void *)ident_chunk.data(), endpoint.route.data(), endpoint.route.size());
+
+	if (true != socket->send(ident_chunk, ZMQ_SNDMORE)) {
+		return false;
+	}
+
+	// send header
+	zmq::message_t empty_message(0);
+	if (true != socket->send(empty_message, ZMQ_SNDMORE)) {
+		return false;
+	}
+
+	// send message uuid in text form engine expects, formatted on
+	// stack, packing buffer is reused between messages
+	char uuid_str[wuuid_t::string_length];
+	message->uuid().to_chars(uuid_str);
+
+	m_pack_buffer.clear();
+	msgpack::packer<msgpack::sbuffer> uuid_packer(m_pack_buffer);
+	uuid_packer.pack_raw(sizeof(uuid_str));
+	uuid_packer.pack_raw_body(uuid_str, sizeof(uuid_str));
+	zmq::message_t uuid_chunk(m_pack_buffer.size());
+	memcpy((void *)uuid_chunk.data(), m_pack_buffer.data(), m_pack_buffer.size());
+
+	if (true != socket->send(uuid_chunk, ZMQ_SNDMORE)) {
+		return false;
+	}
+
+	// send message policy
+	policy_t server_policy = message->policy().server_policy();
+
+	if (server_policy.deadline > 0.0) {
+		// awful semantics! convert deadline [timeout value] to actual [deadline time]
+		time_value server_deadline = message->enqued_timestamp();
+		server_deadline += server_policy.deadline;
+		server_policy.deadline = server_deadline.as_double();
+	}
+
+	m_pack_buffer.clear();
+	msgpack::pack(m_pack_buffer, server_policy);
+	zmq::message_t policy_chunk(m_pack_buffer.size());
+	memcpy((void *)policy_chunk.data(), m_pack_buffer.data(), m_pack_buffer.size());
+
+	if (true != socket->send(policy_chunk, ZMQ_SNDMORE)) {
+		return false;
+	}
 
-	int socket_response = zmq_poll(poll_items, 1, poll_timeout);
+	// send data, zmq holds a reference to message data until it's on the wire
+	size_t data_size = message->size();
+	data_container shared_data;
+
+	if (data_size > 0 && message->share_data(shared_data)) {
+		zmq::message_t data_chunk(shared_data.data(),
+								  shared_data.size(),
+								  &data_container::release_buffer,
+								  shared_data.retain_buffer());
+
+		return socket->send(data_chunk);
+	}
+
+	zmq::message_t data_chunk(data_size);
+
+	if (data_size > 0) {
+		message->load_data();
+		memcpy((void *)data_chunk.data(), message->data(), data_size);
+		message->unload_data();
+	}
+
+	return socket->send(data_chunk);
+}
+
+bool
+balancer_t::check_for_responses(int poll_timeout) {
+	m_poll_items.clear();
+
+	if (poll_items(m_poll_items) == 0) {
+		return false;
+	}
+
+	// poll for responce
+	int socket_response = zmq_poll(&m_poll_items[0], m_poll_items.size(), poll_timeout);
 
 	if (socket_response <= 0) {
 		return false;
 	}
 
 	// in case we received response
-	if ((ZMQ_POLLIN & poll_items[0].revents) == ZMQ_POLLIN) {
-		return true;
+	for (size_t i = 0; i < m_poll_items.size(); ++i) {
+		if ((ZMQ_POLLIN & m_poll_items[i].revents) == ZMQ_POLLIN) {
+			return true;
+		}
 	}
 
     return false;
 }
 
+size_t
+balancer_t::poll_items(std::vector<zmq_pollitem_t>& items) const {
+	zmq_pollitem_t poll_item;
+	poll_item.fd = 0;
+	poll_item.events = ZMQ_POLLIN;
+	poll_item.revents = 0;
+
+	sockets_map_t::const_iterator it = m_sockets.begin();
+	for (; it != m_sockets.end(); ++it) {
+		poll_item.socket = *(it->second);
+		items.push_back(poll_item);
+	}
+
+	return m_sockets.size();
+}
+
 bool
 balancer_t::is_valid_rpc_code(int rpc_code) {
 	switch (rpc_code) {
@@ -284,24 +503,53 @@ balancer_t::is_valid_rpc_code(int rpc_code) {
 
 bool
 balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
+	size_t count = m_sockets.size();
+
+	if (count == 0) {
+		return false;
+	}
+
+	// sockets take turns, busy endpoint doesn't starve the rest
+	m_receive_index %= count;
+
+	sockets_map_t::iterator it = m_sockets.begin();
+	std::advance(it, m_receive_index);
+
+	for (size_t i = 0; i < count; ++i) {
+		zmq::socket_t& socket = *(it->second);
+
+		m_receive_index = (m_receive_index + 1) % count;
+		if (++it == m_sockets.end()) {
+			it = m_sockets.begin();
+		}
+
+		if (receive_frames(socket, response)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool
+balancer_t::receive_frames(zmq::socket_t& socket, boost::shared_ptr<response_chunk_t>& response) {
 	zmq::message_t		chunk;
 	msgpack::object		obj;
 
 	std::string			route;
-	std::string			uuid;
-	std::string			data;
+	wuuid_t				uuid;
 	int					rpc_code;
 
 	int 				error_code = -1;
 	std::string 		error_message;
 
 	// receive route
-	if (!nutils::recv_zmq_message(*m_socket, chunk, route)) {
+	if (!nutils::recv_zmq_message(socket, chunk, route)) {
 		return false;
 	}
 
 	// receive rpc code
-	if (!nutils::recv_zmq_message(*m_socket, chunk, obj)) {
+	if (!nutils::recv_zmq_message(socket, chunk, obj)) {
 		return false;
 	}
 	obj.convert(&rpc_code);
@@ -311,10 +559,14 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	}
 
 	// receive uuid
-	if (!nutils::recv_zmq_message(*m_socket, chunk, obj)) {
+	if (!nutils::recv_zmq_message(socket, chunk, obj)) {
+		return false;
+	}
+
+	// parsed straight from packed text, no string in between
+	if (obj.type != msgpack::type::RAW || !uuid.from_chars(obj.via.raw.ptr, obj.via.raw.size)) {
 		return false;
 	}
-	obj.convert(&uuid);
 
 	// init response
 	response.reset(new response_chunk_t);
@@ -325,25 +577,23 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	// receive all data
 	switch (rpc_code) {
 		case SERVER_RPC_MESSAGE_CHUNK: {
-			// receive response data
-			if (!nutils::recv_zmq_message(*m_socket, chunk, data)) {
+			// receive response data straight into response
+			if (!nutils::recv_zmq_message(socket, chunk, response->data)) {
 				return false;
 			}
-
-			response->data = data_container(data.data(), data.size());
 		}
 		break;
 
 		case SERVER_RPC_MESSAGE_ERROR: {
 			// receive error code
-			if (!nutils::recv_zmq_message(*m_socket, chunk, obj)) {
+			if (!nutils::recv_zmq_message(socket, chunk, obj)) {
 				return false;
 			}
 		    obj.convert(&error_code);
 		    response->error_code = error_code;
 
 			// receive error message
-			if (!nutils::recv_zmq_message(*m_socket, chunk, obj)) {
+			if (!nutils::recv_zmq_message(socket, chunk, obj)) {
 				return false;
 			}
 		    obj.convert(&error_message);
@@ -358,16 +608,16 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	// 2DO довычитать оставшиеся чанки
 	int64_t		more = 1;
 	size_t		more_size = sizeof(more);
-	int			rc = zmq_getsockopt(*m_socket, ZMQ_RCVMORE, &more, &more_size);
+	int			rc = zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &more_size);
     assert(rc == 0);
 
 	while (more) {
 		zmq::message_t chunk;
-		if (!m_socket->recv(&chunk, ZMQ_NOBLOCK)) {
+		if (!socket.recv(&chunk, ZMQ_NOBLOCK)) {
 			break;
 		}
 
-		int rc = zmq_getsockopt(*m_socket, ZMQ_RCVMORE, &more, &more_size);
+		int rc = zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &more_size);
     	assert(rc == 0);		
 	}
 
@@ -379,7 +629,7 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 			if (log_flag_enabled(PLOG_DEBUG)) {
 				std::string times = time_value::get_current_time().as_string();
 				message += "ACK (%s)";
-				log(PLOG_DEBUG, message, route.c_str(), uuid.c_str(), times.c_str());
+				log(PLOG_DEBUG, message, route.c_str(), uuid.as_string().c_str(), times.c_str());
 			}
 		}
 		break;
@@ -388,7 +638,7 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 			if (log_flag_enabled(PLOG_DEBUG)) {
 				std::string times = time_value::get_current_time().as_string();
 				message += "CHUNK (%s)";
-				log(PLOG_DEBUG, message, route.c_str(), uuid.c_str(), times.c_str());
+				log(PLOG_DEBUG, message, route.c_str(), uuid.as_string().c_str(), times.c_str());
 			}
 		}
 		break;
@@ -397,7 +647,7 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 			if (log_flag_enabled(PLOG_DEBUG)) {
 				std::string times = time_value::get_current_time().as_string();
 				message += "CHOKE (%s)";
-				log(PLOG_DEBUG, message, route.c_str(), uuid.c_str(), times.c_str());
+				log(PLOG_DEBUG, message, route.c_str(), uuid.as_string().c_str(), times.c_str());
 			}
 		}
 		break;
@@ -406,7 +656,7 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 			if (log_flag_enabled(PLOG_ERROR)) {
 				std::string times = time_value::get_current_time().as_string();
 				message += "ERROR (%s), error message: %s, error code: %d";
-				log(PLOG_ERROR, message, route.c_str(), uuid.c_str(), times.c_str(), error_message.c_str(), error_code);
+				log(PLOG_ERROR, message, route.c_str(), uuid.as_string().c_str(), times.c_str(), error_message.c_str(), error_code);
 			}
 		}
 		break;
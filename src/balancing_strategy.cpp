@@ -0,0 +1,268 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <ctime>
+#include <unistd.h>
+
+#include "cocaine/dealer/core/balancing_strategy.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+class round_robin_strategy_t : public balancing_strategy_t {
+public:
+	round_robin_strategy_t() : m_index(0) {}
+
+	size_t select(const std::vector<cocaine_endpoint_t>& endpoints,
+				  const endpoint_loads_t& loads)
+	{
+		size_t count = endpoints.size();
+		bool skip_ejected = !all_ejected(loads);
+
+		for (size_t i = 0; i < count; ++i) {
+			if (++m_index >= count) {
+				m_index = 0;
+			}
+
+			if (!skip_ejected || !loads[m_index].ejected) {
+				break;
+			}
+		}
+
+		return m_index;
+	}
+
+	bool uses_in_flight() const {
+		return false;
+	}
+
+private:
+	size_t m_index;
+};
+
+// scans all endpoints for the lowest score, ties are broken round robin
+// so equally loaded endpoints share messages evenly
+class least_score_strategy_t : public balancing_strategy_t {
+public:
+	least_score_strategy_t() : m_start(0) {}
+
+	size_t select(const std::vector<cocaine_endpoint_t>& endpoints,
+				  const endpoint_loads_t& loads)
+	{
+		size_t count = endpoints.size();
+		bool skip_ejected = !all_ejected(loads);
+
+		size_t best = count;
+		double best_score = 0.0;
+
+		for (size_t i = 0; i < count; ++i) {
+			size_t index = (m_start + i) % count;
+
+			if (skip_ejected && loads[index].ejected) {
+				continue;
+			}
+
+			double index_score = score(endpoints[index], loads[index]);
+
+			if (best == count || index_score < best_score) {
+				best = index;
+				best_score = index_score;
+			}
+		}
+
+		m_start = best + 1;
+		return best;
+	}
+
+	bool uses_in_flight() const {
+		return true;
+	}
+
+protected:
+	virtual double score(const cocaine_endpoint_t& endpoint, const endpoint_load_t& load) const = 0;
+
+private:
+	size_t m_start;
+};
+
+class least_outstanding_strategy_t : public least_score_strategy_t {
+protected:
+	double score(const cocaine_endpoint_t& endpoint, const endpoint_load_t& load) const {
+		(void)endpoint;
+		return static_cast<double>(load.in_flight);
+	}
+};
+
+class backlog_weighted_strategy_t : public least_score_strategy_t {
+protected:
+	double score(const cocaine_endpoint_t& endpoint, const endpoint_load_t& load) const {
+		return load_score(endpoint, load.in_flight);
+	}
+};
+
+class peak_ewma_strategy_t : public least_score_strategy_t {
+protected:
+	double score(const cocaine_endpoint_t& endpoint, const endpoint_load_t& load) const {
+		(void)endpoint;
+		return latency_score(load);
+	}
+};
+
+// compares load of two random endpoints only, stays cheap on large
+// clusters and doesn't herd all senders onto a single least loaded node
+class power_of_two_strategy_t : public balancing_strategy_t {
+public:
+	power_of_two_strategy_t() :
+		m_seed(static_cast<unsigned int>(time(NULL)) ^ static_cast<unsigned int>(getpid())) {}
+
+	size_t select(const std::vector<cocaine_endpoint_t>& endpoints,
+				  const endpoint_loads_t& loads)
+	{
+		// candidates are picked among endpoints that are not ejected
+		m_candidates.clear();
+
+		if (!all_ejected(loads)) {
+			for (size_t i = 0; i < loads.size(); ++i) {
+				if (!loads[i].ejected) {
+					m_candidates.push_back(i);
+				}
+			}
+		}
+
+		size_t count = m_candidates.empty() ? endpoints.size() : m_candidates.size();
+
+		if (count == 1) {
+			return m_candidates.empty() ? 0 : m_candidates[0];
+		}
+
+		size_t first = next_random() % count;
+		size_t second = next_random() % (count - 1);
+
+		if (second >= first) {
+			++second;
+		}
+
+		if (!m_candidates.empty()) {
+			first = m_candidates[first];
+			second = m_candidates[second];
+		}
+
+		double first_score = load_score(endpoints[first], loads[first].in_flight);
+		double second_score = load_score(endpoints[second], loads[second].in_flight);
+
+		return (second_score < first_score) ? second : first;
+	}
+
+	bool uses_in_flight() const {
+		return true;
+	}
+
+private:
+	// xorshift, good enough to pick candidates
+	unsigned int next_random() {
+		if (m_seed == 0) {
+			m_seed = 2463534242U;
+		}
+
+		m_seed ^= m_seed << 13;
+		m_seed ^= m_seed >> 17;
+		m_seed ^= m_seed << 5;
+
+		return m_seed;
+	}
+
+private:
+	unsigned int m_seed;
+	std::vector<size_t> m_candidates;
+};
+
+double
+balancing_strategy_t::load_score(const cocaine_endpoint_t& endpoint, size_t in_flight) {
+	double capacity = (endpoint.slaves_total > 0) ? endpoint.slaves_total : 1;
+	double load = static_cast<double>(in_flight) + endpoint.backlog + endpoint.queue_depth;
+
+	return (load + 1.0) / capacity;
+}
+
+double
+balancing_strategy_t::latency_score(const endpoint_load_t& load) {
+	// unmeasured routes look cheap, so they are measured soon
+	const double min_latency = 0.0001;
+	double latency = (load.latency > min_latency) ? load.latency : min_latency;
+
+	return latency * (load.in_flight + 1);
+}
+
+bool
+balancing_strategy_t::all_ejected(const endpoint_loads_t& loads) {
+	for (size_t i = 0; i < loads.size(); ++i) {
+		if (!loads[i].ejected) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+balancing_strategy_t*
+balancing_strategy_t::create(enum e_balancing_type type) {
+	switch (type) {
+		case BT_LEAST_OUTSTANDING:
+			return new least_outstanding_strategy_t;
+
+		case BT_BACKLOG_WEIGHTED:
+			return new backlog_weighted_strategy_t;
+
+		case BT_POWER_OF_TWO:
+			return new power_of_two_strategy_t;
+
+		case BT_PEAK_EWMA:
+			return new peak_ewma_strategy_t;
+
+		case BT_ROUND_ROBIN:
+		default:
+			return new round_robin_strategy_t;
+	}
+}
+
+std::string
+balancing_strategy_t::type_name(enum e_balancing_type type) {
+	switch (type) {
+		case BT_ROUND_ROBIN:
+			return "round robin";
+
+		case BT_LEAST_OUTSTANDING:
+			return "least outstanding";
+
+		case BT_BACKLOG_WEIGHTED:
+			return "backlog weighted";
+
+		case BT_POWER_OF_TWO:
+			return "power of two";
+
+		case BT_PEAK_EWMA:
+			return "peak ewma";
+	}
+
+	return "unknown";
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,340 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <set>
+#include <vector>
+#include <sstream>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "cocaine/dealer/utils/buffer_pool.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+struct buffer_pool_t::header_t {
+	volatile int refs;
+	int size_class;
+
+	// keep buffers 16 bytes aligned
+	char padding[8];
+};
+
+struct buffer_pool_t::thread_cache_t {
+	thread_cache_t();
+	~thread_cache_t();
+
+	std::vector<header_t*> free_lists[size_classes_count];
+
+	// written by owner thread, read by stats() from any thread,
+	// so counters are only touched atomically
+	stats_t stats;
+};
+
+struct buffer_pool_t::shared_lists_t {
+	shared_lists_t();
+
+	boost::mutex mutex;
+	std::vector<header_t*> free_lists[size_classes_count];
+
+	// fewest buffers each list had since last trim, those were idle all along
+	size_t idle_counts[size_classes_count];
+
+	// live thread caches and stats of finished threads
+	std::set<thread_cache_t*> caches;
+	stats_t retired_stats;
+};
+
+static const int large_size_class = -1;
+
+static inline void
+increment(uint64_t& counter) {
+	__sync_add_and_fetch(&counter, 1);
+}
+
+static inline uint64_t
+load(uint64_t& counter) {
+	return __sync_add_and_fetch(&counter, 0);
+}
+
+buffer_pool_t::stats_t::stats_t() :
+	allocations(0),
+	deallocations(0),
+	thread_cache_hits(0),
+	shared_refills(0),
+	system_allocations(0),
+	large_allocations(0),
+	trimmed(0)
+{
+}
+
+buffer_pool_t::stats_t&
+buffer_pool_t::stats_t::operator += (const stats_t& rhs) {
+	allocations += rhs.allocations;
+	deallocations += rhs.deallocations;
+	thread_cache_hits += rhs.thread_cache_hits;
+	shared_refills += rhs.shared_refills;
+	system_allocations += rhs.system_allocations;
+	large_allocations += rhs.large_allocations;
+	trimmed += rhs.trimmed;
+
+	return *this;
+}
+
+std::string
+buffer_pool_t::stats_t::as_string() const {
+	std::stringstream out;
+
+	out << "allocations: " << allocations << ", deallocations: " << deallocations;
+	out << ", thread cache hits: " << thread_cache_hits << ", shared refills: " << shared_refills;
+	out << ", system allocations: " << system_allocations << ", large allocations: " << large_allocations;
+	out << ", trimmed: " << trimmed;
+
+	return out.str();
+}
+
+buffer_pool_t::shared_lists_t::shared_lists_t() {
+	std::fill(idle_counts, idle_counts + size_classes_count, 0);
+}
+
+buffer_pool_t::thread_cache_t::thread_cache_t() {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+	lists.caches.insert(this);
+}
+
+buffer_pool_t::thread_cache_t::~thread_cache_t() {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+
+	for (size_t i = 0; i < size_classes_count; ++i) {
+		lists.free_lists[i].insert(lists.free_lists[i].end(), free_lists[i].begin(), free_lists[i].end());
+	}
+
+	lists.retired_stats += stats;
+	lists.caches.erase(this);
+}
+
+buffer_pool_t::header_t*
+buffer_pool_t::header(void* buffer) {
+	return reinterpret_cast<header_t*>(static_cast<char*>(buffer) - sizeof(header_t));
+}
+
+int
+buffer_pool_t::size_class(size_t size) {
+	if (size > max_pooled_size) {
+		return large_size_class;
+	}
+
+	int index = 0;
+	size_t class_size = min_pooled_size;
+
+	while (class_size < size) {
+		class_size <<= 1;
+		++index;
+	}
+
+	return index;
+}
+
+buffer_pool_t::thread_cache_t&
+buffer_pool_t::thread_cache() {
+	// never destroyed, threads may release buffers during static destruction
+	static boost::thread_specific_ptr<thread_cache_t>* cache = new boost::thread_specific_ptr<thread_cache_t>;
+
+	if (!cache->get()) {
+		cache->reset(new thread_cache_t);
+	}
+
+	return *cache->get();
+}
+
+buffer_pool_t::shared_lists_t&
+buffer_pool_t::shared_lists() {
+	static shared_lists_t* lists = new shared_lists_t;
+	return *lists;
+}
+
+void
+buffer_pool_t::refill(thread_cache_t& cache, int size_class) {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+
+	std::vector<header_t*>& shared_list = lists.free_lists[size_class];
+
+	if (shared_list.empty()) {
+		return;
+	}
+
+	size_t count = std::min(shared_list.size(), static_cast<size_t>(refill_batch_size));
+	std::vector<header_t*>& list = cache.free_lists[size_class];
+
+	list.insert(list.end(), shared_list.end() - count, shared_list.end());
+	shared_list.resize(shared_list.size() - count);
+
+	size_t& idle_count = lists.idle_counts[size_class];
+	idle_count = std::min(idle_count, shared_list.size());
+
+	increment(cache.stats.shared_refills);
+}
+
+void
+buffer_pool_t::flush(thread_cache_t& cache, int size_class, size_t count) {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+
+	std::vector<header_t*>& list = cache.free_lists[size_class];
+	std::vector<header_t*>& shared_list = lists.free_lists[size_class];
+
+	shared_list.insert(shared_list.end(), list.end() - count, list.end());
+	list.resize(list.size() - count);
+}
+
+void*
+buffer_pool_t::allocate(size_t size) {
+	thread_cache_t& cache = thread_cache();
+	increment(cache.stats.allocations);
+
+	int index = size_class(size);
+	header_t* buffer_header = NULL;
+
+	if (index == large_size_class) {
+		increment(cache.stats.large_allocations);
+		increment(cache.stats.system_allocations);
+
+		buffer_header = static_cast<header_t*>(malloc(sizeof(header_t) + size));
+	}
+	else {
+		std::vector<header_t*>& list = cache.free_lists[index];
+
+		if (!list.empty()) {
+			increment(cache.stats.thread_cache_hits);
+		}
+		else {
+			refill(cache, index);
+		}
+
+		if (!list.empty()) {
+			buffer_header = list.back();
+			list.pop_back();
+		}
+		else {
+			increment(cache.stats.system_allocations);
+			buffer_header = static_cast<header_t*>(malloc(sizeof(header_t) + (min_pooled_size << index)));
+		}
+	}
+
+	if (!buffer_header) {
+		throw std::bad_alloc();
+	}
+
+	buffer_header->refs = 1;
+	buffer_header->size_class = index;
+
+	return buffer_header + 1;
+}
+
+void
+buffer_pool_t::deallocate(void* buffer) {
+	header_t* buffer_header = header(buffer);
+
+	thread_cache_t& cache = thread_cache();
+	increment(cache.stats.deallocations);
+
+	if (buffer_header->size_class == large_size_class) {
+		free(buffer_header);
+		return;
+	}
+
+	std::vector<header_t*>& list = cache.free_lists[buffer_header->size_class];
+	list.push_back(buffer_header);
+
+	// give half of the buffers away so other threads can reuse them
+	if (list.size() > thread_cache_size) {
+		flush(cache, buffer_header->size_class, list.size() / 2);
+	}
+}
+
+void
+buffer_pool_t::add_ref(void* buffer) {
+	__sync_add_and_fetch(&header(buffer)->refs, 1);
+}
+
+bool
+buffer_pool_t::release(void* buffer) {
+	return __sync_sub_and_fetch(&header(buffer)->refs, 1) == 0;
+}
+
+buffer_pool_t::stats_t
+buffer_pool_t::stats() {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+
+	// live threads keep counting meanwhile, numbers are approximate
+	stats_t result = lists.retired_stats;
+
+	std::set<thread_cache_t*>::const_iterator it = lists.caches.begin();
+	for (; it != lists.caches.end(); ++it) {
+		stats_t& stats = (*it)->stats;
+
+		result.allocations += load(stats.allocations);
+		result.deallocations += load(stats.deallocations);
+		result.thread_cache_hits += load(stats.thread_cache_hits);
+		result.shared_refills += load(stats.shared_refills);
+		result.system_allocations += load(stats.system_allocations);
+		result.large_allocations += load(stats.large_allocations);
+	}
+
+	return result;
+}
+
+void
+buffer_pool_t::trim() {
+	shared_lists_t& lists = shared_lists();
+	boost::mutex::scoped_lock lock(lists.mutex);
+
+	for (size_t i = 0; i < size_classes_count; ++i) {
+		std::vector<header_t*>& shared_list = lists.free_lists[i];
+
+		// refills take buffers from the back, idle ones are in front
+		size_t idle_count = std::min(lists.idle_counts[i], shared_list.size());
+
+		for (size_t j = 0; j < idle_count; ++j) {
+			free(shared_list[j]);
+		}
+
+		shared_list.erase(shared_list.begin(), shared_list.begin() + idle_count);
+		lists.retired_stats.trimmed += idle_count;
+
+		// let go of list storage once most of it is unused
+		if (shared_list.capacity() > 4 * std::max(shared_list.size(), static_cast<size_t>(thread_cache_size))) {
+			std::vector<header_t*>(shared_list).swap(shared_list);
+		}
+
+		lists.idle_counts[i] = shared_list.size();
+	}
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,119 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <algorithm>
+#include <exception>
+
+#include <boost/bind.hpp>
+
+#include "cocaine/dealer/core/completion_executor.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+completion_executor_t::completion_executor_t(size_t threads_count,
+											 const boost::shared_ptr<base_logger_t>& logger) :
+	m_logger(logger)
+{
+	threads_count = std::max<size_t>(threads_count, 1);
+
+	for (size_t i = 0; i < threads_count; ++i) {
+		shard_ptr_t shard(new shard_t);
+		m_shards.push_back(shard);
+		m_threads.create_thread(boost::bind(&completion_executor_t::run, this, boost::ref(*shard)));
+	}
+}
+
+completion_executor_t::~completion_executor_t() {
+	for (size_t i = 0; i < m_shards.size(); ++i) {
+		shard_t& shard = *m_shards[i];
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+		shard.is_running = false;
+		shard.cond_var.notify_one();
+	}
+
+	m_threads.join_all();
+}
+
+size_t
+completion_executor_t::threads_count() const {
+	return m_shards.size();
+}
+
+void
+completion_executor_t::post(size_t key, const task_t& task) {
+	shard_t& shard = *m_shards[key % m_shards.size()];
+
+	boost::mutex::scoped_lock lock(shard.mutex);
+	shard.tasks.push_back(task);
+
+	// wake thread only if it sleeps, busy one picks task up anyway
+	if (shard.is_waiting) {
+		shard.is_waiting = false;
+		lock.unlock();
+		shard.cond_var.notify_one();
+	}
+}
+
+void
+completion_executor_t::run(shard_t& shard) {
+	std::deque<task_t> tasks;
+
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(shard.mutex);
+
+			while (shard.tasks.empty() && shard.is_running) {
+				shard.is_waiting = true;
+				shard.cond_var.wait(lock);
+			}
+
+			if (shard.tasks.empty()) {
+				return;
+			}
+
+			// take all pending tasks at once, run them without lock
+			tasks.swap(shard.tasks);
+		}
+
+		for (size_t i = 0; i < tasks.size(); ++i) {
+			try {
+				tasks[i]();
+			}
+			// client callback must not kill completion thread
+			catch (const std::exception& ex) {
+				if (m_logger) {
+					m_logger->log(PLOG_ERROR, "async response callback failed, details: %s", ex.what());
+				}
+			}
+			catch (...) {
+				if (m_logger) {
+					m_logger->log(PLOG_ERROR, "async response callback failed with unknown error");
+				}
+			}
+		}
+
+		tasks.clear();
+	}
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -36,6 +36,8 @@ namespace dealer {
 configuration_t::configuration_t() :
 	m_default_message_deadline(defaults_t::default_message_deadline),
 	m_message_cache_type(defaults_t::message_cache_type),
+	m_io_threads(defaults_t::io_threads),
+	m_completion_threads(defaults_t::completion_threads),
 	m_logger_type(defaults_t::logger_type),
 	m_logger_flags(defaults_t::logger_flags),
 	m_eblob_path(defaults_t::eblob_path),
@@ -43,6 +45,12 @@ configuration_t::configuration_t() :
 	m_eblob_sync_interval(defaults_t::eblob_sync_interval),
 	m_eblob_thread_pool_size(defaults_t::eblob_thread_pool_size),
 	m_eblob_defrag_timeout(defaults_t::eblob_defrag_timeout),
+	m_journal_enabled(false),
+	m_journal_batch_size(defaults_t::journal_batch_size),
+	m_journal_batch_timeout(defaults_t::journal_batch_timeout),
+	m_journal_wait_durable(false),
+	m_spill_enabled(false),
+	m_spill_min_size(defaults_t::spill_min_size),
 	m_statistics_enabled(false),
 	m_remote_statistics_enabled(false),
 	m_remote_statistics_port(defaults_t::statistics_port)
@@ -54,6 +62,8 @@ configuration_t::configuration_t(const std::string& path) :
 	m_path(path),
 	m_default_message_deadline(defaults_t::default_message_deadline),
 	m_message_cache_type(defaults_t::message_cache_type),
+	m_io_threads(defaults_t::io_threads),
+	m_completion_threads(defaults_t::completion_threads),
 	m_logger_type(defaults_t::logger_type),
 	m_logger_flags(defaults_t::logger_flags),
 	m_eblob_path(defaults_t::eblob_path),
@@ -61,6 +71,12 @@ configuration_t::configuration_t(const std::string& path) :
 	m_eblob_sync_interval(defaults_t::eblob_sync_interval),
 	m_eblob_thread_pool_size(defaults_t::eblob_thread_pool_size),
 	m_eblob_defrag_timeout(defaults_t::eblob_defrag_timeout),
+	m_journal_enabled(false),
+	m_journal_batch_size(defaults_t::journal_batch_size),
+	m_journal_batch_timeout(defaults_t::journal_batch_timeout),
+	m_journal_wait_durable(false),
+	m_spill_enabled(false),
+	m_spill_min_size(defaults_t::spill_min_size),
 	m_statistics_enabled(false),
 	m_remote_statistics_enabled(false),
 	m_remote_statistics_port(defaults_t::statistics_port)
@@ -176,6 +192,30 @@ configuration_t::parse_persistant_storage_settings(const Json::Value& config_val
 	m_eblob_sync_interval = persistent_storage_value.get("eblob_sync_interval", defaults_t::eblob_sync_interval).asInt();
 	m_eblob_thread_pool_size = persistent_storage_value.get("thread_pool_size", defaults_t::eblob_thread_pool_size).asInt();
 	m_eblob_defrag_timeout = persistent_storage_value.get("defrag_timeout", defaults_t::eblob_defrag_timeout).asInt();
+
+	// messages are written by journal thread instead of sender
+	const Json::Value journal_value = persistent_storage_value["write_behind"];
+
+	m_journal_enabled = journal_value.get("enabled", false).asBool();
+	m_journal_batch_size = journal_value.get("batch_size", defaults_t::journal_batch_size).asInt();
+	m_journal_batch_timeout = journal_value.get("batch_timeout", defaults_t::journal_batch_timeout).asInt();
+	m_journal_wait_durable = journal_value.get("wait_durable", false).asBool();
+
+	if (m_journal_batch_size <= 0 || m_journal_batch_timeout < 0) {
+		throw internal_error("\"write_behind\" batch_size must be positive and batch_timeout non-negative");
+	}
+
+	// persistent messages and big ones hold only metadata in memory
+	const Json::Value spill_value = persistent_storage_value["spill_to_disk"];
+
+	m_spill_enabled = spill_value.get("enabled", false).asBool();
+	int spill_min_size = spill_value.get("min_size", defaults_t::spill_min_size).asInt();
+
+	if (spill_min_size < 0) {
+		throw internal_error("\"spill_to_disk\" min_size must be non-negative");
+	}
+
+	m_spill_min_size = static_cast<size_t>(spill_min_size);
 }
 
 void
@@ -268,6 +308,63 @@ configuration_t::parse_services_settings(const Json::Value& config_value) {
 			throw internal_error(error_str);
 		}
 
+		si.batching_size = service_data.get("batching_size", defaults_t::batching_size).asInt();
+
+		if (si.batching_size <= 0) {
+			std::string error_str = "malformed \"service\" " + si.name + " section found, field";
+			error_str += "\"batching_size\" must be positive";
+			throw internal_error(error_str);
+		}
+
+		std::string balancing_str = service_data.get("balancing", "ROUND_ROBIN").asString();
+
+		if (balancing_str == "ROUND_ROBIN") {
+			si.balancing_type = BT_ROUND_ROBIN;
+		}
+		else if (balancing_str == "LEAST_OUTSTANDING") {
+			si.balancing_type = BT_LEAST_OUTSTANDING;
+		}
+		else if (balancing_str == "BACKLOG_WEIGHTED") {
+			si.balancing_type = BT_BACKLOG_WEIGHTED;
+		}
+		else if (balancing_str == "POWER_OF_TWO") {
+			si.balancing_type = BT_POWER_OF_TWO;
+		}
+		else if (balancing_str == "PEAK_EWMA") {
+			si.balancing_type = BT_PEAK_EWMA;
+		}
+		else {
+			std::string error_str = "service " + service_name + " has malformed field \"balancing\", which can only ";
+			error_str += "take values ROUND_ROBIN, LEAST_OUTSTANDING, BACKLOG_WEIGHTED, POWER_OF_TWO, PEAK_EWMA.";
+			throw internal_error(error_str);
+		}
+
+		// queued messages watermarks
+		const Json::Value queue_limits = service_data["queue_limits"];
+		if (queue_limits.isObject()) {
+			parse_queue_limits(queue_limits["service"], service_name, si.service_queue_limits);
+			parse_queue_limits(queue_limits["handle"], service_name, si.handle_queue_limits);
+
+			std::string overflow_str = queue_limits.get("overflow", "FAIL").asString();
+
+			if (overflow_str == "FAIL") {
+				si.overflow_policy = OP_FAIL;
+			}
+			else if (overflow_str == "BLOCK") {
+				si.overflow_policy = OP_BLOCK;
+			}
+			else if (overflow_str == "DROP_OLDEST") {
+				si.overflow_policy = OP_DROP_OLDEST;
+			}
+			else {
+				std::string error_str = "service " + service_name + " has malformed field \"overflow\", which can only ";
+				error_str += "take values FAIL, BLOCK, DROP_OLDEST.";
+				throw internal_error(error_str);
+			}
+
+			si.block_timeout = queue_limits.get("block_timeout", si.block_timeout).asDouble();
+		}
+
 		// default message policy
 		const Json::Value mpolicy = service_data["policy"];
 		if (mpolicy.isObject()) {
@@ -276,6 +373,7 @@ configuration_t::parse_services_settings(const Json::Value& config_value) {
 			si.policy.timeout = mpolicy.get("timeout", si.policy.timeout).asFloat();
 			si.policy.deadline = mpolicy.get("deadline", si.policy.deadline).asFloat();
 			si.policy.max_retries = mpolicy.get("max_retries", si.policy.max_retries).asInt();
+			si.policy.hedge_after = mpolicy.get("hedge_after", si.policy.hedge_after).asFloat();
 		}
 
 		// check for duplicate services
@@ -290,6 +388,32 @@ configuration_t::parse_services_settings(const Json::Value& config_value) {
 	}
 }
 
+void
+configuration_t::parse_queue_limits(const Json::Value& limits_value,
+									const std::string& service_name,
+									queue_limits_t& limits)
+{
+	if (!limits_value.isObject()) {
+		return;
+	}
+
+	limits.high_messages = static_cast<size_t>(limits_value.get("high_messages", 0).asUInt64());
+	limits.high_bytes = static_cast<size_t>(limits_value.get("high_bytes", 0).asUInt64());
+
+	// admission opens again at 3/4 of high watermark unless told otherwise
+	limits.low_messages = limits.high_messages / 4 * 3;
+	limits.low_bytes = limits.high_bytes / 4 * 3;
+
+	limits.low_messages = static_cast<size_t>(limits_value.get("low_messages", (Json::UInt64)limits.low_messages).asUInt64());
+	limits.low_bytes = static_cast<size_t>(limits_value.get("low_bytes", (Json::UInt64)limits.low_bytes).asUInt64());
+
+	if (limits.low_messages > limits.high_messages || limits.low_bytes > limits.high_bytes) {
+		std::string error_str = "service " + service_name + " has malformed \"queue_limits\" section, ";
+		error_str += "low watermarks can't exceed high ones.";
+		throw internal_error(error_str);
+	}
+}
+
 void
 configuration_t::load(const std::string& path) {
 	boost::mutex::scoped_lock lock(m_mutex);
@@ -354,6 +478,19 @@ configuration_t::parse_basic_settings(const Json::Value& config_value) {
 
 	m_default_message_deadline = static_cast<unsigned long long>(deadline_value.asInt());
 
+	// threads dispatching messages of all handles, 0 - one per cpu core
+	m_io_threads = config_value.get("io_threads", defaults_t::io_threads).asInt();
+
+	if (m_io_threads < 0) {
+		throw internal_error("\"io_threads\" must be a non-negative integer");
+	}
+
+	// threads running async responses callbacks, 0 - one per cpu core
+	m_completion_threads = config_value.get("completion_threads", defaults_t::completion_threads).asInt();
+
+	if (m_completion_threads < 0) {
+		throw internal_error("\"completion_threads\" must be a non-negative integer");
+	}
 
 	bool use_persistense = config_value.get("use_persistense", false).asBool();
 	
@@ -385,6 +522,16 @@ configuration_t::message_cache_type() const {
 	return m_message_cache_type;
 }
 
+int
+configuration_t::io_threads() const {
+	return m_io_threads;
+}
+
+int
+configuration_t::completion_threads() const {
+	return m_completion_threads;
+}
+
 enum e_logger_type
 configuration_t::logger_type() const {
 	return m_logger_type;
@@ -430,6 +577,36 @@ configuration_t::eblob_defrag_timeout() const {
 	return m_eblob_defrag_timeout;
 }
 
+bool
+configuration_t::is_journal_enabled() const {
+	return m_journal_enabled;
+}
+
+int
+configuration_t::journal_batch_size() const {
+	return m_journal_batch_size;
+}
+
+int
+configuration_t::journal_batch_timeout() const {
+	return m_journal_batch_timeout;
+}
+
+bool
+configuration_t::journal_wait_durable() const {
+	return m_journal_wait_durable;
+}
+
+bool
+configuration_t::is_spill_enabled() const {
+	return m_spill_enabled;
+}
+
+size_t
+configuration_t::spill_min_size() const {
+	return m_spill_min_size;
+}
+
 bool
 configuration_t::is_statistics_enabled() const {
 	return m_statistics_enabled;
@@ -484,6 +661,8 @@ configuration_t::as_string() const {
 	out << "basic settings\n";
 	out << "\tconfig version: " << configuration_t::current_config_version << "\n";
 	out << "\tdefault message deadline: " << c.m_default_message_deadline << "\n";
+	out << "\tio threads: " << c.m_io_threads << "\n";
+	out << "\tcompletion threads: " << c.m_completion_threads << "\n";
 	
 	// logger
 	out << "\nlogger\n";
@@ -534,7 +713,25 @@ configuration_t::as_string() const {
 		out << "\teblob path: " << c.m_eblob_path << "\n";
  		out << "\teblob sync interval: " << c.m_eblob_sync_interval << "\n";
  		out << "\teblob thread pool size: " << c.m_eblob_thread_pool_size << "\n";
- 		out << "\teblob defrag timeout: " << c.m_eblob_defrag_timeout << "\n\n";
+ 		out << "\teblob defrag timeout: " << c.m_eblob_defrag_timeout << "\n";
+
+		if (c.m_journal_enabled) {
+			out << "\twrite behind batch size: " << c.m_journal_batch_size << "\n";
+			out << "\twrite behind batch timeout: " << c.m_journal_batch_timeout << "\n";
+			out << "\twrite behind wait durable: " << (c.m_journal_wait_durable ? "yes" : "no") << "\n";
+		}
+		else {
+			out << "\twrite behind: no\n";
+		}
+
+		if (c.m_spill_enabled) {
+			out << "\tspill to disk min size: " << c.m_spill_min_size << "\n";
+		}
+		else {
+			out << "\tspill to disk: no\n";
+		}
+
+		out << "\n";
  	}
 
 	// services
@@ -562,6 +759,12 @@ configuration_t::as_string() const {
 				out << "\tautodiscovery type: undefined" << "\n";
 				break;
 		}
+
+		out << "\tbatching size: " << it->second.batching_size << "\n";
+		out << "\tbalancing: " << balancing_strategy_t::type_name(it->second.balancing_type) << "\n";
+		out << "\tservice queue limits: " << service_info_t::limits_as_string(it->second.service_queue_limits) << "\n";
+		out << "\thandle queue limits: " << service_info_t::limits_as_string(it->second.handle_queue_limits) << "\n";
+		out << "\toverflow: " << service_info_t::overflow_policy_name(it->second.overflow_policy) << "\n";
 	}
 
  	/*
@@ -18,13 +18,25 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>. 
 */
 
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+
 #include "cocaine/dealer/core/context.hpp"
+#include "cocaine/dealer/core/reactor.hpp"
+#include "cocaine/dealer/core/completion_executor.hpp"
 #include "cocaine/dealer/utils/error.hpp"
+#include "cocaine/dealer/utils/refresher.hpp"
+#include "cocaine/dealer/utils/buffer_pool.hpp"
 #include "cocaine/dealer/storage/eblob_storage.hpp"
+#include "cocaine/dealer/storage/eblob_journal.hpp"
     
 namespace cocaine {
 namespace dealer {
 
+// milliseconds a pooled buffer may stay unused before it's freed
+static const unsigned long long buffer_pool_trim_interval = 10000;
+
 context_t::context_t(const std::string& config_path) {
 	// load configuration_t from file
 	if (config_path.empty()) {
@@ -65,12 +77,47 @@ context_t::context_t(const std::string& config_path) {
 	// create zmq context
 	m_zmq_context.reset(new zmq::context_t(1));
 
+	// create i/o threads shared by all handles
+	int io_threads = m_config->io_threads();
+
+	if (io_threads <= 0) {
+		io_threads = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+	}
+
+	for (int i = 0; i < io_threads; ++i) {
+		m_reactors.push_back(boost::shared_ptr<reactor_t>(new reactor_t()));
+	}
+
+	logger()->log(PLOG_DEBUG, "started %d i/o threads", io_threads);
+
+	// create threads running async responses callbacks
+	int completion_threads = m_config->completion_threads();
+
+	if (completion_threads <= 0) {
+		completion_threads = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+	}
+
+	m_executor.reset(new completion_executor_t(completion_threads, logger()));
+
+	logger()->log(PLOG_DEBUG, "started %d completion threads", completion_threads);
+
+	m_buffer_pool_trimmer.reset(new refresher(&buffer_pool_t::trim, buffer_pool_trim_interval));
+
 	// create statistics collector
 	//m_stats.reset(new statistics_collector(m_config, m_zmq_context, logger()));
 }
 
 context_t::~context_t() {
+	m_buffer_pool_trimmer.reset();
+	m_reactors.clear();
+
+	// no responses come after reactors stop, run callbacks left
+	m_executor.reset();
+
 	m_zmq_context.reset();
+
+	// queued writes go to eblobs before they close
+	m_journal.reset();
 	m_storage.reset();
 }
 
@@ -108,6 +155,15 @@ context_t::create_storage() {
 	for (; it != services_info_list.end(); ++it) {
 		m_storage->open_eblob(it->second.name);
 	}
+
+	if (config()->is_journal_enabled()) {
+		m_journal.reset(new eblob_journal_t(logger(),
+											config()->journal_batch_size(),
+											config()->journal_batch_timeout()));
+
+		m_storage->set_journal(m_journal);
+		logger()->log(PLOG_DEBUG, "started eblob write-behind journal");
+	}
 }
 
 boost::shared_ptr<configuration_t>
@@ -135,5 +191,29 @@ context_t::storage() {
 	return m_storage;
 }
 
+boost::shared_ptr<eblob_journal_t>
+context_t::journal() {
+	return m_journal;
+}
+
+boost::shared_ptr<completion_executor_t>
+context_t::executor() {
+	return m_executor;
+}
+
+boost::shared_ptr<reactor_t>
+context_t::reactor() {
+	assert(!m_reactors.empty());
+
+	size_t index = 0;
+	for (size_t i = 1; i < m_reactors.size(); ++i) {
+		if (m_reactors[i]->handles_count() < m_reactors[index]->handles_count()) {
+			index = i;
+		}
+	}
+
+	return m_reactors[index];
+}
+
 } // namespace dealer
 } // namespace cocaine
@@ -19,9 +19,12 @@
 */
 
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/current_function.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <uuid/uuid.h>
 
@@ -31,6 +34,7 @@
 #include "json/json.h"
 
 #include "cocaine/dealer/utils/error.hpp"
+#include "cocaine/dealer/utils/buffer_pool.hpp"
 #include "cocaine/dealer/utils/data_container.hpp"
 
 namespace cocaine {
@@ -39,24 +43,26 @@ namespace dealer {
 data_container::data_container() :
 	data_(NULL),
 	size_(0),
+	buffer_(NULL),
 	signed_(false)
 {
-	init();
 }
 
 data_container::data_container(const void* data, size_t size) :
-	size_(size),
+	data_(NULL),
+	size_(0),
+	buffer_(NULL),
 	signed_(false)
 {
 	set_data(data, size);
 }
 
-data_container::data_container(const data_container& dc) {
-	if (dc.empty()) {
-		init();
-		return;
-	}
-
+data_container::data_container(const data_container& dc) :
+	data_(NULL),
+	size_(0),
+	buffer_(NULL),
+	signed_(false)
+{
 	*this = dc;
 }
 
@@ -67,64 +73,134 @@ data_container::set_data(const void* data, size_t size) {
 
 	// early exit
 	if (data == NULL || size == 0) {
-		data_ = NULL;
-		size_ = 0;
 		return;
 	}
 
 	// copy provided data
-	std::string error_msg = "not enough memory to create new data container at ";
-	error_msg += std::string(BOOST_CURRENT_FUNCTION);
-
 	try {
-		data_ = new unsigned char[size];
+		buffer_ = buffer_pool_t::allocate(size);
 	}
 	catch (...) {
+		std::string error_msg = "not enough memory to create new data container at ";
+		error_msg += std::string(BOOST_CURRENT_FUNCTION);
 		throw internal_error(error_msg);
 	}
 
-	if (!data_) {
-		throw internal_error(error_msg);
-	}
-
+	data_ = static_cast<unsigned char*>(buffer_);
 	memcpy(data_, data, size);
-	++*ref_counter_;
 	size_ = size;
+}
+
+void
+data_container::adopt_data(void* data, size_t size, free_fn_t free_fn, void* hint) {
+	// clean-up in case we have anything
+	clear();
+
+	if (data == NULL || size == 0) {
+		if (free_fn) {
+			free_fn(data, hint);
+		}
+		else {
+			delete [] static_cast<unsigned char*>(data);
+		}
 
-	// data too small to compare by sha, we'll do comparisons with memcmp
-	if (size_ <= SMALL_DATA_SIZE) {
 		return;
 	}
 
-	// create sha signature
-	sign_data(data_, size_, signature_);
-	signed_ = true;
+	try {
+		buffer_ = buffer_pool_t::allocate(sizeof(adopted_data_t));
+	}
+	catch (...) {
+		// ownership was handed over, don't leak it
+		if (free_fn) {
+			free_fn(data, hint);
+		}
+		else {
+			delete [] static_cast<unsigned char*>(data);
+		}
+
+		std::string error_msg = "not enough memory to adopt data in data container at ";
+		error_msg += std::string(BOOST_CURRENT_FUNCTION);
+		throw internal_error(error_msg);
+	}
+
+	adopted_data_t* adopted = static_cast<adopted_data_t*>(buffer_);
+	adopted->free_fn = free_fn;
+	adopted->hint = hint;
+
+	data_ = static_cast<unsigned char*>(data);
+	size_ = size;
 }
 
 void
-data_container::init() {
-	// reset sha1 signature
-	signed_ = false;
-	memset(signature_, 0, SHA1_SIZE);
+data_container::swap(data_container& dc) {
+	std::swap(data_, dc.data_);
+	std::swap(size_, dc.size_);
+	std::swap(buffer_, dc.buffer_);
+	std::swap(signed_, dc.signed_);
+
+	unsigned char signature[SHA1_SIZE];
+	memcpy(signature, signature_, SHA1_SIZE);
+	memcpy(signature_, dc.signature_, SHA1_SIZE);
+	memcpy(dc.signature_, signature, SHA1_SIZE);
+}
 
-	// create ref counter
-	std::string error_msg = "not enough memory to create new ref_counter in data container at ";
-	error_msg += std::string(BOOST_CURRENT_FUNCTION);
+bool
+data_container::share_data(data_container& dc) const {
+	if (empty()) {
+		return false;
+	}
 
-	try {
-		ref_counter_.reset(new reference_counter(0));
+	dc = *this;
+	return true;
+}
+
+void
+data_container::free_malloced_data(void* data, __attribute__ ((unused)) void* hint) {
+	free(data);
+}
+
+void*
+data_container::retain_buffer() const {
+	if (buffer_) {
+		buffer_pool_t::add_ref(buffer_);
 	}
-	catch (...) {
-		throw internal_error(error_msg);
+
+	return buffer_;
+}
+
+void
+data_container::release_buffer(void* data, void* hint) {
+	// data may be shared with zmq i/o threads, pool drops references atomically
+	if (!hint || !buffer_pool_t::release(hint)) {
+		return;
 	}
 
-	if (!ref_counter_.get()) {
-		throw internal_error(error_msg);
+	// adopted data lives apart from it's control block
+	if (data != hint) {
+		adopted_data_t* adopted = static_cast<adopted_data_t*>(hint);
+
+		if (adopted->free_fn) {
+			adopted->free_fn(data, adopted->hint);
+		}
+		else {
+			delete [] static_cast<unsigned char*>(data);
+		}
 	}
 
+	buffer_pool_t::deallocate(hint);
+}
+
+void
+data_container::init() {
+	// reset sha1 signature
+	signed_ = false;
+	memset(signature_, 0, SHA1_SIZE);
+
 	// init data
 	data_ = NULL;
 	size_ = 0;
+	buffer_ = NULL;
 }
 
 data_container::~data_container() {
@@ -133,37 +209,24 @@ data_container::~data_container() {
 
 void
 data_container::release() {
-	if (!ref_counter_) {
-		return;
-	}
-
-	if (*ref_counter_ == 0) {
-		return;
-	}
-
-	--*ref_counter_;
-
-	if (data_ && *ref_counter_ == 0) {
-		delete [] data_;
-		data_ = NULL;
-		memset(&signature_, 0, SHA1_SIZE);
-	}
+	release_buffer(data_, buffer_);
 }
 
 data_container&
 data_container::operator = (const data_container& rhs) {
+	if (this == &rhs) {
+		return *this;
+	}
+
+	rhs.retain_buffer();
 	this->release();
 
 	data_ = rhs.data_;
 	size_ = rhs.size_;
-	signed_ = rhs.signed_;
+	buffer_ = rhs.buffer_;
 
-	if (rhs.signed_) {
-		memcpy(signature_, rhs.signature_, SHA1_SIZE);
-	}
-
-	ref_counter_ = rhs.ref_counter_;
-	++*ref_counter_;
+	// rhs may be signed by another thread meanwhile, signature is computed again if needed
+	signed_ = false;
 
 	return *this;
 }
@@ -180,13 +243,18 @@ data_container::operator == (const data_container& rhs) const {
 		return true;
 	}
 
+	// containers share the same data
+	if (data_ == rhs.data_) {
+		return true;
+	}
+
 	// compare small containers
 	if (size_ <= SMALL_DATA_SIZE) {
 		return (0 == memcmp(data_, rhs.data_, size_));
 	}
 
 	// compare big containers
-	return (0 == memcmp(signature_, rhs.signature_, SHA1_SIZE));
+	return (0 == memcmp(signature(), rhs.signature(), SHA1_SIZE));
 }
 
 bool
@@ -215,8 +283,35 @@ data_container::size() const {
 	return size_;
 }
 
+const unsigned char*
+data_container::signature() const {
+	// only containers over SMALL_DATA_SIZE get here, one lock for all is enough
+	static boost::mutex* mutex = new boost::mutex;
+
+	{
+		boost::mutex::scoped_lock lock(*mutex);
+
+		if (signed_) {
+			return signature_;
+		}
+	}
+
+	// data is hashed without lock, concurrent callers may both do it
+	unsigned char signature[SHA1_SIZE];
+	sign_data(data_, size_, signature);
+
+	boost::mutex::scoped_lock lock(*mutex);
+
+	if (!signed_) {
+		memcpy(signature_, signature, SHA1_SIZE);
+		signed_ = true;
+	}
+
+	return signature_;
+}
+
 void
-data_container::sign_data(unsigned char* data, size_t& size, unsigned char signature[SHA1_SIZE]) {
+data_container::sign_data(unsigned char* data, size_t size, unsigned char signature[SHA1_SIZE]) {
 	SHA_CTX sha_context;
 	SHA1_Init(&sha_context);
 
@@ -60,6 +60,42 @@ dealer_t::send_message(const void* data,
     return m_impl->send_message(data, size, path);
 }
 
+boost::shared_ptr<response_t>
+dealer_t::send_message(const data_container& data,
+                       const message_path_t& path,
+                       const message_policy_t& policy)
+{
+	return m_impl->send_message(data, path, policy);
+}
+
+boost::shared_ptr<response_t>
+dealer_t::send_message(const data_container& data,
+                       const message_path_t& path)
+{
+	return m_impl->send_message(data, path);
+}
+
+void
+dealer_t::send_message_async(const void* data,
+                             size_t size,
+                             const message_path_t& path,
+                             const message_policy_t& policy,
+                             const chunk_callback_t& on_chunk,
+                             const done_callback_t& on_done)
+{
+	m_impl->send_message_async(data, size, path, policy, on_chunk, on_done);
+}
+
+void
+dealer_t::send_message_async(const data_container& data,
+                             const message_path_t& path,
+                             const message_policy_t& policy,
+                             const chunk_callback_t& on_chunk,
+                             const done_callback_t& on_done)
+{
+	m_impl->send_message_async(data, path, policy, on_chunk, on_done);
+}
+
 std::vector<boost::shared_ptr<response_t> >
 dealer_t::send_messages(const void* data,
                         size_t size,
@@ -82,11 +118,30 @@ dealer_t::policy_for_service(const std::string& service_alias) {
     return m_impl->policy_for_service(service_alias);
 }
 
+size_t
+dealer_t::queued_messages_count(const std::string& service_alias,
+                                const std::string& handle_name)
+{
+    return m_impl->queued_messages_count(service_alias, handle_name);
+}
+
+size_t
+dealer_t::queued_bytes(const std::string& service_alias,
+                       const std::string& handle_name)
+{
+    return m_impl->queued_bytes(service_alias, handle_name);
+}
+
 size_t
 dealer_t::stored_messages_count(const std::string& service_alias) {
     return m_impl->stored_messages_count(service_alias);
 }
 
+size_t
+dealer_t::stored_bytes(const std::string& service_alias) {
+    return m_impl->stored_bytes(service_alias);
+}
+
 void
 dealer_t::remove_stored_message(const message_t& message) {
     m_impl->remove_stored_message(message);   
@@ -104,5 +159,17 @@ dealer_t::get_stored_messages(const std::string& service_alias,
     m_impl->get_stored_messages(service_alias, messages);
 }
 
+void
+dealer_t::get_stored_messages(const std::string& service_alias,
+                              const stored_message_callback_t& callback)
+{
+    m_impl->get_stored_messages(service_alias, callback);
+}
+
+size_t
+dealer_t::resend_stored_messages(const std::string& service_alias) {
+    return m_impl->resend_stored_messages(service_alias);
+}
+
 } // namespace dealer
 } // namespace cocaine
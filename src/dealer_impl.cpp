@@ -21,6 +21,9 @@
 #include <stdexcept>
 
 #include <boost/current_function.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "cocaine/dealer/core/cached_message.hpp"
 #include "cocaine/dealer/core/request_metadata.hpp"
@@ -31,6 +34,7 @@
 #include "cocaine/dealer/heartbeats/http_hosts_fetcher.hpp"
 #include "cocaine/dealer/heartbeats/file_hosts_fetcher.hpp"
 #include "cocaine/dealer/storage/eblob_storage.hpp"
+#include "cocaine/dealer/storage/eblob_journal.hpp"
 #include "cocaine/dealer/response.hpp"
 
 #include "cocaine/dealer/core/dealer_impl.hpp"
@@ -40,10 +44,61 @@ namespace dealer {
 
 typedef cached_message_t<persistent_data_container, persistent_request_metadata_t> p_message_t;
 
+namespace {
+	// stored record is packed path, policy, uuid and data
+	struct stored_record_t {
+		stored_record_t() : data(NULL), size(0) {}
+
+		message_path_t path;
+		message_policy_t policy;
+		std::string id;
+
+		// points into record, valid while iteration callback runs
+		const char* data;
+		size_t size;
+	};
+
+	bool unpack_stored_record(const void* data, uint64_t size, stored_record_t& record) {
+		if (!data || size == 0) {
+			return false;
+		}
+
+		const char* buffer = reinterpret_cast<const char*>(data);
+		size_t offset = 0;
+		msgpack::unpacked result;
+
+		msgpack::unpack(&result, buffer, size, &offset);
+		result.get().convert(&record.path);
+
+		msgpack::unpack(&result, buffer, size, &offset);
+		result.get().convert(&record.policy);
+
+		msgpack::unpack(&result, buffer, size, &offset);
+		result.get().convert(&record.id);
+
+		// data is referenced in record, not copied
+		msgpack::unpack(&result, buffer, size, &offset);
+		const msgpack::object& body = result.get();
+
+		if (body.type != msgpack::type::RAW) {
+			return false;
+		}
+
+		record.data = body.via.raw.ptr;
+		record.size = body.via.raw.size;
+
+		return true;
+	}
+
+	void collect_stored_message(boost::mutex& mutex, std::vector<message_t>& messages, const message_t& message) {
+		boost::mutex::scoped_lock lock(mutex);
+		messages.push_back(message);
+	}
+}
+
 dealer_impl_t::dealer_impl_t(const std::string& config_path) :
 	m_messages_cache_size(0),
-	m_is_dead(false),
-	m_messages_ptr(NULL)
+	m_is_dead(false)
 {
 	// create dealer context
 	std::string ctx_error_msg = "could not create dealer context at: " + std::string(BOOST_CURRENT_FUNCTION) + " ";
@@ -68,6 +123,12 @@ dealer_impl_t::dealer_impl_t(const std::string& config_path) :
 
 	log(PLOG_INFO, "creating dealer.");
 
+	if (config()->message_cache_type() == PERSISTENT && config()->is_spill_enabled() &&
+		config()->is_journal_enabled() && !config()->journal_wait_durable())
+	{
+		log(PLOG_WARNING, "spilled persistent messages wait for write behind batch, \"wait_durable\" is off for others only.");
+	}
+
 	// get services list
 	const configuration_t::services_list_t& services_info_list = config()->services_list();
 
@@ -117,11 +178,9 @@ dealer_impl_t::get_service(const std::string& service_alias) {
 
 boost::shared_ptr<response_t>
 dealer_impl_t::send_message(const message_t& message) {
-	boost::shared_ptr<service_t> service = get_service(message.path.service_alias);
-	return dealer_impl_t::send_message(message.data.data(),
-									   message.data.size(),
+	return dealer_impl_t::send_message(message.data,
 									   message.path,
-									   message.policy);	
+									   message.policy);
 }
 
 boost::shared_ptr<response_t>
@@ -140,14 +199,67 @@ dealer_impl_t::send_message(const void* data,
 							const message_policy_t& policy)
 {
 	BOOST_VERIFY(!m_is_dead);
-	
-	boost::mutex::scoped_lock lock(m_mutex);
+
+	// services map never changes after construction, no locking needed
 	boost::shared_ptr<service_t> service = get_service(path.service_alias);
 	boost::shared_ptr<message_iface> msg = create_message(data, size, path, policy);
 
 	return service->send_message(msg);
 }
 
+boost::shared_ptr<response_t>
+dealer_impl_t::send_message(const data_container& data,
+							const message_path_t& path)
+{
+	boost::shared_ptr<service_t> service = get_service(path.service_alias);
+	return dealer_impl_t::send_message(data, path, service->info().policy);
+}
+
+boost::shared_ptr<response_t>
+dealer_impl_t::send_message(const data_container& data,
+							const message_path_t& path,
+							const message_policy_t& policy)
+{
+	BOOST_VERIFY(!m_is_dead);
+
+	// services map never changes after construction, no locking needed
+	boost::shared_ptr<service_t> service = get_service(path.service_alias);
+	boost::shared_ptr<message_iface> msg = create_message(data, path, policy);
+
+	return service->send_message(msg);
+}
+
+void
+dealer_impl_t::send_message_async(const void* data,
+								  size_t size,
+								  const message_path_t& path,
+								  const message_policy_t& policy,
+								  const chunk_callback_t& on_chunk,
+								  const done_callback_t& on_done)
+{
+	BOOST_VERIFY(!m_is_dead);
+
+	boost::shared_ptr<service_t> service = get_service(path.service_alias);
+	boost::shared_ptr<message_iface> msg = create_message(data, size, path, policy);
+
+	service->send_message_async(msg, on_chunk, on_done);
+}
+
+void
+dealer_impl_t::send_message_async(const data_container& data,
+								  const message_path_t& path,
+								  const message_policy_t& policy,
+								  const chunk_callback_t& on_chunk,
+								  const done_callback_t& on_done)
+{
+	BOOST_VERIFY(!m_is_dead);
+
+	boost::shared_ptr<service_t> service = get_service(path.service_alias);
+	boost::shared_ptr<message_iface> msg = create_message(data, path, policy);
+
+	service->send_message_async(msg, on_chunk, on_done);
+}
+
 std::vector<boost::shared_ptr<response_t> >
 dealer_impl_t::send_messages(const void* data,
 							 size_t size,
@@ -207,6 +319,32 @@ dealer_impl_t::policy_for_service(const std::string& service_alias) {
 	return service->info().policy;
 }
 
+size_t
+dealer_impl_t::queued_messages_count(const std::string& service_alias,
+									 const std::string& handle_name)
+{
+	boost::shared_ptr<service_t> service = get_service(service_alias);
+
+	if (handle_name.empty()) {
+		return service->queue_usage().messages;
+	}
+
+	return service->queue_usage(handle_name).messages;
+}
+
+size_t
+dealer_impl_t::queued_bytes(const std::string& service_alias,
+							const std::string& handle_name)
+{
+	boost::shared_ptr<service_t> service = get_service(service_alias);
+
+	if (handle_name.empty()) {
+		return service->queue_usage().bytes;
+	}
+
+	return service->queue_usage(handle_name).bytes;
+}
+
 bool
 dealer_impl_t::regex_match(const std::string& regex_str, const std::string& value) {
 	boost::mutex::scoped_lock lock(m_regex_mutex);
@@ -278,21 +416,104 @@ dealer_impl_t::create_message(const void* data,
 							  const message_path_t& path,
 							  const message_policy_t& policy)
 {
+	if (is_spilled(size, policy)) {
+		return create_spilled_message(data, size, path, policy);
+	}
+
+	// stored message gets its record laid out at creation
+	bool is_stored = (config()->message_cache_type() == PERSISTENT && policy.persistent);
+
 	typedef cached_message_t<data_container, request_metadata_t> msg_t;
 	boost::shared_ptr<message_iface> msg(new msg_t(path,
 												   policy,
 												   data,
-												   size));
+												   size,
+												   is_stored));
+
+	commit_to_persistent_storage(msg, path, policy, config()->journal_wait_durable());
+	return msg;
+}
+
+boost::shared_ptr<message_iface>
+dealer_impl_t::create_message(const data_container& data,
+							  const message_path_t& path,
+							  const message_policy_t& policy)
+{
+	if (is_spilled(data.size(), policy)) {
+		return create_spilled_message(data.data(), data.size(), path, policy);
+	}
+
+	typedef cached_message_t<data_container, request_metadata_t> msg_t;
+	boost::shared_ptr<message_iface> msg(new msg_t(path, policy, data));
+
+	commit_to_persistent_storage(msg, path, policy, config()->journal_wait_durable());
+	return msg;
+}
+
+bool
+dealer_impl_t::is_spilled(size_t size, const message_policy_t& policy) {
+	if (config()->message_cache_type() != PERSISTENT || !config()->is_spill_enabled()) {
+		return false;
+	}
+
+	return (policy.persistent || size >= config()->spill_min_size());
+}
 
+boost::shared_ptr<message_iface>
+dealer_impl_t::create_spilled_message(const void* data,
+									  size_t size,
+									  const message_path_t& path,
+									  const message_policy_t& policy)
+{
+	boost::shared_ptr<p_message_t> msg(new p_message_t(path, policy, data, size));
+	boost::shared_ptr<eblob_t> eb = context()->storage()->get_eblob(path.service_alias);
+
+	persistent_data_container& container = msg->data_container();
+
+	if (policy.persistent) {
+		// data is the tail of message record, it must be on disk before it's dropped from memory,
+		// so sender waits for journal batch regardless of wait_durable setting
+		container.set_eblob(eb, msg->uuid().as_string(), 0);
+		commit_to_persistent_storage(msg, path, policy, true);
+	}
+	else {
+		container.set_eblob(eb, msg->uuid().as_string());
+		container.commit_data();
+	}
+
+	msg->unload_data();
+
+	log(PLOG_DEBUG, "spilled data of message with uuid: " + msg->uuid().as_string() + " to persistent storage.");
+	return msg;
+}
+
+void
+dealer_impl_t::commit_to_persistent_storage(const boost::shared_ptr<message_iface>& msg,
+											const message_path_t& path,
+											const message_policy_t& policy,
+											bool wait_durable)
+{
 	if (config()->message_cache_type() == PERSISTENT &&
 		policy.persistent == true)
 	{
 		boost::shared_ptr<eblob_t> eb = context()->storage()->get_eblob(path.service_alias);
-		msg->commit_to_eblob(eb);
-		log(PLOG_DEBUG, "commited message with uuid: " + msg->uuid() + " to persistent storage.");
-	}
+		boost::shared_ptr<eblob_journal_t> journal = context()->journal();
 
-	return msg;
+		if (!journal) {
+			msg->commit_to_eblob(eb);
+			log(PLOG_DEBUG, "commited message with uuid: " + msg->uuid().as_string() + " to persistent storage.");
+			return;
+		}
+
+		boost::uint64_t sequence = msg->commit_to_journal(*journal, eb);
+
+		// sender returns once batch with its message is written
+		if (wait_durable && !journal->wait(sequence)) {
+			throw dealer_error(resource_error,
+							   "could not write message with uuid: %s to persistent storage",
+							   msg->uuid().as_string().c_str());
+		}
+	}
 }
 
 size_t
@@ -301,39 +522,64 @@ dealer_impl_t::stored_messages_count(const std::string& service_alias) {
 		return 0;
 	}
 
+	// counters are kept by eblob_t, no need to wait for journal or iterate blob
+	boost::shared_ptr<eblob_t> blob = this->context()->storage()->get_eblob(service_alias);
+	return static_cast<size_t>(blob->stats().alive_items);
+}
+
+size_t
+dealer_impl_t::stored_bytes(const std::string& service_alias) {
+	if (config()->message_cache_type() != PERSISTENT) {
+		return 0;
+	}
+
 	boost::shared_ptr<eblob_t> blob = this->context()->storage()->get_eblob(service_alias);
-	return blob->alive_items_count();
+	return static_cast<size_t>(blob->stats().alive_bytes);
 }
 
 void
 dealer_impl_t::get_stored_messages(const std::string& service_alias,
 								   std::vector<message_t>& messages)
 {
-	if (config()->message_cache_type() != PERSISTENT) {
+	boost::mutex mutex;
+	get_stored_messages(service_alias, boost::bind(&collect_stored_message, boost::ref(mutex), boost::ref(messages), _1));
+}
+
+void
+dealer_impl_t::get_stored_messages(const std::string& service_alias,
+								   const stored_message_callback_t& callback)
+{
+	if (config()->message_cache_type() != PERSISTENT || !callback) {
 		return;
 	}
 
+	flush_journal();
+
 	boost::shared_ptr<eblob_t> blob = this->context()->storage()->get_eblob(service_alias);
-	int unsent_messages_count = blob->alive_items_count();
 
-	assert(unsent_messages_count >= 0);
+	log(PLOG_DEBUG, "restoring messages for service [%s] from persistent cache...", service_alias.c_str());
 
-	if (unsent_messages_count == 0) {
-		std::string log_str = "no messages to restore for service [%s] from persistent cache...";
-		log(PLOG_DEBUG, log_str, service_alias.c_str());
-		return;
+	// records are decoded on eblob iteration threads as they are read
+	blob->iterate(boost::bind(&dealer_impl_t::restore_stored_message, this, boost::cref(callback), _2, _3, _4));
+}
+
+size_t
+dealer_impl_t::resend_stored_messages(const std::string& service_alias) {
+	if (config()->message_cache_type() != PERSISTENT) {
+		return 0;
 	}
 
-	std::string log_str = "restoring %d messages for service [%s] from persistent cache...";
-	log(PLOG_DEBUG, log_str, unsent_messages_count, service_alias.c_str());
+	boost::shared_ptr<service_t> service = get_service(service_alias);
+
+	flush_journal();
 
-	m_messages_ptr = &messages;
+	boost::shared_ptr<eblob_t> blob = this->context()->storage()->get_eblob(service_alias);
+	boost::detail::atomic_count resent(0);
 
-	eblob_t::iteration_callback_t callback;
-	callback = boost::bind(&dealer_impl_t::storage_iteration_callback, this, _1, _2, _3, _4);
-	blob->iterate(callback);
+	blob->iterate(boost::bind(&dealer_impl_t::resend_stored_message, this, service, blob, boost::ref(resent), _2, _3, _4));
 
-	m_messages_ptr = NULL;
+	log(PLOG_INFO, "resent %d stored messages to service [%s]", static_cast<int>(resent), service_alias.c_str());
+	return static_cast<size_t>(resent);
 }
 
 void
@@ -342,9 +588,16 @@ dealer_impl_t::remove_stored_message(const message_t& message) {
 		return;
 	}
 
-	boost::shared_ptr<eblob_t> blob;
-	blob = this->context()->storage()->get_eblob(message.path.service_alias);
-	blob->remove_all(message.id);
+	context()->storage()->remove_all(message.path.service_alias, message.id);
+}
+
+void
+dealer_impl_t::flush_journal() {
+	boost::shared_ptr<eblob_journal_t> journal = context()->journal();
+
+	if (journal) {
+		journal->flush();
+	}
 }
 
 void
@@ -352,43 +605,93 @@ dealer_impl_t::remove_stored_message_for(const response_ptr_t& response) {
 }
 
 void
-dealer_impl_t::storage_iteration_callback(const std::string& key,
-										  void* data,
-										  uint64_t size,
-										  int column)
+dealer_impl_t::restore_stored_message(const stored_message_callback_t& callback,
+									  void* data,
+									  uint64_t size,
+									  int column)
 {
-	if (!m_messages_ptr) {
+	// spilled data of messages has columns of its own
+	if (column != 0) {
 		return;
 	}
 
-	if (column == 0 && (!data || size == 0)) {
-		throw internal_error("empty message found in cache: " + std::string(BOOST_CURRENT_FUNCTION));
+	try {
+		stored_record_t record;
+
+		if (!unpack_stored_record(data, size, record)) {
+			log(PLOG_ERROR, "damaged message found in persistent cache, skipped.");
+			return;
+		}
+
+		message_t message;
+		message.path = record.path;
+		message.policy = record.policy;
+		message.id = record.id;
+		message.data.set_data(record.data, record.size);
+
+		callback(message);
+	}
+	catch (const std::exception& ex) {
+		log(PLOG_ERROR, "could not restore message from persistent cache, details: %s", ex.what());
+	}
+}
+
+void
+dealer_impl_t::resend_stored_message(const boost::shared_ptr<service_t>& service,
+									 const boost::shared_ptr<eblob_t>& blob,
+									 boost::detail::atomic_count& resent,
+									 void* data,
+									 uint64_t size,
+									 int column)
+{
+	if (column != 0) {
+		return;
 	}
 
-    // init unpacker
-	msgpack::unpacker pac(size);
-	memcpy(pac.buffer(), data, size);
-	pac.buffer_consumed(size);
+	try {
+		stored_record_t record;
+		wuuid_t uuid;
+
+		if (!unpack_stored_record(data, size, record) || !uuid.from_string(record.id)) {
+			log(PLOG_ERROR, "damaged message found in persistent cache, skipped.");
+			return;
+		}
+
+		// stored record is reused, message is not written again
+		boost::shared_ptr<message_iface> msg;
 
-	message_t msg;
-	msgpack::unpacked result;
+		if (is_spilled(record.size, record.policy)) {
+			persistent_data_container container;
+			container.init_from_message_cache(blob, record.id, record.size);
 
-    pac.next(&result);
-    result.get().convert(&msg.path);
+			p_message_t* p_msg = new p_message_t(record.path, record.policy, container);
+			p_msg->mdata_container().uuid = uuid;
+			msg.reset(p_msg);
+		}
+		else {
+			typedef cached_message_t<data_container, request_metadata_t> msg_t;
 
-	pac.next(&result);
-    result.get().convert(&msg.policy);
+			msg_t* ram_msg = new msg_t(record.path, record.policy, record.data, record.size);
+			ram_msg->mdata_container().uuid = uuid;
+			msg.reset(ram_msg);
+		}
 
-    pac.next(&result);
-    result.get().convert(&msg.id);
+		switch (service->resend_message(msg)) {
+			case service_t::RR_QUEUED:
+				++resent;
+				break;
 
-    std::string msg_data;
-    pac.next(&result);
-    result.get().convert(&msg_data);
-    msg.data.set_data(msg_data.data(), msg_data.size());
+			case service_t::RR_IN_FLIGHT:
+				log(PLOG_DEBUG, "stored message with uuid: %s is in flight, not resent.", record.id.c_str());
+				break;
 
-    if (m_messages_ptr) {
-    	m_messages_ptr->push_back(msg);
+			default:
+				log(PLOG_WARNING, "queue is full, stored message with uuid: %s kept for later.", record.id.c_str());
+				break;
+		}
+	}
+	catch (const std::exception& ex) {
+		log(PLOG_ERROR, "could not resend message from persistent cache, details: %s", ex.what());
 	}
 }
 
@@ -18,6 +18,15 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>. 
 */
 
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/functional/hash.hpp>
+
 #include "cocaine/dealer/storage/eblob.hpp"
 
 namespace cocaine {
@@ -33,11 +42,11 @@ eblob_t::eblob_t(const std::string& path,
 				 int sync_interval,
 				 int defrag_timeout,
 				 int thread_pool_size) :
-	m_alive_items_count(0),
 	m_thread_pool_size(thread_pool_size),
 	dealer_object_t(ctx, logging_enabled)
 {
 	create_eblob(path, blob_size, sync_interval, defrag_timeout);
+	scan_at_open();
 }
 
 eblob_t::~eblob_t() {
@@ -45,58 +54,155 @@ eblob_t::~eblob_t() {
 }
 
 void
-eblob_t::write(const std::string& key,
-			   const std::string& value,
-			   int column)
-{
+eblob_t::check_storage(const std::string& key, int column, const char* function) {
 	if (!m_storage.get()) {
-		std::string error_msg = "empty eblob storage object at " + std::string(BOOST_CURRENT_FUNCTION);
+		std::string error_msg = "empty eblob storage object at " + std::string(function);
 		error_msg += " key: " + key + " column: " + boost::lexical_cast<std::string>(column);
 		throw internal_error(error_msg);
 	}
 
 	if (column < 0) {
-		std::string error_msg = "bad column index at " + std::string(BOOST_CURRENT_FUNCTION);
+		std::string error_msg = "bad column index at " + std::string(function);
 		error_msg += " key: " + key + " column: " + boost::lexical_cast<std::string>(column);
 		throw internal_error(error_msg);
 	}
+}
 
-	// 2DO: truncate written value
-	m_storage->write_hashed(key, value, 0, BLOB_DISK_CTL_OVERWRITE, column);
+void
+eblob_t::write(const std::string& key,
+			   const std::string& value,
+			   int column)
+{
+	write(key, value.data(), value.size(), column);
 }
 
 void
 eblob_t::write(const std::string& key,
-			   void* data,
+			   const void* data,
 			   size_t size,
 			   int column)
 {
-	if (!m_storage.get()) {
-		std::string error_msg = "empty eblob storage object at " + std::string(BOOST_CURRENT_FUNCTION);
-		error_msg += " key: " + key + " column: " + boost::lexical_cast<std::string>(column);
-		throw internal_error(error_msg);
+	struct iovec piece;
+	piece.iov_base = const_cast<void*>(data);
+	piece.iov_len = size;
+
+	write(key, &piece, 1, column);
+}
+
+void
+eblob_t::write(const std::string& key,
+			   const struct iovec* pieces,
+			   size_t count,
+			   int column)
+{
+	check_storage(key, column, BOOST_CURRENT_FUNCTION);
+
+	eblob_key ekey;
+	m_storage->key(key, ekey);
+
+	boost::mutex::scoped_lock lock(key_lock(key));
+
+	bool is_counted = (column == EBLOB_TYPE_DATA);
+	uint64_t old_size = 0;
+	bool existed = is_counted && record_size(ekey, old_size);
+
+	// record must land on disk in one write: a header written with
+	// overwrite and followed by failed appends would leave a truncated
+	// record behind after crash, so a single nonempty piece is written
+	// from caller's memory and several pieces are joined first, at the
+	// cost of a copy. messages lay their records out contiguously
+	size_t total = 0;
+	size_t nonempty = 0;
+	const struct iovec* single = count > 0 ? &pieces[0] : NULL;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (pieces[i].iov_len == 0) {
+			continue;
+		}
+
+		total += pieces[i].iov_len;
+		single = &pieces[i];
+		++nonempty;
 	}
 
-	if (column < 0) {
-		std::string error_msg = "bad column index at " + std::string(BOOST_CURRENT_FUNCTION);
-		error_msg += " key: " + key + " column: " + boost::lexical_cast<std::string>(column);
-		throw internal_error(error_msg);
+	if (nonempty <= 1) {
+		const void* data = single ? single->iov_base : NULL;
+		size_t size = single ? single->iov_len : 0;
+		m_storage->write(ekey, data, 0, size, BLOB_DISK_CTL_OVERWRITE, column);
+	}
+	else {
+		std::vector<char> record(total);
+		size_t offset = 0;
+
+		for (size_t i = 0; i < count; ++i) {
+			if (pieces[i].iov_len == 0) {
+				continue;
+			}
+
+			memcpy(&record[offset], pieces[i].iov_base, pieces[i].iov_len);
+			offset += pieces[i].iov_len;
+		}
+
+		m_storage->write(ekey, &record[0], 0, total, BLOB_DISK_CTL_OVERWRITE, column);
 	}
 
-	// 2DO: truncate written value
-	std::string value(reinterpret_cast<char*>(data), reinterpret_cast<char*>(data) + size);
-	m_storage->write_hashed(key, value, 0, BLOB_DISK_CTL_OVERWRITE, column);
+	// overwritten record isn't truncated, its size is taken from index
+	if (is_counted) {
+		uint64_t new_size = 0;
+		bool exists = record_size(ekey, new_size);
+		update_stats(existed, old_size, exists, new_size);
+	}
 }
 
 std::string
 eblob_t::read(const std::string& key, int column) {
-	if (!m_storage.get()) {
-		std::string error_msg = "empty eblob storage object at " + std::string(BOOST_CURRENT_FUNCTION);
-		error_msg += " key: " + key + " column: " + boost::lexical_cast<std::string>(column);
-		throw internal_error(error_msg);
+	check_storage(key, column, BOOST_CURRENT_FUNCTION);
+	return m_storage->read_hashed(key, 0, 0, column);
+}
+
+bool
+eblob_t::locate(const std::string& key, location_t& location, int column) {
+	check_storage(key, column, BOOST_CURRENT_FUNCTION);
+
+	eblob_key ekey;
+	m_storage->key(key, ekey);
+
+	int fd = -1;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+
+	if (m_storage->read(ekey, &fd, &offset, &size, column) < 0) {
+		return false;
 	}
 
-	return m_storage->read_hashed(key, 0, 0, column);
+	location.fd = fd;
+	location.offset = offset;
+	location.size = size;
+
+	return true;
+}
+
+void
+eblob_t::read(const location_t& location, void* buffer) {
+	char* dst = reinterpret_cast<char*>(buffer);
+	uint64_t done = 0;
+
+	while (done < location.size) {
+		ssize_t count = pread(location.fd, dst + done, location.size - done, location.offset + done);
+
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (count <= 0) {
+			std::string error_msg = "could not read eblob record at " + std::string(BOOST_CURRENT_FUNCTION);
+			error_msg += ", offset: " + boost::lexical_cast<std::string>(location.offset + done);
+			error_msg += ", details: " + std::string(count < 0 ? strerror(errno) : "unexpected end of file");
+			throw internal_error(error_msg);
+		}
+
+		done += static_cast<uint64_t>(count);
+	}
 }
 
 void
@@ -109,7 +215,14 @@ eblob_t::remove_all(const std::string &key) {
 
 	eblob_key ekey;
 	m_storage->key(key, ekey);
+
+	boost::mutex::scoped_lock lock(key_lock(key));
+
+	uint64_t old_size = 0;
+	bool existed = record_size(ekey, old_size);
+
 	m_storage->remove_all(ekey);
+	update_stats(existed, old_size, false, 0);
 }
 
 void
@@ -120,7 +233,19 @@ eblob_t::remove(const std::string& key, int column) {
 		throw internal_error(error_msg);
 	}
 
+	boost::mutex::scoped_lock lock(key_lock(key));
+
+	uint64_t old_size = 0;
+	bool existed = false;
+
+	if (column == EBLOB_TYPE_DATA) {
+		eblob_key ekey;
+		m_storage->key(key, ekey);
+		existed = record_size(ekey, old_size);
+	}
+
 	m_storage->remove_hashed(key, column);
+	update_stats(existed, old_size, false, 0);
 }
 
 unsigned long long
@@ -135,25 +260,76 @@ eblob_t::items_count() {
 
 unsigned long long
 eblob_t::alive_items_count() {
-	m_alive_items_count = 0;
+	return stats().alive_items;
+}
 
-	if (!m_storage) {
-		std::string error_msg = "empty eblob storage object at " + std::string(BOOST_CURRENT_FUNCTION);
-		throw internal_error(error_msg);
+eblob_t::stats_t
+eblob_t::stats() {
+	boost::mutex::scoped_lock lock(m_stats_mutex);
+	return m_stats;
+}
+
+boost::mutex&
+eblob_t::key_lock(const std::string& key) {
+	return m_key_locks[boost::hash<std::string>()(key) % key_locks_count];
+}
+
+bool
+eblob_t::record_size(const eblob_key& ekey, uint64_t& size) {
+	int fd = -1;
+	uint64_t offset = 0;
+
+	// index lookup only, record isn't read
+	return (m_storage->read(ekey, &fd, &offset, &size, EBLOB_TYPE_DATA) >= 0);
+}
+
+void
+eblob_t::update_stats(bool existed, uint64_t old_size, bool exists, uint64_t new_size) {
+	if (!existed && !exists) {
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(m_stats_mutex);
+
+	if (existed) {
+		--m_stats.alive_items;
+		m_stats.alive_bytes -= old_size;
+	}
+
+	if (exists) {
+		++m_stats.alive_items;
+		m_stats.alive_bytes += new_size;
 	}
+}
 
-	m_iteration_callback = boost::bind(&eblob_t::counting_iteration_callback, this, _1, _2, _3, _4);
+void
+eblob_t::scan_at_open() {
+	open_scan_t scan;
 
 	eblob_iterate_control ctl;
-    memset(&ctl, 0, sizeof(ctl));
+	memset(&ctl, 0, sizeof(ctl));
 
-    ctl.priv = this;
-    ctl.iterator_cb.iterator = &eblob_t::iteration_callback;
-    ctl.thread_num = m_thread_pool_size;
+	ctl.priv = &scan;
+	ctl.iterator_cb.iterator = &eblob_t::scan_callback;
+	ctl.thread_num = m_thread_pool_size;
 
-    m_storage->iterate(ctl);
+	m_storage->iterate(ctl);
 
-    return m_alive_items_count;
+	// spilled data of non-persistent messages lives in other columns and is
+	// owned by messages of previous run, nobody reads it after restart
+	for (size_t i = 0; i < scan.spilled.size(); ++i) {
+		m_storage->remove(scan.spilled[i].first, scan.spilled[i].second);
+	}
+
+	boost::mutex::scoped_lock lock(m_stats_mutex);
+	m_stats = scan.stats;
+
+	log("eblob at path: %s has %llu alive items, %llu bytes.", m_path.c_str(), scan.stats.alive_items, scan.stats.alive_bytes);
+
+	if (!scan.spilled.empty()) {
+		log("eblob at path: %s purged %llu spilled records of previous run.", m_path.c_str(),
+			static_cast<unsigned long long>(scan.spilled.size()));
+	}
 }
 
 void
@@ -162,12 +338,22 @@ eblob_t::iterate(iteration_callback_t callback) {
 		return;
 	}
 
-	m_iteration_callback = callback;
+	if (!m_storage) {
+		std::string error_msg = "empty eblob storage object at " + std::string(BOOST_CURRENT_FUNCTION);
+		throw internal_error(error_msg);
+	}
+
+	run_iteration(callback);
+}
 
+void
+eblob_t::run_iteration(iteration_callback_t& callback) {
+	// callback is passed to iteration threads with each record, not kept in eblob_t,
+	// so several iterations may run at once
 	eblob_iterate_control ctl;
     memset(&ctl, 0, sizeof(ctl));
 
-    ctl.priv = this;
+    ctl.priv = &callback;
     ctl.iterator_cb.iterator = &eblob_t::iteration_callback;
     ctl.thread_num = m_thread_pool_size;
 
@@ -208,30 +394,31 @@ eblob_t::iteration_callback(eblob_disk_control* dc,
 							void* priv,
 							__attribute__ ((unused)) void* thread_priv)
 {
-	eblob_t* eb = reinterpret_cast<eblob_t*>(priv);
-	eb->iteration_callback_instance((char*)dc->key.id, data, rc->size, rc->type);
+	iteration_callback_t* callback = reinterpret_cast<iteration_callback_t*>(priv);
+	(*callback)((char*)dc->key.id, data, rc->size, rc->type);
 
 	return 0;
 }
 
-void
-eblob_t::iteration_callback_instance(const std::string& key,
-									 void* data,
-									 uint64_t size,
-									 int column)
+int
+eblob_t::scan_callback(eblob_disk_control* dc,
+					   eblob_ram_control* rc,
+					   __attribute__ ((unused)) void* data,
+					   void* priv,
+					   __attribute__ ((unused)) void* thread_priv)
 {
-	if (m_iteration_callback) {
-		m_iteration_callback(key, data, size, column);
+	open_scan_t* scan = reinterpret_cast<open_scan_t*>(priv);
+	boost::mutex::scoped_lock lock(scan->mutex);
+
+	if (rc->type != EBLOB_TYPE_DATA) {
+		scan->spilled.push_back(std::make_pair(dc->key, rc->type));
+		return 0;
 	}
-}
 
-void
-eblob_t::counting_iteration_callback(const std::string& key,
-									 void* data,
-									 uint64_t size,
-									 int column)
-{
-	++m_alive_items_count;
+	++scan->stats.alive_items;
+	scan->stats.alive_bytes += rc->size;
+
+	return 0;
 }
 
 } // namespace dealer
@@ -0,0 +1,265 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "cocaine/dealer/storage/eblob_journal.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+namespace {
+	// failures are kept for waiters, oldest are evicted past that
+	const size_t max_failed_entries = 10000;
+}
+
+eblob_journal_t::eblob_journal_t(const boost::shared_ptr<base_logger_t>& logger,
+								 size_t batch_size,
+								 int batch_timeout) :
+	m_logger(logger),
+	m_batch_size(std::max(batch_size, static_cast<size_t>(1))),
+	m_batch_timeout(batch_timeout),
+	m_queued(0),
+	m_written(0),
+	m_evicted_failure(0),
+	m_batches_count(0),
+	m_waiters(0),
+	m_is_running(true)
+{
+	m_thread = boost::thread(boost::bind(&eblob_journal_t::run, this));
+}
+
+eblob_journal_t::~eblob_journal_t() {
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_is_running = false;
+	}
+
+	m_queued_cond.notify_one();
+	m_thread.join();
+}
+
+eblob_journal_t::entry_t&
+eblob_journal_t::enqueue(const boost::shared_ptr<eblob_t>& blob, const std::string& key) {
+	if (m_queue.empty()) {
+		m_oldest_queued = boost::get_system_time();
+	}
+
+	m_queue.push_back(entry_t());
+
+	entry_t& entry = m_queue.back();
+	entry.blob = blob;
+	entry.key = key;
+	entry.sequence = ++m_queued;
+
+	// writer sleeps until first entry or full batch
+	if (m_queue.size() == 1 || m_queue.size() == m_batch_size) {
+		m_queued_cond.notify_one();
+	}
+
+	return entry;
+}
+
+boost::uint64_t
+eblob_journal_t::write(const boost::shared_ptr<eblob_t>& blob,
+					   const std::string& key,
+					   std::string& value,
+					   int column)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	entry_t& entry = enqueue(blob, key);
+	entry.value.swap(value);
+	entry.column = column;
+
+	return entry.sequence;
+}
+
+boost::uint64_t
+eblob_journal_t::write(const boost::shared_ptr<eblob_t>& blob,
+					   const std::string& key,
+					   std::string& value,
+					   const data_container& data,
+					   int column)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	entry_t& entry = enqueue(blob, key);
+	entry.value.swap(value);
+	entry.data = data;
+	entry.column = column;
+
+	return entry.sequence;
+}
+
+void
+eblob_journal_t::remove_all(const boost::shared_ptr<eblob_t>& blob, const std::string& key) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	enqueue(blob, key).is_removal = true;
+}
+
+bool
+eblob_journal_t::wait(boost::uint64_t sequence) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (m_written < sequence) {
+		// waiting sender makes writer commit without waiting for timeout
+		++m_waiters;
+		m_queued_cond.notify_one();
+
+		while (m_written < sequence) {
+			m_written_cond.wait(lock);
+		}
+
+		--m_waiters;
+	}
+
+	if (m_failed.erase(sequence) > 0) {
+		return false;
+	}
+
+	// failure of this entry might have been evicted, it's reported as failed
+	// rather than risk telling sender its message is on disk
+	return (sequence > m_evicted_failure);
+}
+
+void
+eblob_journal_t::flush() {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	boost::uint64_t sequence = m_queued;
+
+	if (m_written < sequence) {
+		++m_waiters;
+		m_queued_cond.notify_one();
+
+		while (m_written < sequence) {
+			m_written_cond.wait(lock);
+		}
+
+		--m_waiters;
+	}
+}
+
+boost::uint64_t
+eblob_journal_t::batches_count() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_batches_count;
+}
+
+void
+eblob_journal_t::run() {
+	entries_t batch;
+	std::vector<boost::uint64_t> failed;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	while (true) {
+		while (m_is_running && (m_queue.empty() || (m_queue.size() < m_batch_size && m_waiters == 0))) {
+			if (m_queue.empty()) {
+				m_queued_cond.wait(lock);
+			}
+			else {
+				boost::system_time deadline = m_oldest_queued + boost::posix_time::milliseconds(m_batch_timeout);
+
+				if (!m_queued_cond.timed_wait(lock, deadline)) {
+					break;
+				}
+			}
+		}
+
+		if (m_queue.empty()) {
+			if (!m_is_running) {
+				break;
+			}
+
+			continue;
+		}
+
+		// whole queue goes in one batch, senders keep queueing meanwhile
+		batch.swap(m_queue);
+
+		lock.unlock();
+		commit(batch, failed);
+		lock.lock();
+
+		m_written = batch.back().sequence;
+		++m_batches_count;
+
+		for (size_t i = 0; i < failed.size(); ++i) {
+			m_failed.insert(failed[i]);
+		}
+
+		while (m_failed.size() > max_failed_entries) {
+			m_evicted_failure = *m_failed.begin();
+			m_failed.erase(m_failed.begin());
+		}
+
+		batch.clear();
+		failed.clear();
+
+		m_written_cond.notify_all();
+	}
+}
+
+void
+eblob_journal_t::commit(entries_t& batch, std::vector<boost::uint64_t>& failed) {
+	for (size_t i = 0; i < batch.size(); ++i) {
+		entry_t& entry = batch[i];
+
+		try {
+			if (entry.is_removal) {
+				entry.blob->remove_all(entry.key);
+			}
+			else if (entry.data.empty()) {
+				entry.blob->write(entry.key, entry.value, entry.column);
+			}
+			else {
+				struct iovec pieces[2];
+				pieces[0].iov_base = const_cast<char*>(entry.value.data());
+				pieces[0].iov_len = entry.value.size();
+				pieces[1].iov_base = entry.data.data();
+				pieces[1].iov_len = entry.data.size();
+
+				entry.blob->write(entry.key, pieces, 2, entry.column);
+			}
+		}
+		catch (const std::exception& ex) {
+			if (!entry.is_removal) {
+				failed.push_back(entry.sequence);
+			}
+
+			if (m_logger) {
+				m_logger->log(PLOG_ERROR, "journal could not %s key %s, details: %s",
+							  entry.is_removal ? "remove" : "write", entry.key.c_str(), ex.what());
+			}
+		}
+
+		// payload memory is given back as soon as it's on disk
+		std::string().swap(entry.value);
+		entry.data = data_container();
+	}
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -40,10 +40,19 @@ handle_t::handle_t(const handle_info_t& info,
 	m_endpoints(endpoints),
 	m_is_running(false),
 	m_is_connected(false),
-	m_receiving_control_socket_ok(false)
+	m_receiving_control_socket_ok(false),
+	m_balancer_poll_items(0),
+	m_batching_size(defaults_t::batching_size),
+	m_balancing_type(defaults_t::balancing_type)
 {
 	log(PLOG_DEBUG, "CREATED HANDLE " + description());
 
+	service_info_t service_info;
+	if (config()->service_info_by_name(m_info.service_alias, service_info)) {
+		m_batching_size = service_info.batching_size;
+		m_balancing_type = service_info.balancing_type;
+	}
+
 	// create message cache
 	m_message_cache.reset(new message_cache_t(context(), true));
 
@@ -55,9 +64,10 @@ handle_t::handle_t(const handle_info_t& info,
 	m_zmq_control_socket->setsockopt(ZMQ_LINGER, &timeout, sizeof(timeout));
 	m_zmq_control_socket->bind(conn_str.c_str());
 
-	// run message dispatch thread
+	// hand message dispatch over to the least loaded reactor
 	m_is_running = true;
-	m_thread = boost::thread(&handle_t::dispatch_messages, this);
+	m_reactor = context()->reactor();
+	m_reactor->attach(this);
 
 	// connect to hosts 
 	connect();
@@ -75,92 +85,164 @@ handle_t::kill() {
 
 	m_is_running = false;
 
+	// reactor thread releases balancer and control socket
+	m_reactor->detach(this);
+	m_reactor.reset();
+
 	m_zmq_control_socket->close();
 	m_zmq_control_socket.reset(NULL);
 
-	m_thread.join();
-
 	log(PLOG_DEBUG, "KILLED HANDLE " + description());
 }
 
 void
-handle_t::dispatch_messages() {	
+handle_t::start_dispatch() {
 	std::string balancer_ident = m_info.as_string() + "." + wuuid_t().generate();
-	balancer_t balancer(balancer_ident, m_endpoints, context());
+	m_balancer.reset(new balancer_t(balancer_ident, m_endpoints, context(), m_balancing_type));
 
-	socket_ptr_t control_socket;
-	establish_control_conection(control_socket);
+	establish_control_conection(m_control_socket);
 
 	log(PLOG_DEBUG, "started message dispatch for " + description());
+}
 
-	m_last_response_timer.reset();
-	m_deadlined_messages_timer.reset();
-	m_control_messages_timer.reset();
-
-	// process messages
-	while (m_is_running) {
-		// process incoming control messages every 200 msec
-		int control_message = 0;
-		              
-		if (m_control_messages_timer.elapsed().as_double() > 0.2f) {
-		      control_message = receive_control_messages(control_socket, 0);
-		      m_control_messages_timer.reset();
-		}
+void
+handle_t::stop_dispatch() {
+	m_balancer.reset();
+	m_control_socket.reset();
+	m_is_connected = false;
 
-		if (control_message == CONTROL_MESSAGE_KILL) {
-			// stop message dispatch, finalize everything
-			m_is_running = false;
-			break;
-		}
-		else if (control_message > 0) {
-			dispatch_control_messages(control_message, balancer);
+	log(PLOG_DEBUG, "finished message dispatch for " + description());
+}
+
+void
+handle_t::poll_items(std::vector<zmq_pollitem_t>& items) {
+	// control socket, wakeup fd and balancer sockets
+	zmq_pollitem_t item;
+
+	item.socket = *m_control_socket;
+	item.fd = 0;
+	item.events = ZMQ_POLLIN;
+	item.revents = 0;
+	items.push_back(item);
+
+	item.socket = NULL;
+	item.fd = m_wakeup.fd();
+	item.events = ZMQ_POLLIN;
+	item.revents = 0;
+	items.push_back(item);
+
+	// one item per endpoint socket
+	size_t first_item = items.size();
+	m_balancer_poll_items = m_balancer->poll_items(items);
+
+	if (!m_is_connected) {
+		for (size_t i = first_item; i < items.size(); ++i) {
+			items[i].events = 0;
 		}
+	}
+}
 
-		// send new message if any
-		if (m_is_running && m_is_connected) {
-			for (int i = 0; i < 100; ++i) { // batching
-				if (m_message_cache->new_messages_count() == 0) {
-					break;	
-				}
+void
+handle_t::process_events(const zmq_pollitem_t* items) {
+	if (!m_is_running) {
+		return;
+	}
+
+	balancer_t& balancer = *m_balancer;
+
+	// process incoming control messages
+	if ((ZMQ_POLLIN & items[0].revents) == ZMQ_POLLIN) {
+		int control_message = receive_control_message(m_control_socket);
 
-				dispatch_next_available_message(balancer);
+		while (control_message > 0) {
+			if (control_message == CONTROL_MESSAGE_KILL) {
+				// stop message dispatch, reactor lets us go on kill()
+				m_is_running = false;
+				return;
 			}
+
+			dispatch_control_messages(control_message, balancer);
+			control_message = receive_control_message(m_control_socket);
 		}
+	}
 
-		// check for message responces
-		bool received_response = false;
+	// new messages were enqueued
+	if ((ZMQ_POLLIN & items[1].revents) == ZMQ_POLLIN) {
+		m_wakeup.drain();
+	}
 
-		int fast_poll_timeout = 30;		  // microsecs
-		int long_poll_timeout = 300000;   // microsecs
+	// send new messages if any
+	if (m_is_connected) {
+		dispatch_next_available_messages(balancer);
+	}
 
-		int response_poll_timeout = fast_poll_timeout;
-		if (m_last_response_timer.elapsed().as_double() > 5.0f) {
-			response_poll_timeout = long_poll_timeout;
-		}
+	// process received responce(s)
+	bool has_responses = false;
 
-		if (m_is_connected && m_is_running) {
-			received_response = balancer.check_for_responses(response_poll_timeout);
+	for (size_t i = 0; i < m_balancer_poll_items && !has_responses; ++i) {
+		has_responses = ((ZMQ_POLLIN & items[2 + i].revents) == ZMQ_POLLIN);
+	}
 
-			// process received responce(s)
-			while (received_response) {
-				m_last_response_timer.reset();
-				response_poll_timeout = fast_poll_timeout;
+	if (m_is_connected && has_responses) {
+		// don't starve other handles, level-triggered poll
+		// brings us back here at once if anything is left
+		for (int i = 0; i < responses_batch_size; ++i) {
+			dispatch_next_available_response(balancer);
 
-				dispatch_next_available_response(balancer);
-				received_response = balancer.check_for_responses(response_poll_timeout);
+			if (!balancer.check_for_responses(0)) {
+				break;
 			}
 		}
+	}
 
-		if (m_is_running) {
-			if (m_deadlined_messages_timer.elapsed().as_double() > 1.0f) {
-				process_deadlined_messages();
-				m_deadlined_messages_timer.reset();
-			}
+	// single clock read per pass, expirations are kept sorted by cache
+	time_value next_expiration = m_message_cache->next_expiration_time();
+
+	if (next_expiration.empty() && m_hedge_timers.empty()) {
+		return;
+	}
+
+	time_value now = time_value::get_current_time();
+
+	if (!next_expiration.empty() && !(now < next_expiration)) {
+		process_deadlined_messages(now);
+	}
+
+	if (m_is_connected && !m_hedge_timers.empty() && m_hedge_timers.next_deadline() <= now.as_double()) {
+		process_hedges(balancer, now);
+	}
+}
+
+long
+handle_t::next_poll_timeout() {
+	// there are still messages to send, don't block
+	if (m_is_connected && m_message_cache->new_messages_count() > 0) {
+		return 0;
+	}
+
+	// sleep until earliest message expiration or hedge, if any
+	time_value next_expiration = m_message_cache->next_expiration_time();
+
+	if (!m_hedge_timers.empty()) {
+		time_value next_hedge(m_hedge_timers.next_deadline());
+
+		if (next_expiration.empty() || next_hedge < next_expiration) {
+			next_expiration = next_hedge;
 		}
 	}
 
-	control_socket.reset();
-	log(PLOG_DEBUG, "finished message dispatch for " + description());
+	if (next_expiration.empty()) {
+		return -1;
+	}
+
+	double timeout = next_expiration.as_double() - time_value::get_current_time().as_double();
+
+	if (timeout <= 0.0) {
+		return 0;
+	}
+
+	// zmq 2.x poll timeout is in microseconds
+	return static_cast<long>(timeout * 1000000.0) + 1;
 }
 
 void
@@ -180,8 +262,7 @@ handle_t::remove_from_persistent_storage(const boost::shared_ptr<response_chunk_
 	}
 
 	// remove message from eblob
-	boost::shared_ptr<eblob_t> eb = context()->storage()->get_eblob(sent_msg->path().service_alias);
-	eb->remove_all(response->uuid);
+	context()->storage()->remove_all(sent_msg->path().service_alias, response->uuid.as_string());
 }
 
 void
@@ -194,10 +275,33 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 
 	boost::shared_ptr<message_iface> sent_msg;
 
+	// responses to messages which may be hedged
+	hedge_t* hedge = NULL;
+
+	if (!m_hedges.empty()) {
+		hedges_map_t::iterator it = m_hedges.find(response->uuid);
+
+		if (it != m_hedges.end()) {
+			hedge = &it->second;
+
+			if (response->rpc_code != SERVER_RPC_MESSAGE_ACK) {
+				if (!resolve_hedge(*hedge, response)) {
+					return;
+				}
+
+				// losing copy keeps running at the node, its responses are dropped here
+				if (!hedge->winner.empty() && response->route != hedge->winner) {
+					return;
+				}
+			}
+		}
+	}
+
 	switch (response->rpc_code) {
 		case SERVER_RPC_MESSAGE_ACK:		
 			if (m_message_cache->get_sent_message(response->route, response->uuid, sent_msg)) {
 				sent_msg->set_ack_received(true);
+				balancer.ack_received(response->route, copy_sent_timestamp(sent_msg, hedge, response->route));
 			}
 		break;
 
@@ -208,8 +312,20 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 		case SERVER_RPC_MESSAGE_CHOKE:
 			enqueue_response(response);
 
-			remove_from_persistent_storage(response);
-			m_message_cache->remove_message_from_cache(response->route, response->uuid);
+			// losing copy finishes while winner may still be streaming
+			if (!hedge || hedge->winner == response->route) {
+				remove_from_persistent_storage(response);
+			}
+
+			sent_msg = m_message_cache->remove_message_from_cache(response->route, response->uuid);
+
+			if (sent_msg) {
+				balancer.response_received(response->route, copy_sent_timestamp(sent_msg, hedge, response->route));
+			}
+
+			if (hedge && hedge->winner == response->route) {
+				m_hedges.erase(response->uuid);
+			}
 		break;
 		
 		case SERVER_RPC_MESSAGE_ERROR: {
@@ -217,7 +333,7 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 			if (response->error_code == resource_error) {
 				if (m_message_cache->reshedule_message(response->route, response->uuid)) {
 					if (log_flag_enabled(PLOG_WARNING)) {
-						std::string message_str = "resheduled message with uuid: " + response->uuid;
+						std::string message_str = "resheduled message with uuid: " + response->uuid.as_string();
 						message_str += " from " + description() + ", reason: error received, error code: %d";
 						message_str += ", error message: " + response->error_message;
 						log(PLOG_WARNING, message_str, response->error_code);
@@ -227,11 +343,18 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 			else {
 				enqueue_response(response);
 
-				remove_from_persistent_storage(response);
+				if (!hedge || hedge->winner == response->route) {
+					remove_from_persistent_storage(response);
+				}
+
 				m_message_cache->remove_message_from_cache(response->route, response->uuid);
 
+				if (hedge && hedge->winner == response->route) {
+					m_hedges.erase(response->uuid);
+				}
+
 				if (log_flag_enabled(PLOG_ERROR)) {
-					std::string message_str = "error received for message with uuid: " + response->uuid;	
+					std::string message_str = "error received for message with uuid: " + response->uuid.as_string();	
 					message_str += " from " + description() + ", error code: %d";
 					message_str += ", error message: " + response->error_message;
 					log(PLOG_ERROR, message_str, response->error_code);
@@ -247,7 +370,7 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 			m_message_cache->remove_message_from_cache(response->route, response->uuid);
 
 			if (log_flag_enabled(PLOG_ERROR)) {
-				std::string message_str = "unknown RPC code received for message with uuid: " + response->uuid;
+				std::string message_str = "unknown RPC code received for message with uuid: " + response->uuid.as_string();
 				message_str += " from " + description() + ", code: %d";
 				message_str += ", error message: " + response->error_message;
 				log(PLOG_ERROR, message_str, response->error_code);
@@ -310,10 +433,10 @@ handle_t::messages_cache() const {
 }
 
 void
-handle_t::process_deadlined_messages() {
+handle_t::process_deadlined_messages(const time_value& now) {
 	assert(m_message_cache);
 	message_cache_t::message_queue_t expired_messages;
-	m_message_cache->get_expired_messages(expired_messages);
+	m_message_cache->get_expired_messages(now, expired_messages);
 
 	if (expired_messages.empty()) {
 		return;
@@ -324,13 +447,22 @@ handle_t::process_deadlined_messages() {
 	std::string curr_timestamp_str;
 
 	for (size_t i = 0; i < expired_messages.size(); ++i) {
+		// first copy of hedged message got no ack, the other one carries on
+		if (!m_hedges.empty() && continue_hedge(expired_messages.at(i), now)) {
+			continue;
+		}
+
 		if (log_flag_enabled(PLOG_WARNING) || log_flag_enabled(PLOG_ERROR)) {
 			enqued_timestamp_str = expired_messages.at(i)->enqued_timestamp().as_string();
 			sent_timestamp_str = expired_messages.at(i)->sent_timestamp().as_string();
-			curr_timestamp_str = time_value::get_current_time().as_string();
+			curr_timestamp_str = now.as_string();
 		}
 
-		if (!expired_messages.at(i)->ack_received()) {
+		// unsent messages and messages past their deadline are never resent
+		if (expired_messages.at(i)->is_sent() &&
+			!expired_messages.at(i)->ack_received() &&
+			!is_deadline_reached(expired_messages.at(i), now))
+		{
 			if (expired_messages.at(i)->can_retry()) {
 				expired_messages.at(i)->increment_retries_count();
 				m_message_cache->enqueue_with_priority(expired_messages.at(i));
@@ -339,7 +471,7 @@ handle_t::process_deadlined_messages() {
 					std::string log_str = "no ACK, resheduled message %s, (enqued: %s, sent: %s, curr: %s)";
 
 					log(PLOG_WARNING, log_str,
-						expired_messages.at(i)->uuid().c_str(),
+						expired_messages.at(i)->uuid().as_string().c_str(),
 						enqued_timestamp_str.c_str(),
 						sent_timestamp_str.c_str(),
 						curr_timestamp_str.c_str());
@@ -358,7 +490,7 @@ handle_t::process_deadlined_messages() {
 					log_str += "for %s, (enqued: %s, sent: %s, curr: %s)";
 
 					log(PLOG_WARNING, log_str,
-						expired_messages.at(i)->uuid().c_str(),
+						expired_messages.at(i)->uuid().as_string().c_str(),
 						enqued_timestamp_str.c_str(),
 						sent_timestamp_str.c_str(),
 						curr_timestamp_str.c_str());
@@ -378,7 +510,7 @@ handle_t::process_deadlined_messages() {
 
 				log(PLOG_ERROR,
 					log_str,
-					expired_messages.at(i)->uuid().c_str(),
+					expired_messages.at(i)->uuid().as_string().c_str(),
 					enqued_timestamp_str.c_str(),
 					sent_timestamp_str.c_str(),
 					curr_timestamp_str.c_str());
@@ -387,6 +519,169 @@ handle_t::process_deadlined_messages() {
 	}
 }
 
+void
+handle_t::track_hedge(const boost::shared_ptr<message_iface>& message, const std::string& route) {
+	hedge_t hedge;
+	hedge.route = route;
+	hedge.hedge_after = message->policy().hedge_after;
+	hedge.next_check = message->sent_timestamp().as_double() + hedge.hedge_after;
+
+	// resent message replaces its previous hedge, old timer goes stale
+	m_hedges[message->uuid()] = hedge;
+	m_hedge_timers.push(hedge.next_check, message->uuid(), stale_hedge_timer_t(m_hedges));
+}
+
+void
+handle_t::process_hedges(balancer_t& balancer, const time_value& now) {
+	double now_secs = now.as_double();
+	wuuid_t uuid;
+
+	while (m_hedge_timers.pop_due(now_secs, uuid)) {
+		hedges_map_t::iterator it = m_hedges.find(uuid);
+
+		if (it == m_hedges.end() || it->second.next_check > now_secs) {
+			continue;
+		}
+
+		hedge_t& hedge = it->second;
+
+		// no response started in time, duplicate message to another route
+		if (hedge.winner.empty() && hedge.hedge_route.empty()) {
+			boost::shared_ptr<message_iface> message;
+			cocaine_endpoint_t endpoint;
+
+			if (!m_message_cache->get_sent_message(hedge.route, uuid, message) ||
+				message->is_discarded() ||
+				is_deadline_reached(message, now) ||
+				!balancer.send_hedge(message, hedge.route, endpoint))
+			{
+				m_hedges.erase(it);
+				continue;
+			}
+
+			m_message_cache->add_sent_copy(message, endpoint.route, now);
+			hedge.hedge_route = endpoint.route;
+			hedge.hedge_sent = now;
+
+			if (log_flag_enabled(PLOG_DEBUG)) {
+				log(PLOG_DEBUG, "hedged msg with uuid: %s to route: %s (first route: %s)",
+					uuid.as_string().c_str(), hedge.hedge_route.c_str(), hedge.route.c_str());
+			}
+		}
+		else if (!is_hedge_alive(hedge, uuid)) {
+			m_hedges.erase(it);
+			continue;
+		}
+
+		// keep an eye on the message until it's done or lost
+		hedge.next_check = now_secs + std::max(hedge.hedge_after, hedge_recheck_interval / 1000.0);
+		m_hedge_timers.push(hedge.next_check, uuid, stale_hedge_timer_t(m_hedges));
+	}
+}
+
+bool
+handle_t::resolve_hedge(hedge_t& hedge, const boost::shared_ptr<response_chunk_t>& response) {
+	if (!hedge.winner.empty()) {
+		return true;
+	}
+
+	// response started in time, nothing to race with
+	if (hedge.hedge_route.empty()) {
+		hedge.winner = response->route;
+		return true;
+	}
+
+	if (response->route != hedge.route && response->route != hedge.hedge_route) {
+		return true;
+	}
+
+	const std::string& loser = (response->route == hedge.route) ? hedge.hedge_route : hedge.route;
+
+	// one of copies was refused, the other one carries on
+	if (response->rpc_code == SERVER_RPC_MESSAGE_ERROR && response->error_code == resource_error) {
+		m_message_cache->remove_message_from_cache(response->route, response->uuid);
+		hedge.winner = loser;
+		return false;
+	}
+
+	// cocaine can't cancel a running job, we only stop tracking the loser
+	hedge.winner = response->route;
+	m_message_cache->remove_message_from_cache(loser, response->uuid);
+
+	if (log_flag_enabled(PLOG_DEBUG)) {
+		log(PLOG_DEBUG, "hedged msg with uuid: %s answered by route: %s",
+			response->uuid.as_string().c_str(), hedge.winner.c_str());
+	}
+
+	return true;
+}
+
+bool
+handle_t::is_hedge_alive(const hedge_t& hedge, const wuuid_t& uuid) {
+	boost::shared_ptr<message_iface> message;
+
+	if (m_message_cache->get_sent_message(hedge.route, uuid, message)) {
+		return true;
+	}
+
+	return (!hedge.hedge_route.empty() &&
+			m_message_cache->get_sent_message(hedge.hedge_route, uuid, message));
+}
+
+bool
+handle_t::continue_hedge(const boost::shared_ptr<message_iface>& message, const time_value& now) {
+	hedges_map_t::iterator it = m_hedges.find(message->uuid());
+
+	if (it == m_hedges.end()) {
+		return false;
+	}
+
+	hedge_t& hedge = it->second;
+	boost::shared_ptr<message_iface> copy;
+
+	// ack timeouts are tracked for the first copy only
+	if (!hedge.hedge_route.empty() &&
+		hedge.winner.empty() &&
+		!is_deadline_reached(message, now) &&
+		m_message_cache->get_sent_message(hedge.hedge_route, message->uuid(), copy))
+	{
+		message->set_discarded(false);
+		hedge.winner = hedge.hedge_route;
+		return true;
+	}
+
+	// message is resent or reported as failed, stale copy must go
+	if (!hedge.hedge_route.empty()) {
+		m_message_cache->remove_message_from_cache(hedge.hedge_route, message->uuid());
+	}
+
+	m_hedges.erase(it);
+	return false;
+}
+
+const time_value&
+handle_t::copy_sent_timestamp(const boost::shared_ptr<message_iface>& message,
+							  const hedge_t* hedge,
+							  const std::string& route)
+{
+	if (hedge && !hedge->hedge_route.empty() && route == hedge->hedge_route) {
+		return hedge->hedge_sent;
+	}
+
+	return message->sent_timestamp();
+}
+
+bool
+handle_t::is_deadline_reached(const boost::shared_ptr<message_iface>& message, const time_value& now) {
+	double deadline = message->policy().deadline;
+
+	if (deadline <= 0.0) {
+		return false;
+	}
+
+	return now.distance(message->enqued_timestamp()) >= deadline;
+}
+
 void
 handle_t::establish_control_conection(socket_ptr_t& control_socket) {
 	control_socket.reset(new zmq::socket_t(*(context()->zmq_context()), ZMQ_PAIR));
@@ -409,42 +704,21 @@ handle_t::enqueue_response(boost::shared_ptr<response_chunk_t>& response) {
 }
 
 int
-handle_t::receive_control_messages(socket_ptr_t& control_socket, int poll_timeout) {
+handle_t::receive_control_message(socket_ptr_t& control_socket) {
 	if (!m_is_running) {
 		return 0;
 	}
 
-	// poll for responce
-	zmq_pollitem_t poll_items[1];
-	poll_items[0].socket = *control_socket;
-	poll_items[0].fd = 0;
-	poll_items[0].events = ZMQ_POLLIN;
-	poll_items[0].revents = 0;
-
-	int socket_response = zmq_poll(poll_items, 1, poll_timeout);
-
-	if (socket_response <= 0) {
-		return 0;
-	}
-
-	// in case we received control message
-    if ((ZMQ_POLLIN & poll_items[0].revents) != ZMQ_POLLIN) {
-    	return 0;
-    }
-
 	int received_message = 0;
-
-	bool recv_failed = false;
 	zmq::message_t reply;
 
 	try {
-		if (!control_socket->recv(&reply)) {
-			recv_failed = true;
-		}
-		else {
-			memcpy((void *)&received_message, reply.data(), reply.size());
-			return received_message;
+		if (!control_socket->recv(&reply, ZMQ_NOBLOCK)) {
+			return 0;
 		}
+
+		memcpy((void *)&received_message, reply.data(), reply.size());
+		return received_message;
 	}
 	catch (const std::exception& ex) {
 		std::string error_msg = "some very ugly shit happend while recv on control socket at ";
@@ -453,45 +727,68 @@ handle_t::receive_control_messages(socket_ptr_t& control_socket, int poll_timeou
 		throw internal_error(error_msg);
 	}
 
-    if (recv_failed) {
-    	log(PLOG_ERROR, "control socket recv failed on " + description());
-    }
-
-    return 0;
+	log(PLOG_ERROR, "control socket recv failed on " + description());
+	return 0;
 }
 
-bool
-handle_t::dispatch_next_available_message(balancer_t& balancer) {
-	// send new message if any
-	if (m_message_cache->new_messages_count() == 0) {
-		return false;
+size_t
+handle_t::dispatch_next_available_messages(balancer_t& balancer) {
+	if (m_message_cache->take_new_messages(m_batching_size, m_batch) == 0) {
+		return 0;
+	}
+
+	// load aware balancing needs fresh count of messages awaiting response
+	if (balancer.uses_in_flight()) {
+		m_message_cache->sent_messages_counts(balancer.endpoints(), m_in_flight);
+		balancer.set_in_flight(m_in_flight);
 	}
 
-	boost::shared_ptr<message_iface> new_msg = m_message_cache->get_new_message();
-	cocaine_endpoint_t endpoint;
-	if (balancer.send(new_msg, endpoint)) {
-		new_msg->mark_as_sent(true);
-		m_message_cache->move_new_message_to_sent(endpoint.route);
+	size_t sent_count = 0;
+
+	try {
+		sent_count = balancer.send_batch(m_batch, m_batch_routes);
+	}
+	catch (...) {
+		m_message_cache->return_new_messages(m_batch, 0);
+		m_batch.clear();
+		throw;
+	}
+
+	for (size_t i = 0; i < sent_count; ++i) {
+		m_batch[i]->mark_as_sent(true);
+	}
 
-		if (log_flag_enabled(PLOG_DEBUG)) {
-			std::string log_msg = "sent msg with uuid: %s to endpoint: %s with route: %s (%s)";
-			std::string sent_timestamp_str = new_msg->sent_timestamp().as_string();
+	m_message_cache->move_messages_to_sent(m_batch, m_batch_routes, sent_count);
+
+	for (size_t i = 0; i < sent_count; ++i) {
+		if (m_batch[i]->policy().hedge_after > 0.0) {
+			track_hedge(m_batch[i], m_batch_routes[i]);
+		}
+	}
+
+	// socket refused the rest, retry them on next pass
+	if (sent_count < m_batch.size()) {
+		m_message_cache->return_new_messages(m_batch, sent_count);
+		log(PLOG_ERROR, "dispatch_next_available_messages failed, sent %d of %d", sent_count, m_batch.size());
+	}
+
+	if (log_flag_enabled(PLOG_DEBUG)) {
+		for (size_t i = 0; i < sent_count; ++i) {
+			std::string log_msg = "sent msg with uuid: %s to route: %s (%s)";
+			std::string sent_timestamp_str = m_batch[i]->sent_timestamp().as_string();
 
 			log(PLOG_DEBUG,
 				log_msg.c_str(),
-				new_msg->uuid().c_str(),
-				endpoint.endpoint.c_str(),
-				description().c_str(),
+				m_batch[i]->uuid().as_string().c_str(),
+				m_batch_routes[i].c_str(),
 				sent_timestamp_str.c_str());
 		}
-
-		return true;
-	}
-	else {
-		log(PLOG_ERROR, "dispatch_next_available_message failed");		
 	}
 
-	return false;
+	// don't keep references to sent messages
+	m_batch.clear();
+
+	return sent_count;
 }
 
 const handle_info_t&
@@ -550,6 +847,7 @@ void
 handle_t::assign_message_queue(const message_cache_t::message_queue_ptr_t& message_queue) {
 	assert (m_message_cache);
 	m_message_cache->append_message_queue(message_queue);
+	m_wakeup.notify();
 }
 
 void
@@ -561,6 +859,7 @@ handle_t::set_responce_callback(responce_callback_t callback) {
 void
 handle_t::enqueue_message(const boost::shared_ptr<message_iface>& message) {
 	m_message_cache->enqueue(message);
+	m_wakeup.notify();
 }
 
 } // namespace dealer
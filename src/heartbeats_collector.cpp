@@ -200,6 +200,10 @@ heartbeats_collector_t::process_alive_endpoints() {
 			cocaine_node_app_info_t::application_tasks::const_iterator task_it = app.tasks.begin();
 			for (; task_it != app.tasks.end(); ++task_it) {
 				cocaine_endpoint_t ce(task_it->second.endpoint, task_it->second.route);
+				ce.backlog = task_it->second.backlog;
+				ce.queue_depth = app.queue_depth;
+				ce.slaves_busy = app.slaves_busy;
+				ce.slaves_total = app.slaves_total;
 				
 				handles_endpoints_t::iterator hit = handles_endpoints.find(task_it->second.name);
 				if (hit != handles_endpoints.end()) {
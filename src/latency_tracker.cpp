@@ -0,0 +1,245 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#include "cocaine/dealer/core/latency_tracker.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+void
+latency_tracker_t::peak_ewma_t::observe(double value, double now) {
+	double elapsed = std::max(now - stamp, 0.0);
+	double weight = exp(-elapsed / (decay_time / 1000.0));
+
+	if (value > cost) {
+		cost = value;
+	}
+	else {
+		cost = cost * weight + value * (1.0 - weight);
+	}
+
+	stamp = now;
+	++samples;
+}
+
+double
+latency_tracker_t::peak_ewma_t::value(double now) const {
+	// idle routes slowly lose their cost, so they get retried
+	double elapsed = std::max(now - stamp, 0.0);
+	return cost * exp(-elapsed / (decay_time / 1000.0));
+}
+
+void
+latency_tracker_t::peak_ewma_t::reset(double value, double now) {
+	cost = value;
+	stamp = now;
+	samples = 1;
+}
+
+const latency_tracker_t::peak_ewma_t&
+latency_tracker_t::route_t::cost_source() const {
+	// response latency covers processing time, ack latency is used until
+	// first response arrives
+	return (response.samples > 0) ? response : ack;
+}
+
+double
+latency_tracker_t::route_t::cost(double now) const {
+	return cost_source().value(now);
+}
+
+latency_tracker_t::latency_tracker_t() {
+}
+
+void
+latency_tracker_t::ack_received(const std::string& route, double latency, double now) {
+	route_t& r = m_routes[route];
+	r.ack.observe(latency, now);
+	sample_received(r, r.ack, latency, now);
+}
+
+void
+latency_tracker_t::response_received(const std::string& route, double latency, double now) {
+	route_t& r = m_routes[route];
+	r.response.observe(latency, now);
+	sample_received(r, r.response, latency, now);
+}
+
+void
+latency_tracker_t::sample_received(route_t& route, const peak_ewma_t& source, double latency, double now) {
+	if (route.state != RS_PROBING || &source != &route.cost_source()) {
+		return;
+	}
+
+	if (latency > route.threshold) {
+		eject(route, route.threshold, now);
+		return;
+	}
+
+	// probe succeeded, forget latency history which got route ejected
+	route.state = RS_HEALTHY;
+	route.healthy_since = now;
+
+	if (&source == &route.response) {
+		route.response.reset(latency, now);
+	}
+	else {
+		route.ack.reset(latency, now);
+	}
+}
+
+void
+latency_tracker_t::probe_sent(const std::string& route, double now) {
+	routes_map_t::iterator it = m_routes.find(route);
+
+	if (it == m_routes.end() || it->second.state != RS_PROBE_READY) {
+		return;
+	}
+
+	it->second.state = RS_PROBING;
+	it->second.probe_sent_at = now;
+}
+
+size_t
+latency_tracker_t::update(const std::vector<cocaine_endpoint_t>& endpoints, double now, endpoint_loads_t& loads) {
+	loads.resize(endpoints.size());
+	m_costs.clear();
+
+	size_t ejected_count = 0;
+	size_t newly_ejected = 0;
+
+	for (size_t i = 0; i < endpoints.size(); ++i) {
+		route_t& route = m_routes[endpoints[i].route];
+
+		switch (route.state) {
+			case RS_EJECTED:
+				if (now >= route.ejected_until) {
+					route.state = RS_PROBE_READY;
+				}
+				break;
+
+			case RS_PROBING:
+				// probe got lost or takes too long
+				if (now - route.probe_sent_at >= ejection_time(route)) {
+					eject(route, route.threshold, now);
+					++newly_ejected;
+				}
+				break;
+
+			case RS_HEALTHY:
+				if (route.ejections > 0 && now - route.healthy_since >= max_ejection_time / 1000.0) {
+					route.ejections = 0;
+				}
+
+				if (route.cost_source().samples >= static_cast<size_t>(outlier_min_samples)) {
+					m_costs.push_back(route.cost(now));
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		if (route.state != RS_HEALTHY) {
+			++ejected_count;
+		}
+	}
+
+	// outliers are only detected against other measured routes
+	if (m_costs.size() > 1) {
+		size_t median_index = (m_costs.size() - 1) / 2;
+		std::nth_element(m_costs.begin(), m_costs.begin() + median_index, m_costs.end());
+
+		double threshold = std::max(m_costs[median_index] * outlier_factor, outlier_min_latency / 1000.0);
+		size_t max_ejected = (endpoints.size() * max_ejected_percent) / 100;
+
+		for (size_t i = 0; i < endpoints.size() && ejected_count < max_ejected; ++i) {
+			route_t& route = m_routes[endpoints[i].route];
+
+			if (route.state != RS_HEALTHY ||
+				route.cost_source().samples < static_cast<size_t>(outlier_min_samples))
+			{
+				continue;
+			}
+
+			if (route.cost(now) > threshold) {
+				eject(route, threshold, now);
+				++ejected_count;
+				++newly_ejected;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < endpoints.size(); ++i) {
+		const route_t& route = m_routes[endpoints[i].route];
+
+		loads[i].latency = route.cost(now);
+		loads[i].ejected = (route.state == RS_EJECTED || route.state == RS_PROBING);
+		loads[i].probing = (route.state == RS_PROBE_READY);
+	}
+
+	return newly_ejected;
+}
+
+void
+latency_tracker_t::retain(const std::vector<cocaine_endpoint_t>& endpoints) {
+	routes_map_t::iterator it = m_routes.begin();
+
+	while (it != m_routes.end()) {
+		bool found = false;
+
+		for (size_t i = 0; i < endpoints.size() && !found; ++i) {
+			found = (endpoints[i].route == it->first);
+		}
+
+		if (found) {
+			++it;
+		}
+		else {
+			it = m_routes.erase(it);
+		}
+	}
+}
+
+void
+latency_tracker_t::eject(route_t& route, double threshold, double now) {
+	// 2^16 times base ejection time is way over the cap already
+	if (route.ejections < 16) {
+		++route.ejections;
+	}
+
+	route.state = RS_EJECTED;
+	route.threshold = threshold;
+	route.ejected_until = now + ejection_time(route);
+}
+
+double
+latency_tracker_t::ejection_time(const route_t& route) {
+	int shift = (route.ejections > 0) ? route.ejections - 1 : 0;
+	double ejection_time = (base_ejection_time / 1000.0) * (1 << shift);
+
+	return std::min(ejection_time, max_ejection_time / 1000.0);
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -38,6 +38,7 @@ namespace dealer {
 message_cache_t::message_cache_t(const boost::shared_ptr<context_t>& ctx,
 							 bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
+	m_incoming(incoming_queue_size),
 	m_locked(false)
 {
 	m_type = config()->message_cache_type();
@@ -55,19 +56,45 @@ message_cache_t::new_messages() {
 		throw internal_error(error_str);
 	}
 
+	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
+
 	return m_new_messages;
 }
 
+void
+message_cache_t::drain_incoming() {
+	cached_message_ptr_t message;
+
+	while (m_incoming.pop(message)) {
+		m_new_messages->push_back(message);
+		track_deadline(message);
+	}
+}
+
 void
 message_cache_t::enqueue_with_priority(const boost::shared_ptr<message_iface>& message) {
 	boost::mutex::scoped_lock lock(m_mutex);
+
+	message->mark_as_sent(false);
+	message->set_ack_received(false);
+	message->set_discarded(false);
+
 	m_new_messages->push_front(message);
 }
 
 void
 message_cache_t::enqueue(const boost::shared_ptr<message_iface>& message) {
+	// fast path, no locking
+	if (m_incoming.push(message)) {
+		return;
+	}
+
+	// incoming queue is full, keep the order and take the slow path
 	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
 	m_new_messages->push_back(message);
+	track_deadline(message);
 }
 
 void
@@ -79,58 +106,230 @@ message_cache_t::append_message_queue(message_queue_ptr_t queue) {
 		return;
 	}
 
-	// append messages
-	m_new_messages->insert(m_new_messages->end(), queue->begin(), queue->end());
+	drain_incoming();
+
+	// append messages, expired ones were already reported
+	for (message_queue_t::iterator it = queue->begin(); it != queue->end(); ++it) {
+		if ((*it)->is_discarded()) {
+			continue;
+		}
+
+		m_new_messages->push_back(*it);
+		track_deadline(*it);
+	}
 }
 
 boost::shared_ptr<message_iface>
 message_cache_t::get_new_message() {
 	boost::mutex::scoped_lock lock(m_mutex);
+
+	// expired messages are left in queue, drop them here
+	while (!m_new_messages->empty() && m_new_messages->front()->is_discarded()) {
+		m_new_messages->pop_front();
+	}
+
+	if (m_new_messages->empty()) {
+		return cached_message_ptr_t();
+	}
+
 	return m_new_messages->front();
 }
 
+size_t
+message_cache_t::take_new_messages(size_t count, messages_batch_t& messages) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
+
+	messages.clear();
+
+	while (messages.size() < count && !m_new_messages->empty()) {
+		cached_message_ptr_t msg = m_new_messages->front();
+		m_new_messages->pop_front();
+
+		// expired messages are left in queue, drop them here
+		if (!msg->is_discarded()) {
+			messages.push_back(msg);
+		}
+	}
+
+	return messages.size();
+}
+
+void
+message_cache_t::return_new_messages(const messages_batch_t& messages, size_t offset) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	// keep original order at the front of the queue
+	for (size_t i = messages.size(); i > offset; --i) {
+		m_new_messages->push_front(messages[i - 1]);
+	}
+}
+
+message_cache_t::cached_message_ptr_t
+message_cache_t::take_oldest_new_message() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
+
+	while (!m_new_messages->empty()) {
+		cached_message_ptr_t msg = m_new_messages->front();
+		m_new_messages->pop_front();
+
+		if (!msg->is_discarded()) {
+			return msg;
+		}
+	}
+
+	return cached_message_ptr_t();
+}
+
+void
+message_cache_t::move_messages_to_sent(const messages_batch_t& messages,
+									   const std::vector<std::string>& routes,
+									   size_t count)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	int route_id = -1;
+
+	for (size_t i = 0; i < count; ++i) {
+		const cached_message_ptr_t& msg = messages[i];
+		assert(msg);
+
+		// consecutive messages mostly go to the same route
+		if (i == 0 || routes[i] != routes[i - 1]) {
+			route_id = intern_route(routes[i]);
+		}
+
+		sent_key_t key(msg->uuid(), route_id);
+		if (m_sent_messages.insert(key, msg)) {
+			++m_route_sent_counts[route_id];
+		}
+
+		track_ack_timeout(msg, route_id, msg->sent_timestamp());
+	}
+}
+
 size_t
 message_cache_t::new_messages_count() {
 	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
+
 	return m_new_messages->size();
 }
 
 size_t
 message_cache_t::sent_messages_count() {
 	boost::mutex::scoped_lock lock(m_mutex);
+	return m_sent_messages.size();
+}
 
-	size_t sent_messages_count = 0;
+void
+message_cache_t::sent_messages_counts(const std::vector<cocaine_endpoint_t>& endpoints,
+									  std::vector<size_t>& counts)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::const_iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-		sent_messages_count += it->second.size();
+	counts.resize(endpoints.size());
+
+	for (size_t i = 0; i < endpoints.size(); ++i) {
+		routes_map_t::const_iterator it = m_routes.find(endpoints[i].route);
+		counts[i] = (it == m_routes.end()) ? 0 : m_route_sent_counts[it->second];
 	}
+}
+
+int
+message_cache_t::intern_route(const std::string& route) {
+	routes_map_t::iterator it = m_routes.find(route);
 
-	return sent_messages_count;
+	if (it != m_routes.end()) {
+		return it->second;
+	}
+
+	int route_id = 0;
+
+	// ids of routes gone are reused, so per-route vectors don't grow with endpoint churn
+	if (!m_free_route_ids.empty()) {
+		route_id = m_free_route_ids.back();
+		m_free_route_ids.pop_back();
+	}
+	else {
+		route_id = static_cast<int>(m_route_sent_counts.size());
+		m_route_sent_counts.push_back(0);
+	}
+
+	m_routes.insert(std::make_pair(route, route_id));
+	return route_id;
+}
+
+void
+message_cache_t::release_route(routes_map_t::iterator it) {
+	int route_id = it->second;
+	assert(m_route_sent_counts[route_id] == 0);
+
+	m_routes.erase(it);
+	m_free_route_ids.push_back(route_id);
+}
+
+void
+message_cache_t::release_all_routes() {
+	m_routes.clear();
+	m_route_sent_counts.clear();
+	m_free_route_ids.clear();
+}
+
+bool
+message_cache_t::make_sent_key(const std::string& route, const wuuid_t& uuid, sent_key_t& key) const {
+	routes_map_t::const_iterator it = m_routes.find(route);
+
+	if (it == m_routes.end()) {
+		return false;
+	}
+
+	key.route = it->second;
+	key.uuid = uuid;
+
+	return true;
+}
+
+bool
+message_cache_t::take_sent_message(const sent_key_t& key, cached_message_ptr_t& message) {
+	cached_message_ptr_t* msg = m_sent_messages.find(key);
+
+	if (!msg) {
+		return false;
+	}
+
+	if (!(*msg)) {
+		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
+	}
+
+	message = *msg;
+	m_sent_messages.erase(key);
+	--m_route_sent_counts[key.route];
+
+	return true;
 }
 
 bool
 message_cache_t::get_sent_message(const std::string& route,
-								const std::string& uuid,
+								const wuuid_t& uuid,
 								boost::shared_ptr<message_iface>& message) {
 
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::const_iterator it = m_sent_messages.find(route);
-
-	if (it == m_sent_messages.end()) {
+	sent_key_t key;
+	if (!make_sent_key(route, uuid, key)) {
 		return false;
 	}
 
-	const sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::const_iterator mit = msg_map.find(uuid);
+	cached_message_ptr_t* msg = m_sent_messages.find(key);
 
-	if (mit == msg_map.end()) {
+	if (!msg) {
 		return false;
 	}
 
-	assert(mit->second);
-	message = mit->second;
+	assert(*msg);
+	message = *msg;
 
 	return true;
 }
@@ -142,37 +341,48 @@ message_cache_t::move_new_message_to_sent(const std::string& route) {
 	boost::shared_ptr<message_iface> msg = m_new_messages->front();
 	assert(msg);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-	if (it == m_sent_messages.end()) {
-		sent_messages_map_t msg_map;
-		msg_map.insert(std::make_pair(msg->uuid(), msg));
-		m_sent_messages[route] = msg_map;
-	}
-	else {
-		it->second.insert(std::make_pair(msg->uuid(), msg));
+	sent_key_t key(msg->uuid(), intern_route(route));
+	if (m_sent_messages.insert(key, msg)) {
+		++m_route_sent_counts[key.route];
 	}
 
+	track_ack_timeout(msg, key.route, msg->sent_timestamp());
+
 	m_new_messages->pop_front();
 }
 
-bool
-message_cache_t::reshedule_message(const std::string& route, const std::string& uuid) {
+void
+message_cache_t::add_sent_copy(const cached_message_ptr_t& message,
+							   const std::string& route,
+							   const time_value& sent_timestamp)
+{
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+	// copy left alone after first one missed its ack must expire as well
+	sent_key_t key(message->uuid(), intern_route(route));
+	if (m_sent_messages.insert(key, message)) {
+		++m_route_sent_counts[key.route];
+	}
+
+	track_ack_timeout(message, key.route, sent_timestamp);
+}
+
+bool
+message_cache_t::reshedule_message(const std::string& route, const wuuid_t& uuid) {
+	boost::mutex::scoped_lock lock(m_mutex);
 
-	if (it == m_sent_messages.end()) {
+	sent_key_t key;
+	if (!make_sent_key(route, uuid, key)) {
 		return false;
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid);
+	cached_message_ptr_t* msg_ptr = m_sent_messages.find(key);
 
-	if (mit == msg_map.end()) {
+	if (!msg_ptr) {
 		return false;
 	}
 
-	boost::shared_ptr<message_iface> msg = mit->second;
+	boost::shared_ptr<message_iface> msg = *msg_ptr;
 
 	if (!msg) {
 		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
@@ -180,7 +390,7 @@ message_cache_t::reshedule_message(const std::string& route, const std::string&
 
 	if (msg->can_retry()) {
 		msg->increment_retries_count();
-		msg_map.erase(mit);
+		take_sent_message(key, msg);
 
 		msg->mark_as_sent(false);
 		msg->set_ack_received(false);
@@ -194,30 +404,16 @@ message_cache_t::reshedule_message(const std::string& route, const std::string&
 }
 
 void
-message_cache_t::move_sent_message_to_new(const std::string& route, const std::string& uuid) {
+message_cache_t::move_sent_message_to_new(const std::string& route, const wuuid_t& uuid) {
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+	sent_key_t key;
+	boost::shared_ptr<message_iface> msg;
 
-	if (it == m_sent_messages.end()) {
+	if (!make_sent_key(route, uuid, key) || !take_sent_message(key, msg)) {
 		return;
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid);
-
-	if (mit == msg_map.end()) {
-		return;
-	}
-
-	boost::shared_ptr<message_iface> msg = mit->second;
-
-	if (!msg) {
-		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
-	}
-
-	msg_map.erase(mit);
-
 	msg->mark_as_sent(false);
 	msg->set_ack_received(false);
 
@@ -225,76 +421,68 @@ message_cache_t::move_sent_message_to_new(const std::string& route, const std::s
 }
 
 void
-message_cache_t::move_sent_message_to_new_front(const std::string& route, const std::string& uuid) {
+message_cache_t::move_sent_message_to_new_front(const std::string& route, const wuuid_t& uuid) {
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+	sent_key_t key;
+	boost::shared_ptr<message_iface> msg;
 
-	if (it == m_sent_messages.end()) {
+	if (!make_sent_key(route, uuid, key) || !take_sent_message(key, msg)) {
 		return;
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid);
-
-	if (mit == msg_map.end()) {
-		return;
-	}
-
-	boost::shared_ptr<message_iface> msg = mit->second;
-
-	if (!msg) {
-		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
-	}
-
-	msg_map.erase(mit);
 	m_new_messages->push_front(msg);
 }
 
-void
-message_cache_t::remove_message_from_cache(const std::string& route, const std::string& uuid) {
+message_cache_t::cached_message_ptr_t
+message_cache_t::remove_message_from_cache(const std::string& route, const wuuid_t& uuid) {
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+	sent_key_t key;
+	cached_message_ptr_t msg;
 
-	if (it == m_sent_messages.end()) {
-		return;
+	if (make_sent_key(route, uuid, key)) {
+		take_sent_message(key, msg);
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid);
-
-	if (mit == msg_map.end()) {
-		return;
-	}
-
-	msg_map.erase(mit);
+	return msg;
 }
 
 void
 message_cache_t::make_all_messages_new() {
 	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-
-		sent_messages_map_t& msg_map = it->second;
-		sent_messages_map_t::iterator mit = msg_map.begin();
+	for (size_t i = 0; i < m_sent_messages.capacity(); ++i) {
+		if (!m_sent_messages.is_used(i)) {
+			continue;
+		}
 
-		for (; mit != msg_map.end(); ++mit) {
+		cached_message_ptr_t& msg = m_sent_messages.value(i);
 
-			if (!mit->second) {
-				throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
-			}
+		if (!msg) {
+			throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
+		}
 
-			mit->second->mark_as_sent(false);
-			mit->second->set_ack_received(false);
-			m_new_messages->push_front(mit->second);
+		// second copy of hedged message, already moved
+		if (!msg->is_sent()) {
+			continue;
 		}
 
-		msg_map.clear();
+		msg->mark_as_sent(false);
+		msg->set_ack_received(false);
+		m_new_messages->push_front(msg);
 	}
 
+	// nothing is sent anywhere now, routes are interned again as messages go out
+	m_sent_messages.clear();
+	release_all_routes();
+
+	m_new_messages->erase(std::remove_if(m_new_messages->begin(),
+										 m_new_messages->end(),
+										 &message_cache_t::is_message_discarded),
+										 m_new_messages->end());
+
 	for (message_queue_t::iterator it = m_new_messages->begin(); it != m_new_messages->end(); ++it) {
 		(*it)->mark_as_sent(false);
 		(*it)->set_ack_received(false);
@@ -306,84 +494,154 @@ message_cache_t::make_all_messages_new_for_route(const std::string& route) {
 	log(PLOG_DEBUG, "make_all_messages_new_for_route");
 	boost::mutex::scoped_lock lock(m_mutex);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-	if (it == m_sent_messages.end()) {
+	routes_map_t::iterator it = m_routes.find(route);
+	if (it == m_routes.end()) {
 		return;
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.begin();
+	int route_id = it->second;
 
-	if (msg_map.empty()) {
+	// endpoint is gone, its route id is released once its messages are moved
+	if (m_route_sent_counts[route_id] == 0) {
+		release_route(it);
 		return;
 	}
-	
-	for (; mit != msg_map.end(); ++mit) {
-		if (!mit->second) {
-			throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
+
+	// collect keys first, erasing shifts table slots
+	std::vector<sent_key_t> keys;
+	keys.reserve(m_route_sent_counts[route_id]);
+
+	for (size_t i = 0; i < m_sent_messages.capacity(); ++i) {
+		if (m_sent_messages.is_used(i) && m_sent_messages.key(i).route == route_id) {
+			keys.push_back(m_sent_messages.key(i));
 		}
+	}
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		boost::shared_ptr<message_iface> msg;
+		take_sent_message(keys[i], msg);
 
-		mit->second->mark_as_sent(false);
-		mit->second->set_ack_received(false);
-		m_new_messages->push_front(mit->second);
+		msg->mark_as_sent(false);
+		msg->set_ack_received(false);
+		m_new_messages->push_front(msg);
 	}
 
-	msg_map.clear();
+	release_route(it);
 }
 
 bool
-message_cache_t::is_message_expired(cached_message_ptr_t msg) {
-	return msg->is_expired();
+message_cache_t::is_message_discarded(const cached_message_ptr_t& msg) {
+	return msg->is_discarded();
 }
 
 void
-message_cache_t::get_expired_messages(message_queue_t& expired_messages) {
-	boost::mutex::scoped_lock lock(m_mutex);
+message_cache_t::track_deadline(const cached_message_ptr_t& message) {
+	double deadline = message->policy().deadline;
 
-	assert(m_new_messages);
+	if (deadline <= 0.0) {
+		return;
+	}
 
-	// remove expired from sent
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-
-		sent_messages_map_t& msg_map = it->second;
-		sent_messages_map_t::iterator mit = msg_map.begin();
-
-		while (mit != msg_map.end()) {
-			// get single sent message
-			boost::shared_ptr<message_iface> msg = mit->second;
-			assert(msg);
-
-			// remove expired messages
-			if (msg->is_expired()) {
-				expired_messages.push_back(msg);
-				msg_map.erase(mit++);
-			}
-			else {
-				++mit;
-			}
+	double expiration_time = message->enqued_timestamp().as_double() + deadline;
+	expiration_time += expiration_slack / 1000.0;
+
+	m_expirations.push(expiration_time, expiration_t(message, -1), &message_cache_t::is_expiration_stale);
+}
+
+void
+message_cache_t::track_ack_timeout(const cached_message_ptr_t& message,
+								   int route,
+								   const time_value& sent_timestamp)
+{
+	double expiration_time = sent_timestamp.as_double();
+	expiration_time += (message_iface::ACK_TIMEOUT + expiration_slack) / 1000.0;
+
+	m_expirations.push(expiration_time, expiration_t(message, route), &message_cache_t::is_expiration_stale);
+}
+
+bool
+message_cache_t::is_expiration_stale(const expiration_t& expiration) {
+	cached_message_ptr_t message = expiration.message.lock();
+
+	if (!message || message->is_discarded()) {
+		return true;
+	}
+
+	// acked message never times out on ack, resent one gets a new ack timeout
+	return (expiration.route >= 0 && message->is_sent() && message->ack_received());
+}
+
+bool
+message_cache_t::take_expired_message(const expiration_t& expiration,
+									  const time_value& now,
+									  cached_message_ptr_t& message)
+{
+	message = expiration.message.lock();
+
+	// message is gone or was already reported
+	if (!message || message->is_discarded() || !message->is_expired(now)) {
+		return false;
+	}
+
+	// still waits in new messages, it's skipped when reaches the front
+	if (!message->is_sent()) {
+		return true;
+	}
+
+	const wuuid_t& uuid = message->uuid();
+
+	// ack timeout is bound to route message was sent to, stale otherwise
+	if (expiration.route >= 0) {
+		return take_sent_message(sent_key_t(uuid, expiration.route), message);
+	}
+
+	// deadline, look the message up in every route it could be sent to,
+	// hedged message has copies on two routes
+	bool taken = false;
+
+	for (size_t i = 0; i < m_route_sent_counts.size(); ++i) {
+		if (m_route_sent_counts[i] == 0) {
+			continue;
+		}
+
+		if (take_sent_message(sent_key_t(uuid, static_cast<int>(i)), message)) {
+			taken = true;
 		}
 	}
 
-	// remove expired from new
-	message_queue_t::iterator it2 = m_new_messages->begin();
-	while (it2 != m_new_messages->end()) {
-		// get single pending message
-		boost::shared_ptr<message_iface> msg = *it2;
-		assert(msg);
+	return taken;
+}
+
+void
+message_cache_t::get_expired_messages(const time_value& now, message_queue_t& expired_messages) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	assert(m_new_messages);
+	drain_incoming();
 
-		// remove expired messages
-		if (msg->is_expired()) {
+	double now_secs = now.as_double();
+	expiration_t expiration;
+
+	while (m_expirations.pop_due(now_secs, expiration)) {
+		cached_message_ptr_t msg;
+
+		if (take_expired_message(expiration, now, msg)) {
+			msg->set_discarded(true);
 			expired_messages.push_back(msg);
 		}
+	}
+}
+
+time_value
+message_cache_t::next_expiration_time() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	drain_incoming();
 
-		++it2;
+	if (m_expirations.empty()) {
+		return time_value();
 	}
 
-	m_new_messages->erase(std::remove_if(m_new_messages->begin(),
-										 m_new_messages->end(),
-										 &message_cache_t::is_message_expired),
-										 m_new_messages->end());
+	return time_value(m_expirations.next_deadline());
 }
 
 void
@@ -394,10 +652,9 @@ message_cache_t::log_stats() {
 
 	log(PLOG_DEBUG, "new messages: %d", m_new_messages->size());
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-		sent_messages_map_t& msg_map = it->second;
-		log(PLOG_DEBUG, "sent messages for route: %s, size: %d", it->first.c_str(), msg_map.size());
+	routes_map_t::const_iterator it = m_routes.begin();
+	for (; it != m_routes.end(); ++it) {
+		log(PLOG_DEBUG, "sent messages for route: %s, size: %d", it->first.c_str(), m_route_sent_counts[it->second]);
 	}
 }
 
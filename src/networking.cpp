@@ -129,5 +129,28 @@ nutils::recv_zmq_message(zmq::socket_t& sock,
     return true;
 }
 
+bool
+nutils::recv_zmq_message(zmq::socket_t& sock,
+						 zmq::message_t& msg,
+						 data_container& data,
+						 int flags)
+{
+    if (!sock.recv(&msg, flags)) {
+        return false;
+    }
+
+    // message is kept alive by data container until last reference is gone
+    zmq::message_t* owned_msg = new zmq::message_t;
+    owned_msg->move(&msg);
+
+    data.adopt_data(owned_msg->data(), owned_msg->size(), &nutils::free_zmq_message, owned_msg);
+    return true;
+}
+
+void
+nutils::free_zmq_message(__attribute__ ((unused)) void* data, void* hint) {
+    delete static_cast<zmq::message_t*>(hint);
+}
+
 } // namespace dealer
 } // namespace cocaine
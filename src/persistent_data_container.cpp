@@ -39,25 +39,44 @@ namespace dealer {
 persistent_data_container::persistent_data_container() :
 	data_in_memory_(false),
 	data_(NULL),
-	size_(0)
+	size_(0),
+	column_(EBLOB_COLUMN),
+	owns_record_(false)
 {
 }
 
 persistent_data_container::persistent_data_container(const void* data, size_t size) :
 	data_in_memory_(false),
 	data_(NULL),
-	size_(0)
+	size_(0),
+	column_(EBLOB_COLUMN),
+	owns_record_(false)
 {
 	set_data(data, size);
 }
 
-persistent_data_container::persistent_data_container(const persistent_data_container& dc)
+persistent_data_container::persistent_data_container(const persistent_data_container& dc) :
+	data_in_memory_(false),
+	data_(NULL),
+	size_(0),
+	column_(EBLOB_COLUMN),
+	owns_record_(false)
 {
 	*this = dc;
 }
 
 persistent_data_container::~persistent_data_container() {
 	unload_data();
+
+	if (!owns_record_ || !blob_) {
+		return;
+	}
+
+	try {
+		blob_->remove_all(uuid_);
+	}
+	catch (...) {
+	}
 }
 
 void
@@ -101,11 +120,23 @@ persistent_data_container::load_data() {
 
 	assert(data_ == NULL);
 
-	// read into allocated memory
-	std::string str = blob_->read(uuid_, EBLOB_COLUMN);
-	size_ = str.size();
+	if (size_ == 0) {
+		data_in_memory_ = true;
+		return;
+	}
+
+	// read from blob file straight into allocated memory
+	eblob_t::location_t location;
+
+	if (!blob_ || !blob_->locate(uuid_, location, column_) || location.size < size_) {
+		throw internal_error("no data in persistent storage for message with uuid: " + uuid_);
+	}
+
+	location.offset += location.size - size_;
+	location.size = size_;
+
 	allocate_memory();
-	memcpy(data_, str.data(), size_);
+	blob_->read(location, data_);
 
 	data_in_memory_ = true;
 }
@@ -125,6 +156,11 @@ persistent_data_container::empty() const {
 	return (size_ == 0);
 }
 
+bool
+persistent_data_container::share_data(__attribute__ ((unused)) data_container& dc) const {
+	return false;
+}
+
 void
 persistent_data_container::allocate_memory() {
 	std::string error_msg = "not enough memory to create new data container at ";
@@ -147,9 +183,10 @@ persistent_data_container::allocate_memory() {
 }
 
 void
-persistent_data_container::set_eblob(boost::shared_ptr<eblob_t> blob, const std::string& uuid) {
+persistent_data_container::set_eblob(boost::shared_ptr<eblob_t> blob, const std::string& uuid, int column) {
 	blob_ = blob;
 	uuid_ = uuid;
+	column_ = column;
 }
 
 void
@@ -157,9 +194,11 @@ persistent_data_container::init_from_message_cache(boost::shared_ptr<eblob_t> bl
 												   const std::string& uuid,
 												   int64_t data_size)
 {
+	// data is the tail of message record
 	blob_ = blob;
 	uuid_ = uuid;
 	size_ = data_size;
+	column_ = 0;
 }
 
 void
@@ -168,16 +207,20 @@ persistent_data_container::commit_data() {
 		return;
 	}
 
-	blob_->write(uuid_, data_, size_, EBLOB_COLUMN);
-	//unload_data();
-	//data_in_memory_ = false;
+	blob_->write(uuid_, data_, size_, column_);
+	owns_record_ = true;
 }
 
 persistent_data_container&
 persistent_data_container::operator = (const persistent_data_container& rhs) {
+	// copy refers to the same record but doesn't own it
 	if (this != &rhs) {
+		unload_data();
+
 		blob_ = rhs.blob_;
 		uuid_ = rhs.uuid_;
+		column_ = rhs.column_;
+		size_ = rhs.size_;
 	}
 
 	return *this;
@@ -0,0 +1,206 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <algorithm>
+#include <cerrno>
+
+#include <boost/bind.hpp>
+#include <boost/current_function.hpp>
+
+#include "cocaine/dealer/core/reactor.hpp"
+#include "cocaine/dealer/core/handle.hpp"
+#include "cocaine/dealer/utils/error.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+reactor_t::reactor_t() :
+	m_is_running(true),
+	m_handles_count(0)
+{
+	m_thread = boost::thread(boost::bind(&reactor_t::run, this));
+}
+
+reactor_t::~reactor_t() {
+	m_is_running = false;
+	m_wakeup.notify();
+	m_thread.join();
+}
+
+void
+reactor_t::attach(handle_t* handle) {
+	assert(handle);
+	assert(boost::this_thread::get_id() != m_thread.get_id());
+
+	command_t command(ATTACH_HANDLE, handle);
+	execute(command);
+}
+
+void
+reactor_t::detach(handle_t* handle) {
+	assert(handle);
+	assert(boost::this_thread::get_id() != m_thread.get_id());
+
+	command_t command(DETACH_HANDLE, handle);
+	execute(command);
+}
+
+size_t
+reactor_t::handles_count() const {
+	return m_handles_count;
+}
+
+void
+reactor_t::execute(command_t& command) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (!m_is_running) {
+		return;
+	}
+
+	m_commands.push_back(&command);
+	m_wakeup.notify();
+
+	while (!command.done) {
+		m_cond_var.wait(lock);
+	}
+}
+
+void
+reactor_t::process_commands() {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (m_commands.empty()) {
+		return;
+	}
+
+	while (!m_commands.empty()) {
+		command_t* command = m_commands.front();
+		m_commands.pop_front();
+
+		std::vector<handle_t*>::iterator it;
+		it = std::find(m_handles.begin(), m_handles.end(), command->handle);
+
+		switch (command->type) {
+			case ATTACH_HANDLE:
+				if (it == m_handles.end()) {
+					command->handle->start_dispatch();
+					m_handles.push_back(command->handle);
+				}
+				break;
+
+			case DETACH_HANDLE:
+				if (it != m_handles.end()) {
+					command->handle->stop_dispatch();
+					m_handles.erase(it);
+				}
+				break;
+		}
+
+		command->done = true;
+	}
+
+	m_handles_count = m_handles.size();
+	m_cond_var.notify_all();
+}
+
+void
+reactor_t::detach_all() {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	for (size_t i = 0; i < m_handles.size(); ++i) {
+		m_handles[i]->stop_dispatch();
+	}
+
+	m_handles.clear();
+	m_handles_count = 0;
+
+	// release anyone still waiting
+	while (!m_commands.empty()) {
+		m_commands.front()->done = true;
+		m_commands.pop_front();
+	}
+
+	m_cond_var.notify_all();
+}
+
+void
+reactor_t::run() {
+	while (m_is_running) {
+		m_poll_items.clear();
+		m_poll_offsets.clear();
+
+		// reactor's own wakeup goes first
+		zmq_pollitem_t wakeup_item;
+		wakeup_item.socket = NULL;
+		wakeup_item.fd = m_wakeup.fd();
+		wakeup_item.events = ZMQ_POLLIN;
+		wakeup_item.revents = 0;
+		m_poll_items.push_back(wakeup_item);
+
+		// block until the closest handle timer if nothing happens
+		long poll_timeout = -1;
+
+		for (size_t i = 0; i < m_handles.size(); ++i) {
+			m_poll_offsets.push_back(m_poll_items.size());
+			m_handles[i]->poll_items(m_poll_items);
+
+			// negative timeout means handle has nothing to wait for
+			long handle_timeout = m_handles[i]->next_poll_timeout();
+
+			if (handle_timeout < 0) {
+				continue;
+			}
+
+			if (poll_timeout < 0 || handle_timeout < poll_timeout) {
+				poll_timeout = handle_timeout;
+			}
+		}
+
+		if (zmq_poll(&m_poll_items[0], m_poll_items.size(), poll_timeout) < 0) {
+			if (zmq_errno() == EINTR) {
+				continue;
+			}
+
+			std::string error_msg = "zmq_poll failed at " + std::string(BOOST_CURRENT_FUNCTION);
+			error_msg += ", details: " + std::string(zmq_strerror(zmq_errno()));
+			throw internal_error(error_msg);
+		}
+
+		if (!m_is_running) {
+			break;
+		}
+
+		// handles can't go away until we process commands below
+		for (size_t i = 0; i < m_handles.size(); ++i) {
+			m_handles[i]->process_events(&m_poll_items[m_poll_offsets[i]]);
+		}
+
+		if ((ZMQ_POLLIN & m_poll_items[0].revents) == ZMQ_POLLIN) {
+			m_wakeup.drain();
+			process_commands();
+		}
+	}
+
+	detach_all();
+}
+
+} // namespace dealer
+} // namespace cocaine
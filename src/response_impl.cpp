@@ -27,19 +27,30 @@
 #include "cocaine/dealer/dealer.hpp"
 #include "cocaine/dealer/core/response_impl.hpp"
 #include "cocaine/dealer/core/dealer_impl.hpp"
+#include "cocaine/dealer/core/response_registry.hpp"
 #include "cocaine/dealer/utils/progress_timer.hpp"
 
 namespace cocaine {
 namespace dealer {
 
-response_impl_t::response_impl_t(const std::string& uuid, const message_path_t& path) :
+response_impl_t::response_impl_t(const wuuid_t& uuid, const message_path_t& path) :
 	m_uuid(uuid),
 	m_path(path),
 	m_response_finished(false),
-	m_message_finished(false)
+	m_message_finished(false),
+	m_error_reported(false),
+	m_waiters(0),
+	m_notifier_slot(0)
 {}
 
 response_impl_t::~response_impl_t() {
+	// no sweep of dead responses, leave registry right away
+	boost::shared_ptr<response_registry_t> registry = m_registry.lock();
+
+	if (registry) {
+		registry->release(m_uuid);
+	}
+
 	boost::mutex::scoped_lock lock(m_mutex);
 	m_message_finished = true;
 	m_response_finished = true;
@@ -61,23 +72,34 @@ response_impl_t::get(data_container* data, double timeout) {
 	}
 
  	// block in case there's no chunk
-	if (timeout < 0.0) {
-		// block until received chunk
-		while (!m_response_finished) { // handle spurrious wakes
-			m_cond_var.wait(lock);
+	++m_waiters;
+
+	try {
+		if (timeout < 0.0) {
+			// block until received chunk
+			while (!m_response_finished) { // handle spurrious wakes
+				m_cond_var.wait(lock);
+			}
 		}
-	}
-	else {
-		// block until received chunk or timed out
-		boost::system_time t = boost::get_system_time();
-		t += boost::posix_time::milliseconds(timeout * 1000);
+		else {
+			// block until received chunk or timed out
+			boost::system_time t = boost::get_system_time();
+			t += boost::posix_time::milliseconds(timeout * 1000);
 
-		progress_timer pt;
+			progress_timer pt;
 
-		while (!m_response_finished && pt.elapsed().as_double() < timeout) { // handle spurrious wakes
-			m_cond_var.timed_wait(lock, t);
+			while (!m_response_finished && pt.elapsed().as_double() < timeout) { // handle spurrious wakes
+				m_cond_var.timed_wait(lock, t);
+			}
 		}
 	}
+	catch (...) {
+		// interrupted wait, lock is held again here
+		--m_waiters;
+		throw;
+	}
+
+	--m_waiters;
 
 	// reset state
 	if (m_response_finished) {
@@ -121,8 +143,46 @@ response_impl_t::add_chunk(const boost::shared_ptr<response_chunk_t>& chunk) {
 
 	m_response_finished = true;
 
+	bool has_waiters = (m_waiters > 0);
+	boost::shared_ptr<response_notifier_t> notifier = m_notifier;
+	size_t slot = m_notifier_slot;
+
 	lock.unlock();
-	m_cond_var.notify_one();
+
+	if (has_waiters) {
+		m_cond_var.notify_one();
+	}
+
+	if (notifier) {
+		notifier->notify(slot);
+	}
+}
+
+bool
+response_impl_t::set_notifier(const boost::shared_ptr<response_notifier_t>& notifier, size_t slot) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	m_notifier = notifier;
+	m_notifier_slot = slot;
+
+	return (m_message_finished || !m_chunks.empty());
+}
+
+bool
+response_impl_t::is_ready() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return (m_message_finished || !m_chunks.empty());
+}
+
+bool
+response_impl_t::is_done() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return (m_message_finished && (m_chunks.empty() || m_error_reported));
+}
+
+void
+response_impl_t::set_registry(const boost::shared_ptr<response_registry_t>& registry) {
+	m_registry = registry;
 }
 
 } // namespace dealer
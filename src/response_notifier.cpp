@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include "cocaine/dealer/core/response_notifier.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+response_notifier_t::response_notifier_t() :
+	m_is_waiting(false)
+{
+}
+
+void
+response_notifier_t::notify(size_t slot) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (slot >= m_queued.size()) {
+		m_queued.resize(slot + 1, false);
+	}
+
+	if (m_queued[slot]) {
+		return;
+	}
+
+	m_queued[slot] = true;
+	m_ready.push_back(slot);
+
+	if (m_is_waiting) {
+		lock.unlock();
+		m_cond_var.notify_one();
+	}
+}
+
+void
+response_notifier_t::take(size_t& slot) {
+	slot = m_ready.front();
+	m_ready.pop_front();
+	m_queued[slot] = false;
+}
+
+void
+response_notifier_t::wait(size_t& slot) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	while (m_ready.empty()) { // handle spurrious wakes
+		m_is_waiting = true;
+		m_cond_var.wait(lock);
+	}
+
+	m_is_waiting = false;
+	take(slot);
+}
+
+bool
+response_notifier_t::timed_wait(size_t& slot, const boost::system_time& deadline) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	while (m_ready.empty()) {
+		m_is_waiting = true;
+
+		if (!m_cond_var.timed_wait(lock, deadline)) {
+			break;
+		}
+	}
+
+	m_is_waiting = false;
+
+	if (m_ready.empty()) {
+		return false;
+	}
+
+	take(slot);
+	return true;
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,165 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <boost/bind.hpp>
+
+#include "cocaine/dealer/core/response_registry.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+response_registry_t::response_registry_t(const boost::shared_ptr<completion_executor_t>& executor) :
+	m_executor(executor)
+{
+}
+
+response_registry_t::shard_t&
+response_registry_t::shard(const wuuid_t& uuid) {
+	return m_shards[uuid.hash() >> (sizeof(size_t) * 8 - shard_bits)];
+}
+
+void
+response_registry_t::add(const wuuid_t& uuid, const boost::shared_ptr<response_impl_t>& response) {
+	response->set_registry(shared_from_this());
+
+	shard_t& s = shard(uuid);
+	boost::mutex::scoped_lock lock(s.mutex);
+
+	entry_t& entry = s.entries[uuid];
+	entry.response = response;
+	entry.async_response.reset();
+}
+
+void
+response_registry_t::add(const wuuid_t& uuid, const boost::shared_ptr<async_response_t>& response) {
+	shard_t& s = shard(uuid);
+	boost::mutex::scoped_lock lock(s.mutex);
+
+	entry_t& entry = s.entries[uuid];
+	entry.response.reset();
+	entry.async_response = response;
+}
+
+void
+response_registry_t::release(const wuuid_t& uuid) {
+	shard_t& s = shard(uuid);
+	boost::mutex::scoped_lock lock(s.mutex);
+
+	entries_map_t::iterator it = s.entries.find(uuid);
+
+	if (it != s.entries.end() && !it->second.async_response && it->second.response.expired()) {
+		s.entries.erase(it);
+	}
+}
+
+bool
+response_registry_t::deliver(const response_chunk_ptr_t& chunk) {
+	const wuuid_t& uuid = chunk->uuid;
+	shard_t& s = shard(uuid);
+	boost::shared_ptr<response_impl_t> response;
+
+	{
+		boost::mutex::scoped_lock lock(s.mutex);
+
+		entries_map_t::iterator it = s.entries.find(uuid);
+
+		if (it == s.entries.end()) {
+			return false;
+		}
+
+		entry_t& entry = it->second;
+
+		if (entry.async_response) {
+			if (!entry.async_response->accept(*chunk)) {
+				return false;
+			}
+
+			// posted under lock, so chunks of a message keep their order
+			m_executor->post(uuid.hash(), boost::bind(&async_response_t::deliver, entry.async_response, chunk));
+
+			if (entry.async_response->is_finished()) {
+				s.entries.erase(it);
+			}
+
+			return true;
+		}
+
+		// client dropped response, it's being destroyed right now
+		response = entry.response.lock();
+
+		if (!response) {
+			return false;
+		}
+	}
+
+	response->add_chunk(chunk);
+	return true;
+}
+
+void
+response_registry_t::fail(const wuuid_t& uuid,
+						  const boost::shared_ptr<async_response_t>& response,
+						  int error_code,
+						  const std::string& error_message)
+{
+	response_chunk_ptr_t chunk(new response_chunk_t);
+	chunk->uuid = uuid;
+	chunk->rpc_code = SERVER_RPC_MESSAGE_ERROR;
+	chunk->error_code = error_code;
+	chunk->error_message = error_message;
+
+	if (response->accept(*chunk)) {
+		m_executor->post(uuid.hash(), boost::bind(&async_response_t::deliver, response, chunk));
+	}
+}
+
+void
+response_registry_t::cancel_all(int error_code, const std::string& error_message) {
+	for (size_t i = 0; i < shards_count; ++i) {
+		shard_t& s = m_shards[i];
+		boost::mutex::scoped_lock lock(s.mutex);
+
+		entries_map_t::iterator it = s.entries.begin();
+		while (it != s.entries.end()) {
+			if (!it->second.async_response) {
+				++it;
+				continue;
+			}
+
+			fail(it->first, it->second.async_response, error_code, error_message);
+			it = s.entries.erase(it);
+		}
+	}
+}
+
+size_t
+response_registry_t::size() {
+	size_t count = 0;
+
+	for (size_t i = 0; i < shards_count; ++i) {
+		boost::mutex::scoped_lock lock(m_shards[i].mutex);
+		count += m_shards[i].entries.size();
+	}
+
+	return count;
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,150 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "cocaine/dealer/response_set.hpp"
+#include "cocaine/dealer/core/response_impl.hpp"
+#include "cocaine/dealer/core/response_notifier.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+response_set_t::response_set_t() :
+	m_size(0),
+	m_notifier(new response_notifier_t),
+	m_returned_slot(0),
+	m_has_returned(false)
+{
+}
+
+response_set_t::~response_set_t() {
+	for (size_t i = 0; i < m_responses.size(); ++i) {
+		if (m_responses[i]) {
+			m_responses[i]->m_impl->set_notifier(boost::shared_ptr<response_notifier_t>(), 0);
+		}
+	}
+}
+
+void
+response_set_t::add(const response_ptr_t& response) {
+	if (!response) {
+		return;
+	}
+
+	size_t slot = m_responses.size();
+
+	if (!m_free_slots.empty()) {
+		slot = m_free_slots.back();
+		m_free_slots.pop_back();
+		m_responses[slot] = response;
+	}
+	else {
+		m_responses.push_back(response);
+	}
+
+	++m_size;
+
+	// chunks might have come before response was added
+	if (response->m_impl->set_notifier(m_notifier, slot)) {
+		m_notifier->notify(slot);
+	}
+}
+
+void
+response_set_t::add(const std::vector<response_ptr_t>& responses) {
+	for (size_t i = 0; i < responses.size(); ++i) {
+		add(responses[i]);
+	}
+}
+
+void
+response_set_t::remove(size_t slot) {
+	m_responses[slot]->m_impl->set_notifier(boost::shared_ptr<response_notifier_t>(), 0);
+	m_responses[slot].reset();
+	m_free_slots.push_back(slot);
+	--m_size;
+}
+
+void
+response_set_t::check_returned() {
+	if (!m_has_returned) {
+		return;
+	}
+
+	m_has_returned = false;
+
+	const boost::shared_ptr<response_impl_t>& impl = m_responses[m_returned_slot]->m_impl;
+
+	if (impl->is_done()) {
+		remove(m_returned_slot);
+	}
+	else if (impl->is_ready()) {
+		// chunks left, hand response out again
+		m_notifier->notify(m_returned_slot);
+	}
+}
+
+response_set_t::response_ptr_t
+response_set_t::wait_any(double timeout) {
+	check_returned();
+
+	boost::system_time deadline = boost::get_system_time();
+
+	if (timeout > 0.0) {
+		deadline += boost::posix_time::microseconds(static_cast<boost::int64_t>(timeout * 1000000.0));
+	}
+
+	while (m_size > 0) {
+		size_t slot = 0;
+
+		if (timeout < 0.0) {
+			m_notifier->wait(slot);
+		}
+		else if (!m_notifier->timed_wait(slot, deadline)) {
+			break;
+		}
+
+		// signal of removed response or of chunks already taken
+		if (slot >= m_responses.size() || !m_responses[slot] || !m_responses[slot]->m_impl->is_ready()) {
+			continue;
+		}
+
+		m_returned_slot = slot;
+		m_has_returned = true;
+
+		return m_responses[slot];
+	}
+
+	return response_ptr_t();
+}
+
+size_t
+response_set_t::size() const {
+	return m_size;
+}
+
+bool
+response_set_t::empty() const {
+	return (m_size == 0);
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -18,7 +18,10 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>. 
 */
 
+#include <boost/functional/hash.hpp>
+
 #include "cocaine/dealer/core/service.hpp"
+#include "cocaine/dealer/storage/eblob_storage.hpp"
 
 namespace cocaine {
 namespace dealer {
@@ -28,14 +31,18 @@ service_t::service_t(const service_info_t& info,
 					 bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
 	m_info(info),
+	m_admission(new admission_control_t(info.service_queue_limits, info.handle_queue_limits)),
+	m_registry(new response_registry_t(ctx->executor())),
 	m_is_running(false),
 	m_is_dead(false)
 {
+	if (config()->message_cache_type() == PERSISTENT) {
+		m_stored_in_flight.reset(new stored_in_flight_t);
+	}
+
 	// run response_t dispatch thread
 	m_is_running = true;
 
-	m_responces_cleanup_timer.reset();
-
 	// run timed out messages checker
 	m_deadlined_messages_refresher.reset(new refresher(boost::bind(&service_t::check_for_deadlined_messages, this),
 										 deadline_check_interval));
@@ -57,6 +64,9 @@ service_t::~service_t() {
 		it->second.reset();
 	}
 
+	// no chunks come from destroyed handles, callers still waiting get an error
+	m_registry->cancel_all(resource_error, "service " + m_info.name + " is shut down");
+
 	m_is_running = false;
 
 	log(PLOG_INFO, "FINISHED SERVICE [%s]", m_info.name.c_str());
@@ -72,73 +82,263 @@ service_t::info() const {
 	return m_info;
 }
 
+admission_control_t::usage_t
+service_t::queue_usage() {
+	return m_admission->service_usage();
+}
+
+admission_control_t::usage_t
+service_t::queue_usage(const std::string& handle_name) {
+	return m_admission->handle_usage(handle_name);
+}
+
 boost::shared_ptr<response_t>
 service_t::send_message(cached_message_prt_t message) {
+	// may block, no locks must be held here
+	cached_message_prt_t admitted = admit_message(message);
+
+	if (!admitted) {
+		reject_message(message);
+	}
+
+	message = admitted;
 
 	boost::shared_ptr<response_t> resp;
 	resp.reset(new response_t(message->uuid(), message->path()));
 
-	{
-		boost::mutex::scoped_lock lock(m_responces_mutex);
-		m_responses[message->uuid()] = resp;
+	m_registry->add(message->uuid(), resp->m_impl);
+
+	dispatch_message(message);
+
+	return resp;
+}
+
+void
+service_t::send_message_async(cached_message_prt_t message,
+							  const chunk_callback_t& on_chunk,
+							  const done_callback_t& on_done)
+{
+	boost::shared_ptr<async_response_t> resp(new async_response_t(on_chunk, on_done));
+
+	// may block, no locks must be held here
+	cached_message_prt_t admitted = admit_message(message);
+
+	// caller waits for on_done, so rejection goes there instead of throwing
+	if (!admitted) {
+		remove_from_persistent_storage(message);
+
+		std::string error_message = "queue of service " + m_info.name;
+		error_message += ", handle " + message->path().handle_name + " is full";
+
+		m_registry->fail(message->uuid(), resp, resource_error, error_message);
+		return;
 	}
 
+	m_registry->add(admitted->uuid(), resp);
 
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	dispatch_message(admitted);
+}
+
+service_t::e_resend_result
+service_t::resend_message(cached_message_prt_t message) {
+	// message sent before or resent by concurrent caller is still here,
+	// its uuid is claimed before admission so only one copy gets in
+	if (m_stored_in_flight && !m_stored_in_flight->insert(message->uuid())) {
+		return RR_IN_FLIGHT;
+	}
+
+	cached_message_prt_t admitted = admit_message(message);
+
+	if (!admitted) {
+		if (m_stored_in_flight) {
+			m_stored_in_flight->erase(message->uuid());
+		}
+
+		return RR_QUEUE_FULL;
+	}
+
+	// responses find no receiver and are dropped, stored copy is removed once message is done
+	dispatch_message(admitted);
+	return RR_QUEUED;
+}
+
+void
+service_t::dispatch_message(const cached_message_prt_t& message) {
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 	bool enqued = enque_to_handle(message);
 
 	if (!enqued) {
 		enque_to_unhandled(message);
 	}
+}
 
-	return resp;
+service_t::cached_message_prt_t
+service_t::admit_message(const cached_message_prt_t& message) {
+	bool track_in_flight = (m_stored_in_flight && message->policy().persistent);
+
+	// no limits configured, nothing to account or release
+	if (!m_admission->is_enabled() && !track_in_flight) {
+		return message;
+	}
+
+	const std::string& handle_name = message->path().handle_name;
+	size_t bytes = message->size();
+
+	bool admitted = m_admission->try_acquire(handle_name, bytes);
+
+	if (!admitted) {
+		switch (m_info.overflow_policy) {
+			case OP_BLOCK:
+				admitted = m_admission->acquire(handle_name, bytes, m_info.block_timeout);
+				break;
+
+			case OP_DROP_OLDEST:
+				while (!admitted) {
+					// while handle itself is full only its own messages make room
+					bool any_handle = m_admission->handle_fits(handle_name, bytes);
+
+					if (!drop_oldest_message(handle_name, any_handle)) {
+						break;
+					}
+
+					admitted = m_admission->try_acquire_dropped(handle_name, bytes);
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	if (!admitted) {
+		return cached_message_prt_t();
+	}
+
+	boost::shared_ptr<stored_in_flight_t> in_flight;
+
+	if (track_in_flight) {
+		in_flight = m_stored_in_flight;
+		in_flight->insert(message->uuid());
+	}
+
+	return cached_message_prt_t(message.get(), admitted_message_deleter_t(message, m_admission, in_flight, bytes));
 }
 
 void
-service_t::enqueue_responce(boost::shared_ptr<response_chunk_t>& response) {
-	assert(response);
+service_t::reject_message(const cached_message_prt_t& message) {
+	remove_from_persistent_storage(message);
 
-	boost::shared_ptr<response_t> response_object;
+	throw dealer_error(resource_error,
+					   "queue of service %s, handle %s is full",
+					   m_info.name.c_str(),
+					   message->path().handle_name.c_str());
+}
 
-	{
-		boost::mutex::scoped_lock lock(m_responces_mutex);
+bool
+service_t::drop_oldest_message(const std::string& handle_name, bool any_handle) {
+	cached_message_prt_t message = take_oldest_message(handle_name);
 
-		std::map<std::string, boost::shared_ptr<response_t> >::iterator it;
+	// service is full, room can be made in any handle
+	if (!message && any_handle) {
+		std::set<std::string> names;
 
-		// check for unique responses and remove them
-		if (m_responces_cleanup_timer.elapsed().as_double() > 5.0f) {
-			it = m_responses.begin();
+		{
+			boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
-			while (it != m_responses.end()) {
-				if (it->second.unique()) {
-					m_responses.erase(it++);
-				}
-				else {
-					++it;
-				}
+			for (handles_map_t::iterator it = m_handles.begin(); it != m_handles.end(); ++it) {
+				names.insert(it->first);
 			}
+		}
+
+		{
+			boost::mutex::scoped_lock lock(m_unhandled_mutex);
+
+			unhandled_messages_map_t::iterator it = m_unhandled_messages.begin();
+			for (; it != m_unhandled_messages.end(); ++it) {
+				names.insert(it->first);
+			}
+		}
 
-			m_responces_cleanup_timer.reset();
+		for (std::set<std::string>::iterator it = names.begin(); !message && it != names.end(); ++it) {
+			message = take_oldest_message(*it);
 		}
+	}
+
+	if (!message) {
+		return false;
+	}
 
-		// find response object for received chunk
-		it = m_responses.find(response->uuid);
+	message->set_discarded(true);
+	remove_from_persistent_storage(message);
 
-		// no response object -> discard chunk
-		if (it == m_responses.end()) {
-			return;
+	boost::shared_ptr<response_chunk_t> response(new response_chunk_t);
+	response->uuid = message->uuid();
+	response->rpc_code = SERVER_RPC_MESSAGE_ERROR;
+	response->error_code = resource_error;
+	response->error_message = "message dropped, queue is full";
+	enqueue_responce(response);
+
+	log(PLOG_WARNING,
+		"queue of service %s is full, dropped msg with uuid: %s for %s",
+		m_info.name.c_str(),
+		message->uuid().as_string().c_str(),
+		message->path().as_string().c_str());
+
+	return true;
+}
+
+service_t::cached_message_prt_t
+service_t::take_oldest_message(const std::string& handle_name) {
+	cached_message_prt_t message;
+
+	{
+		boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
+
+		handles_map_t::iterator it = m_handles.find(handle_name);
+		if (it != m_handles.end()) {
+			message = it->second->messages_cache()->take_oldest_new_message();
 		}
+	}
+
+	if (message) {
+		return message;
+	}
+
+	boost::mutex::scoped_lock lock(m_unhandled_mutex);
+
+	unhandled_messages_map_t::iterator it = m_unhandled_messages.find(handle_name);
+	if (it == m_unhandled_messages.end()) {
+		return message;
+	}
+
+	cached_messages_deque_t& queue = *(it->second);
+
+	while (!queue.empty()) {
+		message = queue.front();
+		queue.pop_front();
 
-		// response object has only one ref -> discard chunk
-		if (it->second.unique()) {
-			return;
+		if (!message->is_discarded()) {
+			return message;
 		}
+	}
+
+	return cached_message_prt_t();
+}
 
-		response_object = it->second;
+void
+service_t::remove_from_persistent_storage(const cached_message_prt_t& message) {
+	if (config()->message_cache_type() != PERSISTENT || !message->policy().persistent) {
+		return;
 	}
 
-	assert(response_object);
-	response_object->add_chunk(response);
+	context()->storage()->remove_all(message->path().service_alias, message->uuid().as_string());
+}
+
+void
+service_t::enqueue_responce(boost::shared_ptr<response_chunk_t>& response) {
+	assert(response);
+
+	m_registry->deliver(response);
 }
 
 bool
@@ -161,7 +361,7 @@ service_t::enque_to_handle(const cached_message_prt_t& message) {
 		log(PLOG_DEBUG,
 			message_str,
 			message->size(),
-			message->uuid().c_str(),
+			message->uuid().as_string().c_str(),
 			message->path().as_string().c_str(),
 			enqued_timestamp_str.c_str());
 	}
@@ -177,17 +377,19 @@ service_t::enque_to_unhandled(const cached_message_prt_t& message) {
 	unhandled_messages_map_t::iterator it = m_unhandled_messages.find(handle_name);
 	
 	// check for existing message queue for handle
+	messages_deque_ptr_t queue;
 	if (it == m_unhandled_messages.end()) {
-		messages_deque_ptr_t queue(new cached_messages_deque_t);
-		queue->push_back(message);
+		queue.reset(new cached_messages_deque_t);
 		m_unhandled_messages[handle_name] = queue;
 	}
 	else {
-		messages_deque_ptr_t queue = it->second;
-		assert(queue);
-		queue->push_back(message);
+		queue = it->second;
 	}
 
+	assert(queue);
+	queue->push_back(message);
+	track_unhandled_deadline(message, queue);
+
 	if (log_flag_enabled(PLOG_DEBUG)) {
 		const static std::string message_str = "enqued msg (%d bytes) with uuid: %s to unhandled %s (%s)";
 		std::string enqued_timestamp_str = message->enqued_timestamp().as_string();
@@ -195,7 +397,7 @@ service_t::enque_to_unhandled(const cached_message_prt_t& message) {
 		log(PLOG_DEBUG,
 			message_str,
 			message->size(),
-			message->uuid().c_str(),
+			message->uuid().as_string().c_str(),
 			message->path().as_string().c_str(),
 			enqued_timestamp_str.c_str());
 	}
@@ -220,7 +422,7 @@ service_t::get_and_remove_unhandled_queue(const std::string& handle_name) {
 
 void
 service_t::destroy_handle(const std::string& handle_name) {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::unique_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_map_t::iterator it = m_handles.find(handle_name);
 
@@ -299,6 +501,10 @@ service_t::append_to_unhandled(const std::string& handle_name,
 		(*it)->set_ack_received(false);
 	}
 
+	for (cached_messages_deque_t::iterator it = handle_queue->begin(); it != handle_queue->end(); ++it) {
+		track_unhandled_deadline(*it, queue);
+	}
+
 	log(PLOG_DEBUG, "moving message queue done.");
 }
 
@@ -306,7 +512,7 @@ void
 service_t::get_outstanding_handles(const handles_endpoints_t& handles_endpoints,
 								   handles_info_list_t& outstanding_handles)
 {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	for (handles_map_t::iterator it = m_handles.begin(); it != m_handles.end(); ++it) {
 		const std::string& handle_name = it->first;
@@ -322,7 +528,7 @@ void
 service_t::get_new_handles(const handles_endpoints_t& handles_endpoints,
 						   handles_info_list_t& new_handles)
 {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_endpoints_t::const_iterator it = handles_endpoints.begin();
 	for (; it != handles_endpoints.end(); ++it) {
@@ -362,7 +568,7 @@ service_t::remove_outstanding_handles(const handles_info_list_t& handles_info) {
 
 void
 service_t::update_existing_handles(const handles_endpoints_t& handles_endpoints) {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_map_t::iterator it = m_handles.begin();
 	for (; it != m_handles.end(); ++it) {
@@ -380,7 +586,7 @@ void
 service_t::create_handle(const handle_info_t& handle_info,
 						 const handles_endpoints_t& handles_endpoints)
 {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::unique_lock<boost::shared_mutex> lock(m_handles_mutex);
 	const std::string& handle_name = handle_info.name;
 
 	log(PLOG_INFO,
@@ -434,65 +640,83 @@ service_t::create_new_handles(const handles_info_list_t& handles_info,
 	}
 }
 
+void
+service_t::track_unhandled_deadline(const cached_message_prt_t& message,
+									const messages_deque_ptr_t& queue)
+{
+	double deadline = message->policy().deadline;
+
+	if (deadline <= 0.0) {
+		return;
+	}
+
+	double expiration_time = message->enqued_timestamp().as_double() + deadline;
+	expiration_time += message_cache_t::expiration_slack / 1000.0;
+
+	m_unhandled_expirations.push(expiration_time,
+								 unhandled_expiration_t(message, queue),
+								 &service_t::is_unhandled_expiration_stale);
+}
+
+bool
+service_t::is_unhandled_expiration_stale(const unhandled_expiration_t& expiration) {
+	cached_message_prt_t message = expiration.message.lock();
+	return (!message || expiration.queue.expired() || message->is_discarded());
+}
+
 void
 service_t::check_for_deadlined_messages() {
 	boost::mutex::scoped_lock lock(m_unhandled_mutex);
 
-	unhandled_messages_map_t::iterator it = m_unhandled_messages.begin();
+	time_value now = time_value::get_current_time();
+	unhandled_expiration_t expiration;
 
-	for (; it != m_unhandled_messages.end(); ++it) {
-		messages_deque_ptr_t queue = it->second;
+	std::string enqued_timestamp_str;
+	std::string sent_timestamp_str;
+	std::string curr_timestamp_str;
 
-		// create tmp queue
-		messages_deque_ptr_t not_expired_queue(new cached_messages_deque_t);
-		messages_deque_ptr_t expired_queue(new cached_messages_deque_t);
-		bool found_expired = false;
+	while (m_unhandled_expirations.pop_due(now.as_double(), expiration)) {
+		cached_message_prt_t message = expiration.message.lock();
+		messages_deque_ptr_t queue = expiration.queue.lock();
 
-		cached_messages_deque_t::iterator qit = queue->begin();
-		for (;qit != queue->end(); ++qit) {
-			if ((*qit)->is_expired()) {
-				expired_queue->push_back(*qit);
-				found_expired = true;
-			}
-			else {
-				not_expired_queue->push_back(*qit);
-			}
+		if (!message || !queue || message->is_discarded() || !message->is_expired(now)) {
+			continue;
 		}
 
-		if (!found_expired) {
+		// queue was handed over to a handle, message is tracked there
+		unhandled_messages_map_t::iterator it = m_unhandled_messages.find(message->path().handle_name);
+		if (it == m_unhandled_messages.end() || it->second != queue) {
 			continue;
 		}
 
-		it->second = not_expired_queue;
+		// expired messages are skipped later, drop the ones at front now
+		message->set_discarded(true);
+
+		while (!queue->empty() && queue->front()->is_discarded()) {
+			queue->pop_front();
+		}
 
 		// create error response for deadlined message
-		std::string enqued_timestamp_str;
-		std::string sent_timestamp_str;
-		std::string curr_timestamp_str;
-
-		cached_messages_deque_t::iterator expired_qit = expired_queue->begin();
-		for (;expired_qit != expired_queue->end(); ++expired_qit) {
-			boost::shared_ptr<response_chunk_t> response(new response_chunk_t);
-			response->uuid = (*expired_qit)->uuid();
-			response->rpc_code = SERVER_RPC_MESSAGE_ERROR;
-			response->error_code = deadline_error;
-			response->error_message = "unhandled message expired";
-			enqueue_responce(response);
-
-			enqued_timestamp_str = (*expired_qit)->enqued_timestamp().as_string();
-			sent_timestamp_str = (*expired_qit)->sent_timestamp().as_string();
-			curr_timestamp_str = time_value::get_current_time().as_string();
-
-			if (log_flag_enabled(PLOG_ERROR)) {
-				std::string log_str = "deadline policy exceeded, for unhandled message %s, (enqued: %s, sent: %s, curr: %s)";
-
-				log(PLOG_ERROR,
-					log_str,
-					response->uuid.c_str(),
-					enqued_timestamp_str.c_str(),
-					sent_timestamp_str.c_str(),
-					curr_timestamp_str.c_str());
-			}
+		boost::shared_ptr<response_chunk_t> response(new response_chunk_t);
+		response->uuid = message->uuid();
+		response->rpc_code = SERVER_RPC_MESSAGE_ERROR;
+		response->error_code = deadline_error;
+		response->error_message = "unhandled message expired";
+		enqueue_responce(response);
+
+		if (log_flag_enabled(PLOG_ERROR)) {
+			enqued_timestamp_str = message->enqued_timestamp().as_string();
+			sent_timestamp_str = message->sent_timestamp().as_string();
+			curr_timestamp_str = now.as_string();
+
+			std::string log_str = "deadline policy exceeded, for unhandled message %s, (enqued: %s, sent: %s, curr: %s)";
+
+			log(PLOG_ERROR,
+				log_str,
+				response->uuid.as_string().c_str(),
+				enqued_timestamp_str.c_str(),
+				sent_timestamp_str.c_str(),
+				curr_timestamp_str.c_str());
 		}
 	}
 }
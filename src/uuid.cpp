@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <cstring>
+
+#include <boost/thread/tss.hpp>
+
+#include "cocaine/dealer/utils/uuid.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+namespace {
+
+struct uuid_sequence_t {
+	uuid_sequence_t() {
+		// libuuid is hit once per thread to get a random prefix
+		// and a random counter start
+		uuid_t seed;
+		uuid_generate(seed);
+
+		memcpy(&prefix, seed, sizeof(prefix));
+		memcpy(&counter, seed + sizeof(prefix), sizeof(counter));
+	}
+
+	boost::uint64_t prefix;
+	boost::uint64_t counter;
+};
+
+} // namespace
+
+wuuid_t
+wuuid_t::create() {
+	// never destroyed, threads may create messages during static destruction
+	static boost::thread_specific_ptr<uuid_sequence_t>* sequence = new boost::thread_specific_ptr<uuid_sequence_t>;
+
+	if (!sequence->get()) {
+		sequence->reset(new uuid_sequence_t);
+	}
+
+	uuid_sequence_t& s = *sequence->get();
+	return wuuid_t(s.prefix, s.counter++);
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,92 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/current_function.hpp>
+
+#include "cocaine/dealer/utils/error.hpp"
+#include "cocaine/dealer/utils/wakeup_fd.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+wakeup_fd_t::wakeup_fd_t() :
+	m_pending(0)
+{
+	if (pipe(m_pipe) != 0) {
+		std::string error_msg = "could not create wakeup pipe at " + std::string(BOOST_CURRENT_FUNCTION);
+		error_msg += ", details: " + std::string(strerror(errno));
+		throw internal_error(error_msg);
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		int flags = fcntl(m_pipe[i], F_GETFL, 0);
+		fcntl(m_pipe[i], F_SETFL, flags | O_NONBLOCK);
+		fcntl(m_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+}
+
+wakeup_fd_t::~wakeup_fd_t() {
+	close(m_pipe[0]);
+	close(m_pipe[1]);
+}
+
+void
+wakeup_fd_t::notify() {
+	// only the first notification after drain() touches the pipe
+	if (__sync_lock_test_and_set(&m_pending, 1) != 0) {
+		return;
+	}
+
+	char byte = 1;
+	ssize_t rc = 0;
+
+	do {
+		rc = write(m_pipe[1], &byte, sizeof(byte));
+	} while (rc < 0 && errno == EINTR);
+}
+
+void
+wakeup_fd_t::drain() {
+	char buffer[64];
+	ssize_t rc = 0;
+
+	do {
+		rc = read(m_pipe[0], buffer, sizeof(buffer));
+	} while (rc > 0 || (rc < 0 && errno == EINTR));
+
+	// reset pending flag after the pipe is empty, so that any notification
+	// which arrives while the caller processes its queue writes a new byte
+	__sync_lock_release(&m_pending);
+	__sync_synchronize();
+}
+
+int
+wakeup_fd_t::fd() const {
+	return m_pipe[0];
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -0,0 +1,1201 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <msgpack.hpp>
+
+#include "cocaine/dealer/response_chunk.hpp"
+#include "cocaine/dealer/utils/progress_timer.hpp"
+#include "cocaine/dealer/utils/mpsc_queue.hpp"
+#include "cocaine/dealer/utils/data_container.hpp"
+#include "cocaine/dealer/utils/buffer_pool.hpp"
+#include "cocaine/dealer/core/balancing_strategy.hpp"
+#include "cocaine/dealer/core/balancer.hpp"
+#include "cocaine/dealer/core/handle.hpp"
+#include "cocaine/dealer/core/context.hpp"
+#include "cocaine/dealer/core/latency_tracker.hpp"
+#include "cocaine/dealer/utils/deadline_queue.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
+#include "cocaine/dealer/core/cached_message.hpp"
+#include "cocaine/dealer/core/request_metadata.hpp"
+#include "cocaine/dealer/storage/eblob.hpp"
+#include "cocaine/dealer/storage/eblob_journal.hpp"
+
+using namespace cocaine::dealer;
+using namespace boost::program_options;
+
+typedef boost::shared_ptr<int> item_t;
+typedef boost::ptr_vector<boost::thread> thread_pool;
+
+// counts heap allocations made through operator new
+static volatile size_t new_calls = 0;
+
+void* operator new (size_t size) throw (std::bad_alloc) {
+	__sync_fetch_and_add(&new_calls, 1);
+
+	void* ptr = malloc(size == 0 ? 1 : size);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void operator delete (void* ptr) throw () {
+	free(ptr);
+}
+
+// ----------------------------------- queue benchmark ---------------------------------------
+
+struct locked_queue_t {
+	void push(const item_t& item) {
+		boost::mutex::scoped_lock lock(mutex);
+		queue.push_back(item);
+	}
+
+	// mimics former message cache, count, front and pop under separate locks
+	size_t pop_all() {
+		size_t count = 0;
+
+		for (;;) {
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				if (queue.empty()) {
+					break;
+				}
+			}
+
+			item_t item;
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				item = queue.front();
+			}
+
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				queue.pop_front();
+			}
+
+			++count;
+		}
+
+		return count;
+	}
+
+	std::deque<item_t> queue;
+	boost::mutex mutex;
+};
+
+struct ring_queue_t {
+	ring_queue_t() : ring(4096) {}
+
+	void push(const item_t& item) {
+		if (ring.push(item)) {
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(mutex);
+		drain();
+		queue.push_back(item);
+	}
+
+	// one lock per batch
+	size_t pop_all() {
+		boost::mutex::scoped_lock lock(mutex);
+		drain();
+
+		size_t count = queue.size();
+		queue.clear();
+
+		return count;
+	}
+
+	void drain() {
+		item_t item;
+		while (ring.pop(item)) {
+			queue.push_back(item);
+		}
+	}
+
+	mpsc_queue_t<item_t> ring;
+	std::deque<item_t> queue;
+	boost::mutex mutex;
+};
+
+template <typename Queue>
+void producer(Queue* queue, int messages) {
+	item_t item(new int(0));
+
+	for (int i = 0; i < messages; ++i) {
+		queue->push(item);
+	}
+}
+
+template <typename Queue>
+double run_queue(int producers, int messages) {
+	Queue queue;
+	thread_pool pool;
+
+	progress_timer timer;
+
+	for (int i = 0; i < producers; ++i) {
+		pool.push_back(new boost::thread(boost::bind(&producer<Queue>, &queue, messages)));
+	}
+
+	size_t total = static_cast<size_t>(producers) * messages;
+	size_t consumed = 0;
+
+	while (consumed < total) {
+		size_t count = queue.pop_all();
+
+		if (count == 0) {
+			boost::this_thread::yield();
+		}
+
+		consumed += count;
+	}
+
+	double elapsed = timer.elapsed().as_double();
+
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+
+	return total / elapsed;
+}
+
+void queue_benchmark(int max_producers, int messages) {
+	std::cout << "----------------------------------- queue benchmark -------------------------------------\n";
+	std::cout << messages << " messages per producer, single consumer, messages per second\n";
+	std::cout << std::setw(10) << "producers" << std::setw(20) << "locked deque" << std::setw(20) << "mpsc ring" << "\n";
+
+	for (int producers = 1; producers <= max_producers; producers *= 2) {
+		double locked = run_queue<locked_queue_t>(producers, messages);
+		double ring = run_queue<ring_queue_t>(producers, messages);
+
+		std::cout << std::setw(10) << producers;
+		std::cout << std::setw(20) << std::fixed << std::setprecision(0) << locked;
+		std::cout << std::setw(20) << std::fixed << std::setprecision(0) << ring << "\n";
+	}
+}
+
+// ----------------------------------- set_data benchmark ------------------------------------
+
+void set_data_benchmark(int max_size_mb, int iterations) {
+	std::cout << "----------------------------------- set_data benchmark ----------------------------------\n";
+	std::cout << iterations << " iterations per size, megabytes per second\n";
+	std::cout << std::setw(10) << "size, mb" << std::setw(20) << "set_data" << std::setw(20) << "first compare" << "\n";
+
+	for (int size_mb = 1; size_mb <= max_size_mb; size_mb *= 2) {
+		size_t size = static_cast<size_t>(size_mb) * 1024 * 1024;
+		std::vector<char> buffer(size, 'x');
+
+		// containers are kept alive to time set_data alone
+		std::vector<data_container> containers(iterations);
+		data_container reference(&buffer[0], size);
+
+		progress_timer timer;
+
+		for (int i = 0; i < iterations; ++i) {
+			containers[i].set_data(&buffer[0], size);
+		}
+
+		double set_data_time = timer.elapsed().as_double();
+		timer.reset();
+
+		// big containers are signed once, on first comparison
+		size_t equal = 0;
+		for (int i = 0; i < iterations; ++i) {
+			equal += (containers[i] == reference) ? 1 : 0;
+		}
+
+		double compare_time = timer.elapsed().as_double();
+
+		if (equal != static_cast<size_t>(iterations)) {
+			std::cerr << "containers differ at size " << size_mb << "mb" << std::endl;
+		}
+
+		double total_mb = static_cast<double>(size_mb) * iterations;
+
+		std::cout << std::setw(10) << size_mb;
+		std::cout << std::setw(20) << std::fixed << std::setprecision(0) << total_mb / set_data_time;
+		std::cout << std::setw(20) << std::fixed << std::setprecision(0) << total_mb / compare_time << "\n";
+	}
+}
+
+// ----------------------------------- allocation benchmark ----------------------------------
+
+void allocation_benchmark(int messages) {
+	std::cout << "----------------------------------- allocation benchmark --------------------------------\n";
+	std::cout << messages << " containers per size, set_data, copy and release\n";
+	std::cout << std::setw(10) << "size" << std::setw(15) << "new calls" << std::setw(15) << "mallocs";
+	std::cout << std::setw(20) << "containers/sec" << "\n";
+
+	size_t sizes[] = { 64, 512, 4 * 1024, 64 * 1024, 256 * 1024 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		std::vector<char> buffer(sizes[i], 'x');
+
+		size_t new_calls_before = new_calls;
+		buffer_pool_t::stats_t stats_before = buffer_pool_t::stats();
+		progress_timer timer;
+
+		for (int j = 0; j < messages; ++j) {
+			data_container data(&buffer[0], buffer.size());
+			data_container copy(data);
+		}
+
+		double elapsed = timer.elapsed().as_double();
+		buffer_pool_t::stats_t stats_after = buffer_pool_t::stats();
+
+		size_t new_count = new_calls - new_calls_before;
+		uint64_t malloc_count = stats_after.system_allocations - stats_before.system_allocations;
+
+		std::cout << std::setw(10) << sizes[i];
+		std::cout << std::setw(15) << new_count;
+		std::cout << std::setw(15) << malloc_count;
+		std::cout << std::setw(20) << std::fixed << std::setprecision(0) << messages / elapsed << "\n";
+	}
+
+	std::cout << "pool stats: " << buffer_pool_t::stats().as_string() << "\n";
+}
+
+// ----------------------------------- uuid benchmark ----------------------------------------
+
+// per message id work: generated once, hashed by three maps on the way
+// out, formatted for the wire and parsed back from the response
+void uuid_benchmark(int messages) {
+	std::cout << "----------------------------------- uuid benchmark --------------------------------------\n";
+	std::cout << messages << " message ids, generate, 3 lookups hashes, format and parse\n";
+	std::cout << std::setw(15) << "ids" << std::setw(15) << "ns/message" << std::setw(15) << "new calls" << "\n";
+
+	size_t sink = 0;
+
+	{
+		size_t new_calls_before = new_calls;
+		progress_timer timer;
+
+		for (int i = 0; i < messages; ++i) {
+			std::string uuid = wuuid_t::generate();
+
+			for (int j = 0; j < 3; ++j) {
+				sink += boost::hash<std::string>()(uuid);
+			}
+
+			// response uuid is converted to a string of its own
+			std::string echoed(uuid.data(), uuid.size());
+			sink += boost::hash<std::string>()(echoed);
+		}
+
+		double elapsed = timer.elapsed().as_double();
+
+		std::cout << std::setw(15) << "libuuid string";
+		std::cout << std::setw(15) << std::fixed << std::setprecision(1) << elapsed * 1e9 / messages;
+		std::cout << std::setw(15) << new_calls - new_calls_before << "\n";
+	}
+
+	{
+		size_t new_calls_before = new_calls;
+		progress_timer timer;
+
+		for (int i = 0; i < messages; ++i) {
+			wuuid_t uuid = wuuid_t::create();
+
+			for (int j = 0; j < 3; ++j) {
+				sink += uuid.hash();
+			}
+
+			char buff[wuuid_t::string_length];
+			uuid.to_chars(buff);
+
+			wuuid_t echoed;
+			echoed.from_chars(buff, sizeof(buff));
+			sink += echoed.hash();
+		}
+
+		double elapsed = timer.elapsed().as_double();
+
+		std::cout << std::setw(15) << "binary";
+		std::cout << std::setw(15) << std::fixed << std::setprecision(1) << elapsed * 1e9 / messages;
+		std::cout << std::setw(15) << new_calls - new_calls_before << "\n";
+	}
+
+	// keeps loops from being optimized away
+	if (sink == 0) {
+		std::cout << "\n";
+	}
+}
+
+// ----------------------------------- journal benchmark -------------------------------------
+
+typedef cached_message_t<data_container, request_metadata_t> bench_message_t;
+
+enum e_commit_type {
+	CT_DIRECT = 1,
+	CT_JOURNAL_WAIT,
+	CT_JOURNAL
+};
+
+void commit_messages(e_commit_type type,
+					 boost::shared_ptr<eblob_t> blob,
+					 eblob_journal_t* journal,
+					 const std::vector<char>* payload,
+					 int messages)
+{
+	message_path_t path("bench_service", "bench_handle");
+	message_policy_t policy;
+	policy.persistent = true;
+
+	for (int i = 0; i < messages; ++i) {
+		bench_message_t message(path, policy, &(*payload)[0], payload->size());
+
+		if (type == CT_DIRECT) {
+			message.commit_to_eblob(blob);
+		}
+		else {
+			boost::uint64_t sequence = message.commit_to_journal(*journal, blob);
+
+			if (type == CT_JOURNAL_WAIT) {
+				journal->wait(sequence);
+			}
+		}
+	}
+}
+
+double run_commits(e_commit_type type,
+				   const std::string& path,
+				   int producers,
+				   int messages,
+				   size_t size,
+				   boost::uint64_t& batches)
+{
+	boost::shared_ptr<eblob_t> blob(new eblob_t(path, boost::shared_ptr<context_t>(), false));
+	std::auto_ptr<eblob_journal_t> journal;
+
+	if (type != CT_DIRECT) {
+		journal.reset(new eblob_journal_t(boost::shared_ptr<base_logger_t>(),
+										  defaults_t::journal_batch_size,
+										  defaults_t::journal_batch_timeout));
+	}
+
+	std::vector<char> payload(size, 'x');
+	thread_pool pool;
+
+	progress_timer timer;
+
+	for (int i = 0; i < producers; ++i) {
+		pool.push_back(new boost::thread(boost::bind(&commit_messages, type, blob, journal.get(), &payload, messages)));
+	}
+
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+
+	// write-behind is done once everything is on disk
+	batches = 0;
+
+	if (journal.get()) {
+		journal->flush();
+		batches = journal->batches_count();
+	}
+
+	double elapsed = timer.elapsed().as_double();
+	return (static_cast<double>(producers) * messages) / elapsed;
+}
+
+void journal_benchmark(const std::string& path, int max_producers, int messages) {
+	std::cout << "----------------------------------- journal benchmark -----------------------------------\n";
+	std::cout << messages << " persistent messages per producer, eblob at " << path << ", messages per second\n";
+	std::cout << std::setw(10) << "producers" << std::setw(10) << "size";
+	std::cout << std::setw(15) << "per message" << std::setw(15) << "journal wait";
+	std::cout << std::setw(15) << "write-behind" << std::setw(10) << "batches" << "\n";
+
+	size_t sizes[] = { 512, 16 * 1024 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		for (int producers = 1; producers <= max_producers; producers *= 4) {
+			boost::uint64_t batches = 0;
+
+			double direct = run_commits(CT_DIRECT, path + "/direct", producers, messages, sizes[i], batches);
+			double waiting = run_commits(CT_JOURNAL_WAIT, path + "/journal_wait", producers, messages, sizes[i], batches);
+			double behind = run_commits(CT_JOURNAL, path + "/journal", producers, messages, sizes[i], batches);
+
+			std::cout << std::setw(10) << producers << std::setw(10) << sizes[i];
+			std::cout << std::setw(15) << std::fixed << std::setprecision(0) << direct;
+			std::cout << std::setw(15) << std::fixed << std::setprecision(0) << waiting;
+			std::cout << std::setw(15) << std::fixed << std::setprecision(0) << behind;
+			std::cout << std::setw(10) << batches << "\n";
+		}
+	}
+}
+
+// ----------------------------------- storage benchmark -------------------------------------
+
+void storage_benchmark(const std::string& path, int max_size_mb, int iterations) {
+	std::cout << "----------------------------------- storage benchmark -----------------------------------\n";
+	std::cout << iterations << " records per size, eblob at " << path << ", megabytes per second and heap allocations\n";
+	std::cout << std::setw(10) << "size, mb" << std::setw(15) << "string write" << std::setw(15) << "raw write";
+	std::cout << std::setw(15) << "string read" << std::setw(15) << "located read";
+	std::cout << std::setw(10) << "new" << std::setw(10) << "new raw" << "\n";
+
+	boost::shared_ptr<eblob_t> blob(new eblob_t(path + "/storage", boost::shared_ptr<context_t>(), false));
+	const int column = 1;
+
+	for (int size_mb = 1; size_mb <= max_size_mb; size_mb *= 2) {
+		size_t size = static_cast<size_t>(size_mb) * 1024 * 1024;
+		std::vector<char> payload(size, 'x');
+		std::vector<char> buffer(size);
+
+		std::vector<std::string> keys;
+		for (int i = 0; i < iterations; ++i) {
+			keys.push_back(wuuid_t::create().as_string());
+		}
+
+		// old path: payload copied into value string before write, read returns a string copy
+		size_t new_calls_before = new_calls;
+		progress_timer timer;
+
+		for (int i = 0; i < iterations; ++i) {
+			std::string value(&payload[0], size);
+			blob->write(keys[i], value, column);
+		}
+
+		double string_write = timer.elapsed().as_double();
+		timer.reset();
+
+		for (int i = 0; i < iterations; ++i) {
+			std::string value = blob->read(keys[i], column);
+			memcpy(&buffer[0], value.data(), value.size());
+		}
+
+		double string_read = timer.elapsed().as_double();
+		size_t string_new_calls = new_calls - new_calls_before;
+
+		// new path: payload written from and read into caller's memory, stored messages
+		// hold header and data in one buffer and take it, gathered pieces are joined first
+		new_calls_before = new_calls;
+		timer.reset();
+
+		for (int i = 0; i < iterations; ++i) {
+			blob->write(keys[i], &payload[0], size, column);
+		}
+
+		double raw_write = timer.elapsed().as_double();
+		timer.reset();
+
+		for (int i = 0; i < iterations; ++i) {
+			eblob_t::location_t location;
+
+			if (!blob->locate(keys[i], location, column) || location.size != size) {
+				std::cerr << "record " << keys[i] << " not found" << std::endl;
+				continue;
+			}
+
+			blob->read(location, &buffer[0]);
+		}
+
+		double located_read = timer.elapsed().as_double();
+		size_t raw_new_calls = new_calls - new_calls_before;
+
+		for (int i = 0; i < iterations; ++i) {
+			blob->remove_all(keys[i]);
+		}
+
+		double total_mb = static_cast<double>(size_mb) * iterations;
+
+		std::cout << std::setw(10) << size_mb;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << total_mb / string_write;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << total_mb / raw_write;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << total_mb / string_read;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << total_mb / located_read;
+		std::cout << std::setw(10) << string_new_calls << std::setw(10) << raw_new_calls << "\n";
+	}
+}
+
+// ----------------------------------- send benchmark ----------------------------------------
+
+// stands for cocaine node, counts messages balancer delivered to it,
+// echoing node answers each message with choke, which completes it
+struct bench_node_t {
+	bench_node_t(zmq::context_t& zmq_context, const std::string& endpoint, const std::string& route, bool echo_ = false) :
+		socket(zmq_context, ZMQ_ROUTER),
+		received(0),
+		stopped(false),
+		echo(echo_)
+	{
+		socket.setsockopt(ZMQ_IDENTITY, route.data(), route.size());
+		socket.bind(endpoint.c_str());
+	}
+
+	void run() {
+		zmq_pollitem_t item;
+		item.socket = socket;
+		item.fd = 0;
+		item.events = ZMQ_POLLIN;
+		item.revents = 0;
+
+		// message frames are sender identity, empty, uuid, policy and data
+		size_t frame = 0;
+		std::string sender;
+		std::string uuid;
+
+		while (!stopped) {
+			if (zmq_poll(&item, 1, 100000) <= 0) {
+				continue;
+			}
+
+			zmq::message_t chunk;
+
+			while (socket.recv(&chunk, ZMQ_NOBLOCK)) {
+				int64_t more = 0;
+				size_t more_size = sizeof(more);
+				socket.getsockopt(ZMQ_RCVMORE, &more, &more_size);
+
+				if (echo && frame == 0) {
+					sender.assign(static_cast<const char*>(chunk.data()), chunk.size());
+				}
+				else if (echo && frame == 2) {
+					uuid.assign(static_cast<const char*>(chunk.data()), chunk.size());
+				}
+
+				++frame;
+
+				if (more) {
+					continue;
+				}
+
+				frame = 0;
+				__sync_add_and_fetch(&received, 1);
+
+				if (echo) {
+					reply(sender, uuid);
+				}
+			}
+		}
+	}
+
+	// route, rpc code and uuid as packed by sender
+	void reply(const std::string& sender, const std::string& uuid) {
+		msgpack::sbuffer buffer;
+		msgpack::pack(buffer, static_cast<int>(SERVER_RPC_MESSAGE_CHOKE));
+
+		zmq::message_t sender_chunk(sender.size());
+		memcpy(sender_chunk.data(), sender.data(), sender.size());
+
+		zmq::message_t code_chunk(buffer.size());
+		memcpy(code_chunk.data(), buffer.data(), buffer.size());
+
+		zmq::message_t uuid_chunk(uuid.size());
+		memcpy(uuid_chunk.data(), uuid.data(), uuid.size());
+
+		socket.send(sender_chunk, ZMQ_SNDMORE);
+		socket.send(code_chunk, ZMQ_SNDMORE);
+		socket.send(uuid_chunk);
+	}
+
+	zmq::socket_t socket;
+	volatile size_t received;
+	volatile bool stopped;
+	bool echo;
+};
+
+// messages sender keeps ahead of the node, so queues stay bounded
+static const size_t send_window = 5000;
+
+// messages per second balancer puts on the wire
+double run_sends(balancer_t& balancer, bench_node_t& node, size_t payload_size, int messages, int batch) {
+	message_path_t path("bench_service", "bench_handle");
+	message_policy_t policy;
+	std::vector<char> payload(payload_size, 'x');
+
+	std::vector<boost::shared_ptr<message_iface> > pending;
+	for (int i = 0; i < messages; ++i) {
+		pending.push_back(boost::shared_ptr<message_iface>(new bench_message_t(path, policy, &payload[0], payload.size())));
+	}
+
+	size_t received_before = node.received;
+	size_t window = send_window;
+
+	std::vector<boost::shared_ptr<message_iface> > messages_batch;
+	std::vector<std::string> routes;
+	cocaine_endpoint_t endpoint;
+
+	progress_timer timer;
+	size_t sent = 0;
+
+	while (sent < pending.size()) {
+		while (sent - (node.received - received_before) > window) {
+			boost::this_thread::yield();
+		}
+
+		size_t count = 0;
+
+		if (batch <= 1) {
+			count = balancer.send(pending[sent], endpoint) ? 1 : 0;
+		}
+		else {
+			count = std::min(pending.size() - sent, static_cast<size_t>(batch));
+			messages_batch.assign(pending.begin() + sent, pending.begin() + sent + count);
+			count = balancer.send_batch(messages_batch, routes);
+		}
+
+		if (count == 0) {
+			std::cerr << "socket refused message " << sent << std::endl;
+			break;
+		}
+
+		sent += count;
+	}
+
+	while (node.received - received_before < sent) {
+		boost::this_thread::yield();
+	}
+
+	return static_cast<double>(sent) / timer.elapsed().as_double();
+}
+
+void send_benchmark(const std::string& config_path, int messages) {
+	std::cout << "----------------------------------- send benchmark --------------------------------------\n";
+	std::cout << messages << " messages per run through balancer_t to in-process node, messages per second\n";
+	std::cout << std::setw(10) << "size" << std::setw(15) << "per message";
+	std::cout << std::setw(15) << "batch 10" << std::setw(15) << "batch 100" << "\n";
+
+	boost::shared_ptr<context_t> ctx(new context_t(config_path));
+
+	std::string endpoint_address = "inproc://dealer_bench_send";
+	std::string route = "bench_node";
+
+	bench_node_t node(*(ctx->zmq_context()), endpoint_address, route);
+	boost::thread node_thread(boost::bind(&bench_node_t::run, &node));
+
+	std::vector<cocaine_endpoint_t> endpoints;
+	endpoints.push_back(cocaine_endpoint_t(endpoint_address, route));
+
+	balancer_t balancer("bench_balancer", endpoints, ctx, BT_ROUND_ROBIN, false);
+	balancer.connect(endpoints);
+
+	// router drops messages to peer it hasn't finished handshake with
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+	size_t sizes[] = { 16, 64, 256, 1024 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		double single = run_sends(balancer, node, sizes[i], messages, 1);
+		double batch_10 = run_sends(balancer, node, sizes[i], messages, 10);
+		double batch_100 = run_sends(balancer, node, sizes[i], messages, defaults_t::batching_size);
+
+		std::cout << std::setw(10) << sizes[i];
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << single;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << batch_10;
+		std::cout << std::setw(15) << std::fixed << std::setprecision(0) << batch_100 << "\n";
+	}
+
+	balancer.disconnect();
+
+	node.stopped = true;
+	node_thread.join();
+}
+
+// ----------------------------------- handles benchmark -------------------------------------
+
+double cpu_time() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+	double sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+
+	return user + sys;
+}
+
+void count_completed(volatile size_t* completed, handle_t::response_chunk_prt_t response) {
+	if (response->rpc_code == SERVER_RPC_MESSAGE_CHOKE) {
+		__sync_add_and_fetch(completed, 1);
+	}
+}
+
+// messages go round robin to handles_count handles multiplexed by context's
+// reactors, echoing node completes them, up to window messages are in flight
+void run_handles(const boost::shared_ptr<context_t>& ctx,
+				 const std::string& endpoint_address,
+				 const std::string& route,
+				 size_t handles_count,
+				 int messages,
+				 size_t window)
+{
+	std::vector<cocaine_endpoint_t> endpoints;
+	endpoints.push_back(cocaine_endpoint_t(endpoint_address, route));
+
+	volatile size_t completed = 0;
+	boost::ptr_vector<handle_t> handles;
+	std::vector<message_path_t> paths;
+
+	for (size_t i = 0; i < handles_count; ++i) {
+		std::string name = "handle_" + boost::lexical_cast<std::string>(handles_count) + "_" + boost::lexical_cast<std::string>(i);
+		handle_info_t info(name, "bench_app", "bench_service");
+
+		handles.push_back(new handle_t(info, endpoints, ctx, false));
+		handles.back().set_responce_callback(boost::bind(&count_completed, &completed, _1));
+		paths.push_back(message_path_t("bench_service", name));
+	}
+
+	// router drops messages to peers it hasn't finished handshake with
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+	message_policy_t policy;
+	std::string payload(16, 'x');
+
+	progress_timer timer;
+	double cpu_start = cpu_time();
+
+	for (int i = 0; i < messages; ++i) {
+		while (static_cast<size_t>(i) - completed >= window) {
+			boost::this_thread::yield();
+		}
+
+		size_t index = static_cast<size_t>(i) % handles_count;
+		boost::shared_ptr<message_iface> message(new bench_message_t(paths[index], policy, payload.data(), payload.size()));
+		handles[index].enqueue_message(message);
+	}
+
+	while (completed < static_cast<size_t>(messages)) {
+		boost::this_thread::yield();
+	}
+
+	double elapsed = timer.elapsed().as_double();
+	double cpu_used = cpu_time() - cpu_start;
+
+	std::cout << std::setw(10) << handles_count;
+	std::cout << std::setw(15) << std::fixed << std::setprecision(0) << messages / elapsed;
+	std::cout << std::setw(15) << std::fixed << std::setprecision(2) << cpu_used;
+	std::cout << std::setw(15) << std::fixed << std::setprecision(1) << 1000000.0 * cpu_used / messages;
+	std::cout << std::setw(15) << std::fixed << std::setprecision(0) << 100.0 * cpu_used / elapsed << "\n";
+}
+
+void handles_benchmark(const std::string& config_path, int max_handles, int messages) {
+	boost::shared_ptr<context_t> ctx(new context_t(config_path));
+
+	std::cout << "----------------------------------- handles benchmark -----------------------------------\n";
+	int io_threads = ctx->config()->io_threads();
+	if (io_threads <= 0) {
+		io_threads = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+	}
+
+	std::cout << messages << " messages of 16 bytes per run, spread over handles of " << io_threads;
+	std::cout << " i/o threads, completed by in-process node, 1000 in flight\n";
+	std::cout << std::setw(10) << "handles" << std::setw(15) << "msgs/sec" << std::setw(15) << "cpu, secs";
+	std::cout << std::setw(15) << "cpu usecs/msg" << std::setw(15) << "cpu, %" << "\n";
+
+	std::string endpoint_address = "inproc://dealer_bench_handles";
+	std::string route = "bench_node";
+
+	bench_node_t node(*(ctx->zmq_context()), endpoint_address, route, true);
+	boost::thread node_thread(boost::bind(&bench_node_t::run, &node));
+
+	for (int handles_count = 1; handles_count <= max_handles; handles_count *= 4) {
+		run_handles(ctx, endpoint_address, route, static_cast<size_t>(handles_count), messages, 1000);
+	}
+
+	node.stopped = true;
+	node_thread.join();
+}
+
+// ----------------------------------- balancing benchmark -----------------------------------
+
+// simulated node handle, serves requests fifo with a number of slaves,
+// every slow_every-th request takes slow_service_time instead
+struct fake_endpoint_t {
+	fake_endpoint_t(int slaves, int service_time) :
+		service_time(service_time),
+		slow_every(0),
+		slow_service_time(0),
+		busy_until(slaves, 0),
+		busy_requests(slaves, 0),
+		started(0),
+		served(0) {}
+
+	size_t in_flight() const {
+		size_t busy = 0;
+		for (size_t i = 0; i < busy_until.size(); ++i) {
+			busy += (busy_until[i] > 0) ? 1 : 0;
+		}
+
+		return queue.size() + busy;
+	}
+
+	// advances endpoint to given tick, collects ids of finished requests
+	void tick(int now, std::vector<int>& finished) {
+		for (size_t i = 0; i < busy_until.size(); ++i) {
+			if (busy_until[i] > 0 && busy_until[i] <= now) {
+				finished.push_back(busy_requests[i]);
+				busy_until[i] = 0;
+				++served;
+			}
+
+			if (busy_until[i] == 0 && !queue.empty()) {
+				++started;
+				bool slow = (slow_every > 0 && started % slow_every == 0);
+
+				busy_requests[i] = queue.front();
+				busy_until[i] = now + (slow ? slow_service_time : service_time);
+				queue.pop_front();
+			}
+		}
+	}
+
+	int service_time; // ticks
+	int slow_every;
+	int slow_service_time;
+	std::vector<int> busy_until;
+	std::vector<int> busy_requests;
+	std::deque<int> queue;
+	size_t started;
+	size_t served;
+};
+
+struct latency_stats_t {
+	latency_stats_t(std::vector<int>& latencies) {
+		std::sort(latencies.begin(), latencies.end());
+
+		mean = 0.0;
+		for (size_t i = 0; i < latencies.size(); ++i) {
+			mean += latencies[i];
+		}
+		mean /= latencies.size();
+
+		p50 = latencies[latencies.size() / 2];
+		p99 = latencies[(latencies.size() * 99) / 100];
+		max = latencies.back();
+	}
+
+	double mean;
+	int p50;
+	int p99;
+	int max;
+};
+
+void run_balancing(enum e_balancing_type type, int messages) {
+	// heterogeneous cluster: two fast nodes, a slower one and an overloaded one,
+	// about 0.92 requests per tick in total, offered load is 0.6 per tick,
+	// second fast node degrades to 0.1 requests per tick midway
+	const int slaves[] = { 4, 4, 2, 1 };
+	const int service_times[] = { 10, 10, 20, 50 };
+	const size_t endpoints_count = sizeof(slaves) / sizeof(slaves[0]);
+	const size_t degrading_node = 1;
+	const int degraded_service_time = 40;
+	const double arrival_rate = 0.6;
+	const int heartbeat_interval = 1000; // ticks
+
+	std::vector<fake_endpoint_t> nodes;
+	std::vector<cocaine_endpoint_t> endpoints;
+
+	for (size_t i = 0; i < endpoints_count; ++i) {
+		nodes.push_back(fake_endpoint_t(slaves[i], service_times[i]));
+
+		std::string name = "tcp://node" + boost::lexical_cast<std::string>(i);
+		endpoints.push_back(cocaine_endpoint_t(name, name));
+		endpoints.back().slaves_total = slaves[i];
+	}
+
+	// strategy, loads and latency tracker are driven the way balancer_t does,
+	// one tick is one millisecond
+	std::auto_ptr<balancing_strategy_t> strategy(balancing_strategy_t::create(type));
+	latency_tracker_t tracker;
+	endpoint_loads_t loads(endpoints_count);
+	size_t ejections = 0;
+
+	std::vector<int> arrivals(messages, 0);
+	std::vector<int> latencies;
+	std::vector<int> finished;
+	latencies.reserve(messages);
+
+	double pending_arrivals = 0.0;
+	int sent = 0;
+	int now = 0;
+
+	while (latencies.size() < static_cast<size_t>(messages)) {
+		++now;
+		double now_sec = now / 1000.0;
+
+		if (sent == messages / 2) {
+			nodes[degrading_node].service_time = degraded_service_time;
+		}
+
+		for (size_t i = 0; i < endpoints_count; ++i) {
+			finished.clear();
+			nodes[i].tick(now, finished);
+
+			for (size_t j = 0; j < finished.size(); ++j) {
+				int latency = now - arrivals[finished[j]];
+				latencies.push_back(latency);
+				tracker.response_received(endpoints[i].route, latency / 1000.0, now_sec);
+			}
+
+			loads[i].in_flight = nodes[i].in_flight();
+		}
+
+		// nodes report backlog with heartbeats only
+		if (now % heartbeat_interval == 0) {
+			for (size_t i = 0; i < endpoints_count; ++i) {
+				endpoints[i].backlog = nodes[i].queue.size();
+				endpoints[i].slaves_busy = nodes[i].in_flight() - nodes[i].queue.size();
+			}
+		}
+
+		ejections += tracker.update(endpoints, now_sec, loads);
+		pending_arrivals += arrival_rate;
+
+		for (; pending_arrivals >= 1.0 && sent < messages; pending_arrivals -= 1.0, ++sent) {
+			size_t index = strategy->select(endpoints, loads);
+			arrivals[sent] = now;
+			nodes[index].queue.push_back(sent);
+			++loads[index].in_flight;
+
+			if (loads[index].probing) {
+				tracker.probe_sent(endpoints[index].route, now_sec);
+				loads[index].probing = false;
+				loads[index].ejected = true;
+			}
+		}
+	}
+
+	latency_stats_t stats(latencies);
+
+	std::cout << std::setw(20) << balancing_strategy_t::type_name(type);
+	std::cout << std::setw(10) << std::fixed << std::setprecision(1) << stats.mean;
+	std::cout << std::setw(8) << stats.p50 << std::setw(8) << stats.p99 << std::setw(8) << stats.max;
+	std::cout << std::setw(10) << ejections << "   ";
+
+	for (size_t i = 0; i < endpoints_count; ++i) {
+		std::cout << std::setw(8) << nodes[i].served;
+	}
+
+	std::cout << "\n";
+}
+
+void balancing_benchmark(int messages) {
+	std::cout << "----------------------------------- balancing benchmark ---------------------------------\n";
+	std::cout << messages << " simulated messages, 4 nodes with 4x10, 4x10, 2x20, 1x50 slaves x ticks per request,\n";
+	std::cout << "second node slows down to 4x40 after half of messages are sent\n";
+	std::cout << std::setw(20) << "strategy" << std::setw(10) << "mean" << std::setw(8) << "p50";
+	std::cout << std::setw(8) << "p99" << std::setw(8) << "max" << std::setw(10) << "ejections";
+	std::cout << "   served per node\n";
+
+	run_balancing(BT_ROUND_ROBIN, messages);
+	run_balancing(BT_LEAST_OUTSTANDING, messages);
+	run_balancing(BT_BACKLOG_WEIGHTED, messages);
+	run_balancing(BT_POWER_OF_TWO, messages);
+	run_balancing(BT_PEAK_EWMA, messages);
+}
+
+// ----------------------------------- hedging benchmark -------------------------------------
+
+// queueing model of hedging policy, it uses balancing_strategy_t and deadline_queue_t
+// the way handle_t does, but no handle_t, sockets or cocaine nodes are involved
+void run_hedging(int hedge_after, int messages) {
+	// four equal nodes, one of them has a slow worker which takes
+	// 10 times longer on every 20th request, offered load is about 40%
+	// of capacity, one tick is one millisecond
+	const size_t endpoints_count = 4;
+	const double arrival_rate = 0.6;
+
+	std::vector<fake_endpoint_t> nodes(endpoints_count, fake_endpoint_t(4, 10));
+	nodes[0].slow_every = 20;
+	nodes[0].slow_service_time = 100;
+
+	std::vector<cocaine_endpoint_t> endpoints;
+	for (size_t i = 0; i < endpoints_count; ++i) {
+		std::string name = "tcp://node" + boost::lexical_cast<std::string>(i);
+		endpoints.push_back(cocaine_endpoint_t(name, name));
+	}
+
+	std::auto_ptr<balancing_strategy_t> strategy(balancing_strategy_t::create(BT_ROUND_ROBIN));
+	endpoint_loads_t loads(endpoints_count);
+
+	// first node each request was sent to, -1 once it's answered
+	std::vector<int> arrivals(messages, 0);
+	std::vector<int> first_node(messages, -1);
+	deadline_queue_t<int> hedge_timers;
+	size_t hedged = 0;
+
+	std::vector<int> latencies;
+	std::vector<int> finished;
+	latencies.reserve(messages);
+
+	double pending_arrivals = 0.0;
+	int sent = 0;
+	int now = 0;
+
+	while (latencies.size() < static_cast<size_t>(messages)) {
+		++now;
+
+		for (size_t i = 0; i < endpoints_count; ++i) {
+			finished.clear();
+			nodes[i].tick(now, finished);
+
+			// first copy to respond wins, the other one is dropped
+			for (size_t j = 0; j < finished.size(); ++j) {
+				if (first_node[finished[j]] >= 0) {
+					latencies.push_back(now - arrivals[finished[j]]);
+					first_node[finished[j]] = -1;
+				}
+			}
+		}
+
+		// duplicate unanswered requests to another node
+		int id = 0;
+		while (hedge_timers.pop_due(now, id)) {
+			if (first_node[id] < 0) {
+				continue;
+			}
+
+			loads[first_node[id]].ejected = true;
+			size_t index = strategy->select(endpoints, loads);
+			loads[first_node[id]].ejected = false;
+
+			nodes[index].queue.push_back(id);
+			++hedged;
+		}
+
+		pending_arrivals += arrival_rate;
+
+		for (; pending_arrivals >= 1.0 && sent < messages; pending_arrivals -= 1.0, ++sent) {
+			size_t index = strategy->select(endpoints, loads);
+			arrivals[sent] = now;
+			first_node[sent] = static_cast<int>(index);
+			nodes[index].queue.push_back(sent);
+
+			if (hedge_after > 0) {
+				hedge_timers.push(now + hedge_after, sent);
+			}
+		}
+	}
+
+	latency_stats_t stats(latencies);
+
+	std::cout << std::setw(12) << hedge_after;
+	std::cout << std::setw(10) << std::fixed << std::setprecision(1) << stats.mean;
+	std::cout << std::setw(8) << stats.p50 << std::setw(8) << stats.p99 << std::setw(8) << stats.max;
+	std::cout << std::setw(10) << std::fixed << std::setprecision(1) << (100.0 * hedged) / messages << "%\n";
+}
+
+void hedging_benchmark(int messages) {
+	std::cout << "----------------------------------- hedging benchmark -----------------------------------\n";
+	std::cout << "MODEL: simulated nodes and ticks, handle_t hedging path is not exercised\n";
+	std::cout << messages << " simulated messages, 4 nodes with 4x10 slaves x ticks per request,\n";
+	std::cout << "every 20th request on first node takes 100 ticks, round robin balancing\n";
+	std::cout << std::setw(12) << "hedge after" << std::setw(10) << "mean" << std::setw(8) << "p50";
+	std::cout << std::setw(8) << "p99" << std::setw(8) << "max" << std::setw(11) << "hedged\n";
+
+	int hedge_after[] = { 0, 50, 30, 20, 15 };
+
+	for (size_t i = 0; i < sizeof(hedge_after) / sizeof(hedge_after[0]); ++i) {
+		run_hedging(hedge_after[i], messages);
+	}
+}
+
+int
+main(int argc, char** argv) {
+	try {
+		options_description desc("Allowed options");
+		desc.add_options()
+			("help", "Produce help message")
+			("bench,b", value<std::string>()->default_value("queue"), "Benchmark to run: queue, set_data, alloc, uuid, journal, storage, send, handles, balancing, hedging")
+			("producers,p", value<int>()->default_value(64), "Max number of producer threads")
+			("messages,m", value<int>()->default_value(100000), "Messages per producer")
+			("size,s", value<int>()->default_value(64), "Max payload size in megabytes")
+			("iterations,i", value<int>()->default_value(16), "Iterations per payload size")
+			("config,c", value<std::string>()->default_value("tests/config.json"), "Dealer config for send and handles benchmarks")
+			("handles", value<int>()->default_value(256), "Max number of handles in handles benchmark")
+			("path", value<std::string>()->default_value("/tmp/dealer_bench_eblob"), "Existing directory for journal and storage benchmark eblobs")
+		;
+
+		variables_map vm;
+		store(parse_command_line(argc, argv, desc), vm);
+		notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << std::endl;
+			return EXIT_SUCCESS;
+		}
+
+		std::string bench = vm["bench"].as<std::string>();
+
+		if (bench == "queue") {
+			queue_benchmark(vm["producers"].as<int>(), vm["messages"].as<int>());
+		}
+		else if (bench == "alloc") {
+			allocation_benchmark(vm["messages"].as<int>());
+		}
+		else if (bench == "uuid") {
+			uuid_benchmark(vm["messages"].as<int>());
+		}
+		else if (bench == "journal") {
+			journal_benchmark(vm["path"].as<std::string>(), vm["producers"].as<int>(), vm["messages"].as<int>());
+		}
+		else if (bench == "storage") {
+			storage_benchmark(vm["path"].as<std::string>(), vm["size"].as<int>(), vm["iterations"].as<int>());
+		}
+		else if (bench == "send") {
+			send_benchmark(vm["config"].as<std::string>(), vm["messages"].as<int>());
+		}
+		else if (bench == "handles") {
+			handles_benchmark(vm["config"].as<std::string>(), vm["handles"].as<int>(), vm["messages"].as<int>());
+		}
+		else if (bench == "hedging") {
+			hedging_benchmark(vm["messages"].as<int>());
+		}
+		else if (bench == "balancing") {
+			balancing_benchmark(vm["messages"].as<int>());
+		}
+		else if (bench == "set_data") {
+			set_data_benchmark(vm["size"].as<int>(), vm["iterations"].as<int>());
+		}
+		else {
+			std::cerr << "unknown benchmark: " << bench << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	catch (const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -19,6 +19,10 @@
 */
 
 #include <iostream>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include <boost/program_options.hpp>
 #include <boost/thread.hpp>
@@ -71,19 +75,109 @@ void worker(dealer_t* d,
 		}
 
 		(*dealer_messages_count)[dealer_index] = (*dealer_messages_count)[dealer_index] - 1;
-		sent_messages++;
+		__sync_fetch_and_add(&sent_messages, 1);
+	}
+}
+
+// messages in flight of one async sending thread
+struct async_window_t {
+	async_window_t() : in_flight(0) {}
+
+	int in_flight;
+	boost::mutex mutex;
+	boost::condition_variable cond_var;
+};
+
+void async_done(async_window_t* window, int error_code, const std::string& error_message) {
+	if (error_code != 0) {
+		std::cout << "error code: " << error_code << ", error message: " << error_message << std::endl;
 	}
+
+	__sync_fetch_and_add(&sent_messages, 1);
+
+	boost::mutex::scoped_lock lock(window->mutex);
+	--window->in_flight;
+	window->cond_var.notify_one();
+}
+
+void async_chunk(__attribute__ ((unused)) data_container& data) {
+	//std::cout << std::string(reinterpret_cast<const char*>(data.data()), 0, data.size()) << std::endl;
+}
+
+// keeps up to window_size messages in flight from a single thread
+void async_worker(dealer_t* d,
+				  std::vector<int>* dealer_messages_count,
+				  int dealer_index,
+				  int window_size)
+{
+	message_path_t path("dummy", "hash");
+	message_policy_t policy = d->policy_for_service(path.service_alias);
+	std::string payload = "response chunk: ";
+
+	async_window_t window;
+
+	while (__sync_sub_and_fetch(&(*dealer_messages_count)[dealer_index], 1) >= 0) {
+		{
+			boost::mutex::scoped_lock lock(window.mutex);
+
+			while (window.in_flight >= window_size) {
+				window.cond_var.wait(lock);
+			}
+
+			++window.in_flight;
+		}
+
+		try {
+			d->send_message_async(payload.data(),
+								  payload.size(),
+								  path,
+								  policy,
+								  &async_chunk,
+								  boost::bind(&async_done, &window, _1, _2));
+		}
+		catch (const std::exception& ex) {
+			async_done(&window, -1, ex.what());
+		}
+	}
+
+	// wait for responses of messages left
+	boost::mutex::scoped_lock lock(window.mutex);
+
+	while (window.in_flight > 0) {
+		window.cond_var.wait(lock);
+	}
+}
+
+double cpu_time() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+	double sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+
+	return user + sys;
 }
 
-void create_client(size_t dealers_count, size_t threads_per_dealer, size_t messages_count) {
-	std::string config_path = "tests/config.json";
+double create_client(const std::string& config_path,
+					 size_t dealers_count,
+					 size_t threads_per_dealer,
+					 size_t messages_count,
+					 size_t async_window = 0)
+{
+	sent_messages = 0;
 
 	typedef boost::ptr_vector<boost::thread> thread_pool;
 	typedef boost::ptr_vector<thread_pool> thread_pools_list;
 
 	std::cout << "----------------------------------- test info -------------------------------------------\n";
 	std::cout << "sending " << dealers_count * messages_count << " messages using ";
-	std::cout << dealers_count << " dealers with " << threads_per_dealer << " threads each.\n";
+	std::cout << dealers_count << " dealers with " << threads_per_dealer << " threads each";
+
+	if (async_window > 0) {
+		std::cout << ", async api with " << async_window << " messages in flight per thread";
+	}
+
+	std::cout << ".\n";
 	std::cout << "-----------------------------------------------------------------------------------------\n";
 
 	std::vector<int> dealer_messages_count;
@@ -95,6 +189,7 @@ void create_client(size_t dealers_count, size_t threads_per_dealer, size_t messa
 	}
 
 	progress_timer timer;
+	double cpu_time_start = cpu_time();
 
 	// create threads
 	std::cout << "sending messages...\n";
@@ -105,10 +200,21 @@ void create_client(size_t dealers_count, size_t threads_per_dealer, size_t messa
 
 		for (size_t j = 0; j < threads_per_dealer; ++j) {
 			boost::thread* th;
-			th = new boost::thread(&worker,
-								   &(dealers[i]),
-								   &dealer_messages_count,
-								   i);
+
+			if (async_window > 0) {
+				th = new boost::thread(&async_worker,
+									   &(dealers[i]),
+									   &dealer_messages_count,
+									   i,
+									   async_window);
+			}
+			else {
+				th = new boost::thread(&worker,
+									   &(dealers[i]),
+									   &dealer_messages_count,
+									   i);
+			}
+
 			pool->push_back(th);
 		}
 
@@ -123,12 +229,63 @@ void create_client(size_t dealers_count, size_t threads_per_dealer, size_t messa
 
 	std::cout << "sending messages done.\n";
 
+	double elapsed = timer.elapsed().as_double();
+	double cpu_time_used = cpu_time() - cpu_time_start;
+
 	std::cout << "----------------------------------- test results ----------------------------------------\n";
-	std::cout << "elapsed: " << timer.elapsed().as_double() << std::endl;
+	std::cout << "elapsed: " << elapsed << std::endl;
 	std::cout << "sent: " << sent_messages << " messages.\n";
-	std::cout << "approx performance: " << sent_messages / timer.elapsed().as_double() << " rps." << std::endl;
+	std::cout << "approx performance: " << sent_messages / elapsed << " rps." << std::endl;
+	std::cout << "cpu time: " << cpu_time_used << " secs (" << 100.0 * cpu_time_used / elapsed << "% of one core), ";
+	std::cout << 1000000.0 * cpu_time_used / std::max(sent_messages, 1) << " usecs per message." << std::endl;
 	
 	std::cout << "----------------------------------- shutting dealers down -------------------------------\n";
+
+	return sent_messages / elapsed;
+}
+
+// run the same load with 1, 2, 4 ... max_threads sending threads to see how send path scales
+void sweep_threads(const std::string& config_path,
+				   size_t dealers_count,
+				   size_t max_threads,
+				   size_t messages_count)
+{
+	std::vector<std::pair<size_t, double> > results;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		double rps = create_client(config_path, dealers_count, threads, messages_count);
+		results.push_back(std::make_pair(threads, rps));
+	}
+
+	std::cout << "----------------------------------- scaling -------------------------------------------\n";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		std::cout << "threads: " << results[i].first << ", approx performance: " << results[i].second << " rps";
+		std::cout << " (x" << results[i].second / results[0].second << ")\n";
+	}
+}
+
+// same number of messages in flight, kept by blocking threads and by a single async thread
+void compare_async(const std::string& config_path,
+				   size_t dealers_count,
+				   size_t threads,
+				   size_t messages_count)
+{
+	double cpu_start = cpu_time();
+	double blocking_rps = create_client(config_path, dealers_count, threads, messages_count);
+	double blocking_cpu = cpu_time() - cpu_start;
+
+	cpu_start = cpu_time();
+	double async_rps = create_client(config_path, dealers_count, 1, messages_count, threads);
+	double async_cpu = cpu_time() - cpu_start;
+
+	size_t total = std::max<size_t>(dealers_count * messages_count, 1);
+
+	std::cout << "----------------------------------- blocking vs async ------------------------------------\n";
+	std::cout << "blocking, " << threads << " threads: " << blocking_rps << " rps, ";
+	std::cout << 1000000.0 * blocking_cpu / total << " cpu usecs per message\n";
+	std::cout << "async, 1 thread, " << threads << " in flight: " << async_rps << " rps (x" << async_rps / blocking_rps << "), ";
+	std::cout << 1000000.0 * async_cpu / total << " cpu usecs per message\n";
 }
 
 int
@@ -200,9 +357,13 @@ main(int argc, char** argv) {
 		options_description desc("Allowed options");
 		desc.add_options()
 			("help", "Produce help message")
+			("config,c", value<std::string>()->default_value("tests/config.json"), "Dealer config (io threads, services)")
 			("dealers,d", value<int>()->default_value(1), "Number of dealers to send messages")
 			("threads,t", value<int>()->default_value(1), "Threads per dealer")
 			("messages,m", value<int>()->default_value(1), "Messages per dealer")
+			("sweep,s", "Repeat test with 1, 2, 4 ... up to --threads threads per dealer")
+			("async,a", value<int>()->default_value(0), "Use async api keeping that many messages in flight per thread")
+			("compare", "Compare --threads blocking threads with one async thread keeping as many messages in flight")
 		;
 
 		variables_map vm;
@@ -214,7 +375,26 @@ main(int argc, char** argv) {
 			return EXIT_SUCCESS;
 		}
 		
-		create_client(vm["dealers"].as<int>(), vm["threads"].as<int>(), vm["messages"].as<int>());
+		if (vm.count("compare")) {
+			compare_async(vm["config"].as<std::string>(),
+						  vm["dealers"].as<int>(),
+						  vm["threads"].as<int>(),
+						  vm["messages"].as<int>());
+		}
+		else if (vm.count("sweep")) {
+			sweep_threads(vm["config"].as<std::string>(),
+						  vm["dealers"].as<int>(),
+						  vm["threads"].as<int>(),
+						  vm["messages"].as<int>());
+		}
+		else {
+			create_client(vm["config"].as<std::string>(),
+						  vm["dealers"].as<int>(),
+						  vm["threads"].as<int>(),
+						  vm["messages"].as<int>(),
+						  vm["async"].as<int>());
+		}
+
 		return EXIT_SUCCESS;
 	}
 	catch (const std::exception& ex) {